@@ -0,0 +1,186 @@
+// Compares the receive loop that used to be copy-pasted into every binary
+// (runtime std::vector of channel pointers, encoders and files) against
+// stream::receive() with a file_sink, on a fake rx_streamer that hands out
+// pre-filled buffers without touching hardware.
+//
+//      ./stream_core_bench --nsamps 200000000 --channels 2 --codec pack12
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <complex>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stream_core.hpp"
+
+namespace po = boost::program_options;
+
+using sample_t = std::complex<int16_t>;
+
+// Returns nsamps_per_buff samples per recv() until the requested count is out,
+// like a NUM_SAMPS_AND_DONE stream that never overflows.
+class fake_rx_streamer : public uhd::rx_streamer
+{
+public:
+        fake_rx_streamer(size_t num_channels, size_t spb) : _num_channels(num_channels), _spb(spb) {}
+
+        size_t get_num_channels(void) const override { return _num_channels; }
+        size_t get_max_num_samps(void) const override { return _spb; }
+
+        size_t recv(const buffs_type &buffs, const size_t nsamps_per_buff, uhd::rx_metadata_t &md, const double, const bool) override
+        {
+                md.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+                size_t nsamps = std::min(nsamps_per_buff, _remaining);
+                if (nsamps == 0)
+                {
+                        md.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+                        return 0;
+                }
+                // touch the first sample like the converter would, the rest stays from the previous buffer
+                for (size_t ch = 0; ch < _num_channels; ch++)
+                        static_cast<sample_t *>(buffs[ch])[0] = sample_t(int16_t(_remaining), int16_t(ch));
+                _remaining -= nsamps;
+                return nsamps;
+        }
+
+        void issue_stream_cmd(const uhd::stream_cmd_t &stream_cmd) override
+        {
+                if (stream_cmd.stream_mode == uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE)
+                        _remaining = stream_cmd.num_samps;
+        }
+
+private:
+        size_t _num_channels;
+        size_t _spb;
+        size_t _remaining = 0;
+};
+
+// The loop as it was in test_211 before stream_core.hpp
+size_t legacy_recv(uhd::rx_streamer::sptr rx_stream, size_t spb, size_t num_requested_samples, codec::codec_id codec_id)
+{
+        size_t num_total_samps = 0;
+        uhd::rx_metadata_t md;
+        std::vector<std::vector<sample_t>> buffs(rx_stream->get_num_channels(), std::vector<sample_t>(spb, sample_t(1000, -1000)));
+        std::vector<sample_t *> buff_ptrs;
+        for (size_t i = 0; i < buffs.size(); i++)
+                buff_ptrs.push_back(&buffs[i].front());
+
+        std::vector<std::shared_ptr<std::ofstream>> outfiles;
+        for (size_t i = 0; i < buffs.size(); i++)
+                outfiles.push_back(std::shared_ptr<std::ofstream>(new std::ofstream("/dev/null", std::ofstream::binary)));
+        std::vector<codec::encoder> encoders(outfiles.size(), codec::encoder(codec_id));
+
+        uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+        stream_cmd.num_samps = num_requested_samples;
+        stream_cmd.stream_now = false;
+        rx_stream->issue_stream_cmd(stream_cmd);
+
+        while (num_requested_samples > num_total_samps)
+        {
+                size_t num_rx_samps = rx_stream->recv(buff_ptrs, spb, md, 0.1);
+                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+                        break;
+                if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+                        throw std::runtime_error("Receiver error " + md.strerror());
+
+                num_total_samps += num_rx_samps;
+
+                for (size_t i = 0; i < outfiles.size(); i++)
+                {
+                        codec::view frame = encoders[i].encode(buff_ptrs[i], num_rx_samps);
+                        outfiles[i]->write((const char *)frame.data, frame.size);
+                }
+        }
+        return num_total_samps;
+}
+
+template <size_t N>
+size_t core_recv(uhd::rx_streamer::sptr rx_stream, size_t spb, size_t num_requested_samples, codec::codec_id codec_id)
+{
+        std::vector<std::vector<sample_t>> buffs(N, std::vector<sample_t>(spb, sample_t(1000, -1000)));
+        stream::channel_ptrs<sample_t, N> buff_ptrs;
+        std::array<std::string, N> filenames;
+        for (size_t ch = 0; ch < N; ch++)
+        {
+                buff_ptrs[ch] = &buffs[ch].front();
+                filenames[ch] = "/dev/null";
+        }
+
+        std::streambuf *cout_buf = std::cout.rdbuf(nullptr); // mute the encoder reports
+        size_t num_total_samps;
+        {
+                stream::file_sink<sample_t, N> sink(buff_ptrs, filenames, codec_id);
+                num_total_samps = stream::receive<sample_t, N>(rx_stream, sink, spb, num_requested_samples, 0.0, 1e6);
+        }
+        std::cout.rdbuf(cout_buf);
+        return num_total_samps;
+}
+
+template <typename F>
+double run(const std::string &name, size_t num_requested_samples, size_t repeat, F &&fn)
+{
+        double best = 0.0;
+        for (size_t i = 0; i < repeat; i++)
+        {
+                auto start = std::chrono::steady_clock::now();
+                size_t nsamps = fn();
+                double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (nsamps != num_requested_samples)
+                        throw std::runtime_error(name + " received " + std::to_string(nsamps) + " samples");
+                best = std::max(best, nsamps / secs / 1e6);
+        }
+        std::cout << boost::format("%-8s %10.1f Msps per channel") % name % best << std::endl;
+        return best;
+}
+
+int main(int argc, char *argv[])
+{
+        size_t num_requested_samples, spb, num_channels, repeat;
+        std::string codec_name;
+
+        po::options_description desc("Allowed options");
+        // clang-format off
+        desc.add_options()
+                ("help", "help message")
+                ("nsamps", po::value<size_t>(&num_requested_samples)->default_value(100000000), "samples per channel per run")
+                ("spb", po::value<size_t>(&spb)->default_value(2040), "samples per recv() (B210 sc16 packet)")
+                ("channels", po::value<size_t>(&num_channels)->default_value(2), "number of channels (1 or 2)")
+                ("codec", po::value<std::string>(&codec_name)->default_value("raw"), "sample codec: raw, pack12 or zstd")
+                ("repeat", po::value<size_t>(&repeat)->default_value(5), "runs per loop, the best one is reported")
+        ;
+        // clang-format on
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+                std::cout << "stream_core benchmark " << desc << std::endl;
+                return EXIT_SUCCESS;
+        }
+
+        codec::codec_id codec_id = codec::parse_codec(codec_name);
+        uhd::rx_streamer::sptr rx_stream(new fake_rx_streamer(num_channels, spb));
+
+        std::cout << boost::format("%d channel(s), %d samples per recv(), codec %s") % num_channels % spb % codec_name
+                  << std::endl;
+
+        double legacy = run("legacy", num_requested_samples, repeat, [&]()
+                            { return legacy_recv(rx_stream, spb, num_requested_samples, codec_id); });
+        double core = 0.0;
+        stream::dispatch_channels(num_channels, [&](auto nc)
+                                  {
+                                          constexpr size_t N = decltype(nc)::value;
+                                          core = run("core", num_requested_samples, repeat, [&]()
+                                                     { return core_recv<N>(rx_stream, spb, num_requested_samples, codec_id); });
+                                  });
+
+        std::cout << boost::format("speedup  %10.2fx") % (core / legacy) << std::endl;
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,304 @@
+// Plays a sample file of any length into a transmit stream.
+//
+// Reading the file with ifstream::read() right before every send() stalls the
+// send loop on the disk, so the TX binaries used to load the whole waveform
+// into RAM instead. playback::file_source<T, N> is a transmit source (see
+// stream::transmit_from) fed by a reader thread that keeps a ring of large,
+// page-aligned slots filled ahead of the send loop:
+//
+//      playback::file_source<sample_t, 1> source("recording.dat", spb, true);
+//      stream::transmit_from<sample_t, 1>(tx_stream, source, spb, nsamps, md, timeout);
+//
+// The file is read with O_DIRECT, so a long recording does not push
+// everything else out of the page cache. Unaligned reads (the tail of the
+// file, wrap-around when looping) and file systems without O_DIRECT (tmpfs)
+// go through a normal descriptor with sequential readahead. Every channel
+// sends the same samples. Without loop, the samples after the end of the
+// file are zeros: stream::transmit_from() sends whole spb buffers, so the
+// burst ends with up to spb - 1 of them.
+//
+// The constructor returns once the ring is full, so the burst starts from
+// memory. Sends that had to wait for the reader are counted and reported.
+
+#ifndef FILE_SOURCE_HPP
+#define FILE_SOURCE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sample_arena.hpp"
+#include "trace_events.hpp"
+
+namespace playback
+{
+
+static constexpr size_t BLOCK_SIZE = 4096;        // O_DIRECT alignment of buffers, offsets and lengths
+static constexpr size_t MIN_SLOT_BYTES = 1 << 20; // smallest read of the reader thread
+static constexpr size_t DEFAULT_SLOTS = 8;
+
+template <typename T, size_t N>
+class file_source
+{
+public:
+        // spb: samples per send(). Every slot holds a whole number of sends
+        // and of O_DIRECT blocks.
+        file_source(const std::string &path, size_t spb, bool loop, size_t num_slots = DEFAULT_SLOTS)
+            : _spb(spb), _loop(loop)
+        {
+                if (spb == 0 || num_slots < 2)
+                        throw std::runtime_error("file_source needs spb > 0 and at least 2 slots");
+
+                _buffered = ::open(path.c_str(), O_RDONLY);
+                if (_buffered < 0)
+                        throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+                _direct = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+                posix_fadvise(_buffered, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+                _file_bytes = ::lseek(_buffered, 0, SEEK_END);
+                if (_file_bytes < off_t(sizeof(T)))
+                {
+                        close_files();
+                        throw std::runtime_error("No samples in " + path);
+                }
+
+                size_t send_bytes = spb * sizeof(T);
+                size_t unit = send_bytes / std::gcd(send_bytes, BLOCK_SIZE) * BLOCK_SIZE;
+                _slot_bytes = (MIN_SLOT_BYTES + unit - 1) / unit * unit;
+
+                // the destructor does not run if the constructor throws
+                try
+                {
+                        _arena.reset(new arena::sample_arena(num_slots * _slot_bytes));
+                        _slots.resize(num_slots);
+                        for (slot &s : _slots)
+                                s.data = static_cast<uint8_t *>(_arena->allocate(_slot_bytes));
+
+                        std::cout << "Streaming " << path << ": " << _file_bytes / sizeof(T) << " samples, "
+                                  << num_slots << " x " << _slot_bytes / 1024 << " KiB slots"
+                                  << (_direct >= 0 ? ", O_DIRECT" : ", buffered") << (_loop ? ", looping" : "") << std::endl;
+
+                        _thread = std::thread([this]() { run(); });
+                }
+                catch (...)
+                {
+                        close_files();
+                        throw;
+                }
+
+                // prefetch: start the burst with a full ring
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return _filled == _slots.size() || _eof || _error; });
+                if (_error)
+                {
+                        lock.unlock();
+                        stop();
+                        throw std::runtime_error("Reading " + path + " failed: " + _error_message);
+                }
+        }
+
+        ~file_source()
+        {
+                stop();
+                if (_starved)
+                        std::cerr << _starved << " send(s) waited for the file reader" << std::endl;
+        }
+
+        file_source(const file_source &) = delete;
+        file_source &operator=(const file_source &) = delete;
+
+        std::array<const T *, N> next(size_t, size_t nsamps)
+        {
+                if (nsamps != _spb)
+                        throw std::runtime_error("file_source sends spb samples at a time");
+
+                if (_offset == _slot_bytes || _current == nullptr)
+                        advance();
+
+                const T *p = reinterpret_cast<const T *>(_current->data + _offset);
+                _offset += _spb * sizeof(T);
+                std::array<const T *, N> buffs;
+                buffs.fill(p);
+                return buffs;
+        }
+
+private:
+        struct slot
+        {
+                uint8_t *data = nullptr;
+        };
+
+        // Hands the consumed slot back to the reader and takes the next one
+        void advance()
+        {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_current != nullptr)
+                {
+                        _filled--;
+                        _read = (_read + 1) % _slots.size();
+                        _cv.notify_all();
+                }
+                if (_filled == 0)
+                {
+                        _starved++;
+                        TRACE_SCOPE("tx_file_wait");
+                        _cv.wait(lock, [this]() { return _filled > 0 || _error; });
+                }
+                if (_error)
+                        throw std::runtime_error("Reading the TX file failed: " + _error_message);
+                _current = &_slots[_read];
+                _offset = 0;
+        }
+
+        void run()
+        {
+                trace::set_thread_name("tx_file_reader");
+                size_t write = 0;
+                while (true)
+                {
+                        {
+                                std::unique_lock<std::mutex> lock(_mutex);
+                                _cv.wait(lock, [this]() { return _filled < _slots.size() || _stop; });
+                                if (_stop)
+                                        return;
+                        }
+
+                        // the slot at write is not visible to the consumer until _filled grows
+                        try
+                        {
+                                fill(_slots[write].data);
+                        }
+                        catch (const std::runtime_error &e)
+                        {
+                                std::lock_guard<std::mutex> lock(_mutex);
+                                _error = true;
+                                _error_message = e.what();
+                                _cv.notify_all();
+                                return;
+                        }
+
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _filled++;
+                        _cv.notify_all();
+                        write = (write + 1) % _slots.size();
+                }
+        }
+
+        // One slot from the file position on, wrapping around or zero-padding at the end
+        void fill(uint8_t *data)
+        {
+                size_t done = 0;
+                while (done < _slot_bytes)
+                {
+                        if (_position >= _file_bytes)
+                        {
+                                if (!_loop)
+                                {
+                                        std::memset(data + done, 0, _slot_bytes - done);
+                                        std::lock_guard<std::mutex> lock(_mutex);
+                                        _eof = true;
+                                        return;
+                                }
+                                _position = 0;
+                        }
+
+                        // whole samples only, a trailing partial sample is never sent
+                        size_t want = std::min<size_t>(_slot_bytes - done, (_file_bytes - _position) / sizeof(T) * sizeof(T));
+                        if (want == 0)
+                        {
+                                _position = _file_bytes;
+                                continue;
+                        }
+                        ssize_t n = read_at(data + done, want, _position);
+                        if (n < 0)
+                                throw std::runtime_error(std::strerror(errno));
+                        if (n == 0)
+                        {
+                                _position = _file_bytes;
+                                continue;
+                        }
+                        done += n;
+                        _position += n;
+                }
+        }
+
+        ssize_t read_at(uint8_t *dest, size_t bytes, off_t offset)
+        {
+                bool aligned = reinterpret_cast<uintptr_t>(dest) % BLOCK_SIZE == 0 && bytes % BLOCK_SIZE == 0 && offset % BLOCK_SIZE == 0;
+                if (_direct >= 0 && aligned)
+                {
+                        ssize_t n = ::pread(_direct, dest, bytes, offset);
+                        if (n >= 0 || errno != EINVAL)
+                                return n;
+                        // the file system refuses O_DIRECT after all
+                        ::close(_direct);
+                        _direct = -1;
+                }
+                return ::pread(_buffered, dest, bytes, offset);
+        }
+
+        void stop()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _stop = true;
+                }
+                _cv.notify_all();
+                if (_thread.joinable())
+                        _thread.join();
+                close_files();
+        }
+
+        void close_files()
+        {
+                if (_direct >= 0)
+                        ::close(_direct);
+                if (_buffered >= 0)
+                        ::close(_buffered);
+                _direct = _buffered = -1;
+        }
+
+        size_t _spb;
+        bool _loop;
+        int _buffered = -1;
+        int _direct = -1;
+        off_t _file_bytes = 0;
+        off_t _position = 0; // next byte the reader reads
+        size_t _slot_bytes = 0;
+
+        std::unique_ptr<arena::sample_arena> _arena;
+        std::vector<slot> _slots;
+
+        // consumer side
+        slot *_current = nullptr;
+        size_t _offset = 0; // bytes of _current already sent
+        size_t _read = 0;   // index of _current
+        size_t _starved = 0;
+
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        size_t _filled = 0; // slots ready for the consumer
+        bool _eof = false;
+        bool _stop = false;
+        bool _error = false;
+        std::string _error_message;
+        std::thread _thread;
+};
+
+} // namespace playback
+
+#endif /* FILE_SOURCE_HPP */
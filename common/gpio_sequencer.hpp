@@ -0,0 +1,228 @@
+// Timed GPIO edges on a front-panel bank (FP0 on the B210).
+//
+// Every edge is a timed set_gpio_attr("OUT") command: the FPGA applies it at
+// its time_spec, so scope triggers and marker pulses land on the same clock
+// edge as the TX/RX bursts scheduled for that time. The device only buffers a
+// limited number of timed commands, so the sequencer keeps at most
+// queue_depth edges in flight and tops the queue up as the device time passes
+// them. There is one get_time_now() per refill, not a host round-trip per edge.
+//
+//      gpio::sequencer seq(usrp, 0xF);
+//      seq.add_pulse_train({start, 1e-3, 10e-6, 100, 0x1}); // 100 pulses on pin 0
+//      seq.add({uhd::time_spec_t(start + 0.5), 0x2, 0x2});   // pin 1 high
+//      std::thread gpio_thread([&]() { seq.run(&stop_signal_called); });
+//
+// set_command_time() is shared by every timed command of the motherboard;
+// the edges are queued under timed::command_time_mutex(), so other threads
+// schedule their commands through timed::at() (see timed_command.hpp).
+//
+// On the B210 the timed commands of a radio share one strictly ordered FIFO:
+// a command queued behind an edge waits for that edge's time, and so does
+// get_time_now(). Start run() only after the timed stream commands of the
+// bursts the edges go with were issued (see the issued hook of
+// stream::receive()), or those bursts start late, behind the queued edges.
+//
+// Edge files hold one edge per line, "time mask value", e.g. "12.0 0x1 0x1";
+// empty lines and lines starting with # are skipped.
+
+#ifndef GPIO_SEQUENCER_HPP
+#define GPIO_SEQUENCER_HPP
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "timed_command.hpp"
+
+namespace gpio
+{
+
+struct edge
+{
+        uhd::time_spec_t time;
+        uint32_t mask;  // pins this edge drives
+        uint32_t value; // level of those pins
+};
+
+// count pulses of width seconds every period seconds, high on mask
+struct pulse_train
+{
+        double start;
+        double period;
+        double width;
+        size_t count;
+        uint32_t mask;
+};
+
+// "start,period,width,count[,mask]" as given on the command line
+inline pulse_train parse_pulse_train(const std::string &spec, double start_offset = 0.0)
+{
+        pulse_train train{0.0, 0.0, 0.0, 0, 0x1};
+        char sep;
+        std::istringstream ss(spec);
+        ss >> train.start >> sep >> train.period >> sep >> train.width >> sep >> train.count;
+        if (!ss || train.width <= 0.0 || train.width >= train.period)
+                throw std::runtime_error("Invalid pulse train \"" + spec + "\" (start,period,width,count[,mask], width < period)");
+        std::string mask;
+        if (ss >> sep >> mask)
+                train.mask = std::stoul(mask, nullptr, 0);
+        train.start += start_offset;
+        return train;
+}
+
+inline std::vector<edge> load_edges(const std::string &path, double start_offset = 0.0)
+{
+        std::ifstream file(path);
+        if (!file)
+                throw std::runtime_error("Could not open GPIO edge file " + path);
+
+        std::vector<edge> edges;
+        std::string line;
+        while (std::getline(file, line))
+        {
+                if (line.empty() || line[0] == '#')
+                        continue;
+                std::istringstream ss(line);
+                double time;
+                std::string mask, value;
+                if (!(ss >> time >> mask >> value))
+                        throw std::runtime_error("Invalid GPIO edge \"" + line + "\" in " + path);
+                edges.push_back({uhd::time_spec_t(time + start_offset),
+                                 uint32_t(std::stoul(mask, nullptr, 0)),
+                                 uint32_t(std::stoul(value, nullptr, 0))});
+        }
+        return edges;
+}
+
+class sequencer
+{
+public:
+        // Sets the pins in gpio_line up as ATR-free outputs, driven low.
+        sequencer(uhd::usrp::multi_usrp::sptr usrp,
+                  uint32_t gpio_line,
+                  size_t queue_depth = 16,
+                  const std::string &bank = "FP0",
+                  size_t mboard = 0)
+            : _usrp(usrp), _gpio_line(gpio_line), _queue_depth(queue_depth), _bank(bank), _mboard(mboard)
+        {
+                if (_queue_depth == 0)
+                        throw std::runtime_error("GPIO queue depth must be at least 1");
+                _usrp->set_gpio_attr(_bank, "DDR", 0xFFFFFFFF, _gpio_line, _mboard);
+                _usrp->set_gpio_attr(_bank, "CTRL", 0x0, _gpio_line, _mboard);
+                _usrp->set_gpio_attr(_bank, "OUT", 0x0, _gpio_line, _mboard);
+        }
+
+        void add(const edge &e)
+        {
+                if (e.mask & ~_gpio_line)
+                        throw std::runtime_error(str(boost::format("GPIO mask 0x%X outside of the configured lines 0x%X") % e.mask % _gpio_line));
+                _edges.push_back(e);
+                _sorted = false;
+        }
+
+        void add(const std::vector<edge> &edges)
+        {
+                for (const edge &e : edges)
+                        add(e);
+        }
+
+        void add_pulse_train(const pulse_train &train)
+        {
+                for (size_t i = 0; i < train.count; i++)
+                {
+                        double rise = train.start + i * train.period;
+                        add({uhd::time_spec_t(rise), train.mask, train.mask});
+                        add({uhd::time_spec_t(rise + train.width), train.mask, 0x0});
+                }
+        }
+
+        size_t size() const { return _edges.size(); }
+        bool done() const { return _next == _edges.size() && _in_flight.empty(); }
+
+        // Retires the edges the device time has passed and queues new ones up to
+        // queue_depth. Returns the number of edges queued.
+        size_t poll()
+        {
+                if (!_sorted)
+                        sort();
+
+                uhd::time_spec_t now = _usrp->get_time_now(_mboard);
+                while (!_in_flight.empty() && _in_flight.front() <= now)
+                        _in_flight.pop_front();
+
+                std::lock_guard<std::mutex> lock(timed::command_time_mutex());
+                size_t queued = 0;
+                while (_next < _edges.size() && _in_flight.size() < _queue_depth)
+                {
+                        const edge &e = _edges[_next++];
+                        if (e.time <= now)
+                        {
+                                // a late timed command would still fire, but not where it was scheduled
+                                _late++;
+                                continue;
+                        }
+                        _usrp->set_command_time(e.time, _mboard);
+                        _usrp->set_gpio_attr(_bank, "OUT", e.value, e.mask, _mboard);
+                        _in_flight.push_back(e.time);
+                        queued++;
+                }
+                _usrp->clear_command_time(_mboard);
+                return queued;
+        }
+
+        // Keeps the command queue filled until every edge was applied or *stop is set.
+        void run(const bool *stop = nullptr)
+        {
+                while (!done() && !(stop && *stop))
+                {
+                        poll();
+                        if (_in_flight.empty())
+                                continue;
+                        // refill in batches: sleep until half of the queue is due, at most 100 ms to notice stop
+                        double wait = (_in_flight[_in_flight.size() / 2] - _usrp->get_time_now(_mboard)).get_real_secs();
+                        wait = std::min(std::max(wait, 0.0), 0.1);
+                        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+                }
+                report();
+        }
+
+        void report() const
+        {
+                std::cout << boost::format("GPIO %s: %d edges, %d late (skipped)") % _bank % _edges.size() % _late << std::endl;
+        }
+
+private:
+        void sort()
+        {
+                std::stable_sort(_edges.begin() + _next, _edges.end(),
+                                 [](const edge &a, const edge &b)
+                                 { return a.time < b.time; });
+                _sorted = true;
+        }
+
+        uhd::usrp::multi_usrp::sptr _usrp;
+        uint32_t _gpio_line;
+        size_t _queue_depth;
+        std::string _bank;
+        size_t _mboard;
+
+        std::vector<edge> _edges;
+        size_t _next = 0;
+        bool _sorted = true;
+        std::deque<uhd::time_spec_t> _in_flight;
+        size_t _late = 0;
+};
+
+} // namespace gpio
+
+#endif /* GPIO_SEQUENCER_HPP */
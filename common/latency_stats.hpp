@@ -0,0 +1,325 @@
+// Low-overhead latency histograms for the streaming hot path.
+//
+// Every stage (recv, send, file write, ZMQ send, ...) owns one log-linear
+// histogram (HDR-style: exact below 32 ns, then 16 sub-buckets per power of
+// two, i.e. <= 6.25% relative error). Recording is a handful of relaxed atomic
+// increments, so the rx loop and the transmit_worker thread can record into
+// the same histogram without locks.
+//
+// The LATENCY_SCOPE() macro only does something when the program is built
+// with -DENABLE_LATENCY_STATS (cmake -DENABLE_LATENCY_STATS=ON). Without it
+// the macro expands to nothing and the reporter warns once, then writes the
+// event counts alone.
+//
+// Events that are counted rather than timed (TX underflows, ...) go through
+// stats::count(), which is always compiled in, and are reported next to the
+// histograms, with or without ENABLE_LATENCY_STATS.
+//
+// Usage:
+//      {
+//              LATENCY_SCOPE(stats::stage::rx_recv);
+//              rx_stream->recv(...);
+//      }
+//      stats::count(stats::event::tx_underflow);
+//      stats::reporter rep("stats.jsonl", 1.0); // one JSON line per second
+
+#ifndef LATENCY_STATS_HPP
+#define LATENCY_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace stats
+{
+
+enum class stage : size_t
+{
+        rx_recv,    // rx_stream->recv()
+        tx_send,    // tx_stream->send()
+        file_write, // ofstream::write() of one buffer
+        zmq_send,   // publisher.send() of one buffer
+        encode,     // sc16 codec stage on one buffer
+        tx_weights, // rendering the weighted transmit buffers
+        num_stages
+};
+
+inline const char *stage_name(stage s)
+{
+        switch (s)
+        {
+        case stage::rx_recv:
+                return "rx_recv";
+        case stage::tx_send:
+                return "tx_send";
+        case stage::file_write:
+                return "file_write";
+        case stage::zmq_send:
+                return "zmq_send";
+        case stage::encode:
+                return "encode";
+        case stage::tx_weights:
+                return "tx_weights";
+        default:
+                return "unknown";
+        }
+}
+
+enum class event : size_t
+{
+        tx_underflow,  // async TX message: underflow (between or inside packets)
+        tx_seq_error,  // async TX message: packet loss between host and device
+        tx_time_error, // async TX message: packet arrived after its time spec
+        num_events
+};
+
+inline const char *event_name(event e)
+{
+        switch (e)
+        {
+        case event::tx_underflow:
+                return "tx_underflow";
+        case event::tx_seq_error:
+                return "tx_seq_error";
+        case event::tx_time_error:
+                return "tx_time_error";
+        default:
+                return "unknown";
+        }
+}
+
+inline std::atomic<uint64_t> &event_count(event e)
+{
+        static std::array<std::atomic<uint64_t>, static_cast<size_t>(event::num_events)> counts{};
+        return counts[static_cast<size_t>(e)];
+}
+
+inline void count(event e) noexcept
+{
+        event_count(e).fetch_add(1, std::memory_order_relaxed);
+}
+
+class latency_histogram
+{
+public:
+        // 32 exact buckets + 16 sub-buckets for every octave up to 2^40 ns (~18 min)
+        static constexpr unsigned SUB_BITS = 4;
+        static constexpr unsigned SUB_COUNT = 1u << SUB_BITS;
+        static constexpr unsigned MAX_MSB = 40;
+        static constexpr size_t NUM_BUCKETS = 2 * SUB_COUNT + (MAX_MSB - SUB_BITS) * SUB_COUNT;
+
+        void record(uint64_t ns) noexcept
+        {
+                buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+                count.fetch_add(1, std::memory_order_relaxed);
+                sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+                uint64_t prev = max_ns.load(std::memory_order_relaxed);
+                while (ns > prev && !max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+                {
+                }
+        }
+
+        // highest value (ns) that falls in the same bucket as the p-th percentile, p in [0, 1]
+        uint64_t percentile(double p) const
+        {
+                uint64_t total = count.load(std::memory_order_relaxed);
+                if (total == 0)
+                        return 0;
+
+                uint64_t target = static_cast<uint64_t>(p * total + 0.5);
+                if (target == 0)
+                        target = 1;
+
+                uint64_t seen = 0;
+                for (size_t i = 0; i < NUM_BUCKETS; i++)
+                {
+                        seen += buckets[i].load(std::memory_order_relaxed);
+                        if (seen >= target)
+                                return bucket_upper(i);
+                }
+                return max_ns.load(std::memory_order_relaxed);
+        }
+
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+
+private:
+        static size_t bucket_index(uint64_t ns) noexcept
+        {
+                if (ns < 2 * SUB_COUNT)
+                        return static_cast<size_t>(ns);
+
+                unsigned msb = 63 - __builtin_clzll(ns);
+                if (msb > MAX_MSB)
+                        return NUM_BUCKETS - 1;
+
+                unsigned shift = msb - SUB_BITS;
+                size_t top = static_cast<size_t>(ns >> shift); // in [SUB_COUNT, 2 * SUB_COUNT)
+                return 2 * SUB_COUNT + (shift - 1) * SUB_COUNT + (top - SUB_COUNT);
+        }
+
+        static uint64_t bucket_upper(size_t index) noexcept
+        {
+                if (index < 2 * SUB_COUNT)
+                        return index;
+
+                unsigned shift = static_cast<unsigned>((index - 2 * SUB_COUNT) / SUB_COUNT) + 1;
+                uint64_t top = (index - 2 * SUB_COUNT) % SUB_COUNT + SUB_COUNT;
+                return ((top + 1) << shift) - 1;
+        }
+
+        std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets{};
+};
+
+inline latency_histogram &histogram(stage s)
+{
+        static std::array<latency_histogram, static_cast<size_t>(stage::num_stages)> histograms;
+        return histograms[static_cast<size_t>(s)];
+}
+
+class scoped_timer
+{
+public:
+        explicit scoped_timer(stage s) noexcept
+            : _stage(s), _start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~scoped_timer()
+        {
+                auto elapsed = std::chrono::steady_clock::now() - _start;
+                histogram(_stage).record(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+        scoped_timer(const scoped_timer &) = delete;
+        scoped_timer &operator=(const scoped_timer &) = delete;
+
+private:
+        stage _stage;
+        std::chrono::steady_clock::time_point _start;
+};
+
+// One JSON object per line, e.g.
+// {"t":12.0,"rx_recv":{"count":2930,"mean_us":341.2,"p50_us":335.9,"p99_us":512.0,"p999_us":1023.9,"max_us":2210.3}, ...,"events":{"tx_underflow":3}}
+inline std::string to_json_line(double t)
+{
+        std::string line = "{\"t\":" + std::to_string(t);
+        char buf[256];
+        for (size_t i = 0; i < static_cast<size_t>(stage::num_stages); i++)
+        {
+                const latency_histogram &h = histogram(static_cast<stage>(i));
+                uint64_t n = h.count.load(std::memory_order_relaxed);
+                if (n == 0)
+                        continue;
+                std::snprintf(buf, sizeof(buf),
+                              ",\"%s\":{\"count\":%llu,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}",
+                              stage_name(static_cast<stage>(i)),
+                              static_cast<unsigned long long>(n),
+                              h.sum_ns.load(std::memory_order_relaxed) / 1e3 / n,
+                              h.percentile(0.5) / 1e3,
+                              h.percentile(0.99) / 1e3,
+                              h.percentile(0.999) / 1e3,
+                              h.max_ns.load(std::memory_order_relaxed) / 1e3);
+                line += buf;
+        }
+
+        std::string events;
+        for (size_t i = 0; i < static_cast<size_t>(event::num_events); i++)
+        {
+                uint64_t n = event_count(static_cast<event>(i)).load(std::memory_order_relaxed);
+                if (n == 0)
+                        continue;
+                std::snprintf(buf, sizeof(buf), "%s\"%s\":%llu", events.empty() ? "" : ",",
+                              event_name(static_cast<event>(i)), static_cast<unsigned long long>(n));
+                events += buf;
+        }
+        if (!events.empty())
+                line += ",\"events\":{" + events + "}";
+
+        line += "}";
+        return line;
+}
+
+// Periodically appends to_json_line() to a file ("-" for stderr) from a
+// background thread. A final line is written when the reporter goes out of scope.
+class reporter
+{
+public:
+        reporter(const std::string &path, double period_s)
+        {
+                if (path.empty())
+                        return;
+#ifndef ENABLE_LATENCY_STATS
+                std::cerr << "Latency stats requested but this binary was built without ENABLE_LATENCY_STATS, "
+                             "only the event counts are reported" << std::endl;
+#endif
+                _out = (path == "-") ? stderr : std::fopen(path.c_str(), "a");
+                if (_out == nullptr)
+                {
+                        std::cerr << "Could not open stats file " << path << std::endl;
+                        return;
+                }
+                _start = std::chrono::steady_clock::now();
+                _thread = std::thread([this, period_s]() {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        while (!_cv.wait_for(lock, std::chrono::duration<double>(period_s), [this]() { return _stop; }))
+                                write_line();
+                });
+        }
+
+        ~reporter()
+        {
+                if (!_thread.joinable())
+                        return;
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _stop = true;
+                }
+                _cv.notify_all();
+                _thread.join();
+                write_line();
+                if (_out != stderr)
+                        std::fclose(_out);
+        }
+
+        reporter(const reporter &) = delete;
+        reporter &operator=(const reporter &) = delete;
+
+private:
+        void write_line()
+        {
+                std::chrono::duration<double> t = std::chrono::steady_clock::now() - _start;
+                std::fprintf(_out, "%s\n", to_json_line(t.count()).c_str());
+                std::fflush(_out);
+        }
+
+        std::FILE *_out = nullptr;
+        std::chrono::steady_clock::time_point _start;
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _stop = false;
+};
+
+} // namespace stats
+
+#define LATENCY_STATS_CONCAT_(a, b) a##b
+#define LATENCY_STATS_CONCAT(a, b) LATENCY_STATS_CONCAT_(a, b)
+
+#ifdef ENABLE_LATENCY_STATS
+#define LATENCY_SCOPE(s) stats::scoped_timer LATENCY_STATS_CONCAT(_latency_scope_, __LINE__)(s)
+#else
+#define LATENCY_SCOPE(s)
+#endif
+
+#endif /* LATENCY_STATS_HPP */
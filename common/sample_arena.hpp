@@ -0,0 +1,144 @@
+// Session-wide arena for sample buffers.
+//
+// The arena is mapped once from 2 MB huge pages (MAP_HUGETLB, falling back to
+// transparent huge pages when no hugetlbfs pages are reserved), optionally
+// bound to one NUMA node, and pre-faulted by the constructing thread. Carve the
+// per-channel buffers out of it once and reuse them for every calibration
+// cycle, so the receive loop never allocates or takes a page fault.
+//
+// Construct the arena from the thread that will use the buffers, after its
+// placement is applied: without an explicit node the pages land on the node
+// of the first toucher.
+//
+// Reserve huge pages beforehand, e.g.
+//      echo 8 | sudo tee /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages
+
+#ifndef SAMPLE_ARENA_HPP
+#define SAMPLE_ARENA_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace arena
+{
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+static constexpr size_t ALIGNMENT = 64; // cache line, enough for AVX-512 loads
+
+template <typename T>
+struct channel_buffers
+{
+        std::vector<T *> ptrs; // one per channel, as expected by recv()/send()
+        size_t nsamps = 0;     // capacity of each buffer
+};
+
+class sample_arena
+{
+public:
+        // numa_node < 0: no binding, first touch decides
+        sample_arena(size_t bytes, int numa_node = -1)
+        {
+                _size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                if (_size == 0)
+                        _size = HUGE_PAGE_SIZE;
+
+                void *p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (p == MAP_FAILED)
+                {
+                        p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                        if (p == MAP_FAILED)
+                                throw std::runtime_error("Could not map sample arena: " + std::string(std::strerror(errno)));
+                        madvise(p, _size, MADV_HUGEPAGE);
+                        _kind = "transparent huge pages";
+                }
+                _base = static_cast<uint8_t *>(p);
+
+                if (numa_node >= 0)
+                        bind(numa_node);
+
+                // pre-fault every page now instead of in the receive loop
+                std::memset(_base, 0, _size);
+
+                std::cout << "Sample arena: " << _size / 1024 << " KiB, " << _kind;
+                if (numa_node >= 0)
+                        std::cout << ", NUMA node " << numa_node;
+                std::cout << std::endl;
+        }
+
+        ~sample_arena()
+        {
+                munmap(_base, _size);
+        }
+
+        sample_arena(const sample_arena &) = delete;
+        sample_arena &operator=(const sample_arena &) = delete;
+
+        void *allocate(size_t bytes)
+        {
+                size_t offset = (_used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+                if (offset + bytes > _size)
+                        throw std::runtime_error("Sample arena exhausted");
+                _used = offset + bytes;
+                return _base + offset;
+        }
+
+        template <typename T>
+        channel_buffers<T> allocate_channels(size_t num_channels, size_t nsamps)
+        {
+                channel_buffers<T> buffs;
+                buffs.nsamps = nsamps;
+                for (size_t ch = 0; ch < num_channels; ch++)
+                        buffs.ptrs.push_back(static_cast<T *>(allocate(nsamps * sizeof(T))));
+                return buffs;
+        }
+
+        // arena size needed for allocate_channels<T>(num_channels, nsamps)
+        template <typename T>
+        static size_t channel_bytes(size_t num_channels, size_t nsamps)
+        {
+                return num_channels * ((nsamps * sizeof(T) + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+        }
+
+private:
+        void bind(int numa_node)
+        {
+                // mbind(2) through syscall() so libnuma is not required; MPOL_BIND = 2
+                const unsigned long mpol_bind = 2;
+                unsigned long nodemask[4] = {0};
+                if (numa_node >= static_cast<int>(sizeof(nodemask) * 8))
+                        throw std::runtime_error("NUMA node out of range");
+                nodemask[numa_node / (sizeof(unsigned long) * 8)] |= 1ul << (numa_node % (sizeof(unsigned long) * 8));
+                if (syscall(SYS_mbind, _base, _size, mpol_bind, nodemask, sizeof(nodemask) * 8, 0) != 0)
+                        std::cerr << "Could not bind sample arena to NUMA node " << numa_node << ": "
+                                  << std::strerror(errno) << std::endl;
+        }
+
+        uint8_t *_base = nullptr;
+        size_t _size = 0;
+        size_t _used = 0;
+        const char *_kind = "huge pages";
+};
+
+// Views byte buffers from allocate_channels<uint8_t>() as another sample type
+template <typename T>
+channel_buffers<T> view_as(const channel_buffers<uint8_t> &bytes)
+{
+        channel_buffers<T> buffs;
+        buffs.nsamps = bytes.nsamps / sizeof(T);
+        for (uint8_t *p : bytes.ptrs)
+                buffs.ptrs.push_back(reinterpret_cast<T *>(p));
+        return buffs;
+}
+
+} // namespace arena
+
+#endif /* SAMPLE_ARENA_HPP */
@@ -0,0 +1,101 @@
+// Host sample types of the receive pipeline and their properties.
+//
+// recv_to_file, the codec stage and the readers are written once as templates
+// over the sample type; traits<T> gives the UHD cpu format, the id stored in
+// frame headers and the full-scale value used to normalise to [-1, 1).
+//
+// The --type option keeps its rx_samples_to_file meaning (sample type in the
+// file / ZMQ frames): "char" (sc8), "short" (sc16) or "float" (fc32). With
+// --otw sc8 and --type char, every stage moves half the bytes of sc16.
+
+#ifndef SAMPLE_FORMAT_HPP
+#define SAMPLE_FORMAT_HPP
+
+#include <complex>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace sample
+{
+
+enum class format : uint8_t
+{
+        sc16 = 0, // 0 so that frames without a format field read as sc16
+        sc8 = 1,
+        fc32 = 2
+};
+
+template <typename T>
+struct traits;
+
+template <>
+struct traits<std::complex<int8_t>>
+{
+        static constexpr format id = format::sc8;
+        static constexpr const char *cpu_format = "sc8";
+        static constexpr float full_scale = 128.0f;
+};
+
+template <>
+struct traits<std::complex<int16_t>>
+{
+        static constexpr format id = format::sc16;
+        static constexpr const char *cpu_format = "sc16";
+        static constexpr float full_scale = 32768.0f;
+};
+
+template <>
+struct traits<std::complex<float>>
+{
+        static constexpr format id = format::fc32;
+        static constexpr const char *cpu_format = "fc32";
+        static constexpr float full_scale = 1.0f;
+};
+
+inline format parse_type(const std::string &type)
+{
+        if (type == "char")
+                return format::sc8;
+        if (type == "short")
+                return format::sc16;
+        if (type == "float")
+                return format::fc32;
+        throw std::runtime_error("Unknown type " + type + " (char, short or float)");
+}
+
+inline const char *cpu_format(format f)
+{
+        switch (f)
+        {
+        case format::sc8:
+                return traits<std::complex<int8_t>>::cpu_format;
+        case format::fc32:
+                return traits<std::complex<float>>::cpu_format;
+        default:
+                return traits<std::complex<int16_t>>::cpu_format;
+        }
+}
+
+// Calls fn with a value of the matching sample type, e.g.
+//      sample::dispatch(fmt, [&](auto tag) { recv<decltype(tag)>(...); });
+template <typename F>
+void dispatch(format f, F &&fn)
+{
+        switch (f)
+        {
+        case format::sc8:
+                fn(std::complex<int8_t>());
+                break;
+        case format::sc16:
+                fn(std::complex<int16_t>());
+                break;
+        case format::fc32:
+                fn(std::complex<float>());
+                break;
+        }
+}
+
+} // namespace sample
+
+#endif /* SAMPLE_FORMAT_HPP */
@@ -0,0 +1,354 @@
+// Optional codec stage for sc16 captures (files and ZMQ frames).
+//
+//  raw    : interleaved int16 I/Q, unframed, byte for byte what was written before
+//  pack12 : two 12-bit values in 3 bytes (25% smaller). Only lossless when the
+//           4 LSBs of every value are zero, which is the case for --otw sc12 or
+//           when the FPGA does not decimate; otherwise that frame is stored raw
+//  zstd   : per-component delta, byte-plane split and zstd level 1, lossless
+//           for any input (needs libzstd, see HAVE_ZSTD)
+//
+// Every non-raw buffer becomes one frame: a 16-byte frame_header followed by
+// the payload. The matching readers are decode() below and sc16_codec.py.
+//
+// sc8 and fc32 buffers (see sample_format.hpp) have no packed codecs; they are
+// always framed as raw so the reader can tell the sample type.
+//
+// Usage:
+//      codec::encoder enc(codec::parse_codec("pack12"));
+//      codec::view frame = enc.encode(buff_ptrs[0], num_rx_samps);
+//      outfile.write((const char *)frame.data, frame.size);
+//      ...
+//      enc.report(); // compression ratio and throughput of the encoding thread
+
+#ifndef SC16_CODEC_HPP
+#define SC16_CODEC_HPP
+
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "sample_format.hpp"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace codec
+{
+
+using sc16 = std::complex<int16_t>;
+
+enum class codec_id : uint8_t
+{
+        raw = 0,
+        pack12 = 1,
+        zstd = 2
+};
+
+inline const char *codec_name(codec_id id)
+{
+        switch (id)
+        {
+        case codec_id::raw:
+                return "raw";
+        case codec_id::pack12:
+                return "pack12";
+        case codec_id::zstd:
+                return "zstd";
+        default:
+                return "unknown";
+        }
+}
+
+inline codec_id parse_codec(const std::string &name)
+{
+        if (name == "raw")
+                return codec_id::raw;
+        if (name == "pack12")
+                return codec_id::pack12;
+        if (name == "zstd")
+        {
+#ifndef HAVE_ZSTD
+                throw std::runtime_error("zstd codec requested but this binary was built without libzstd");
+#endif
+                return codec_id::zstd;
+        }
+        throw std::runtime_error("Unknown codec " + name + " (raw, pack12 or zstd)");
+}
+
+// "SC12" in memory, all fields little-endian (host order on x86/ARM)
+static constexpr uint32_t FRAME_MAGIC = 0x32314353;
+static constexpr uint8_t FRAME_VERSION = 1;
+
+struct frame_header
+{
+        uint32_t magic;
+        uint8_t version;        // FRAME_VERSION
+        uint8_t codec;          // codec_id actually used for this frame
+        uint8_t format;         // sample::format of the decoded samples
+        uint8_t reserved;       // 0
+        uint32_t nsamps;        // complex samples in the frame
+        uint32_t payload_bytes; // bytes following the header
+};
+static_assert(sizeof(frame_header) == 16, "frame_header must stay 16 bytes");
+
+struct view
+{
+        const uint8_t *data;
+        size_t size;
+};
+
+/***********************************************************************
+ * 12-bit packing
+ **********************************************************************/
+// true when dropping the 4 LSBs loses nothing
+inline bool fits_12bit(const sc16 *in, size_t n)
+{
+        const int16_t *v = reinterpret_cast<const int16_t *>(in);
+        int16_t acc = 0;
+        for (size_t i = 0; i < 2 * n; i++)
+                acc |= v[i];
+        return (acc & 0xF) == 0;
+}
+
+// out must hold 3 * n bytes
+inline void pack12(const sc16 *in, size_t n, uint8_t *out)
+{
+        const int16_t *v = reinterpret_cast<const int16_t *>(in);
+        size_t i = 0;
+        // 4 samples (8 values, 96 bits) per iteration as one 64-bit and one 32-bit store
+        for (; i + 4 <= n; i += 4, v += 8, out += 12)
+        {
+                uint64_t u[8];
+                for (int k = 0; k < 8; k++)
+                        u[k] = static_cast<uint16_t>(v[k]) >> 4;
+                uint64_t lo = u[0] | u[1] << 12 | u[2] << 24 | u[3] << 36 | u[4] << 48 | u[5] << 60;
+                uint32_t hi = static_cast<uint32_t>(u[5] >> 4 | u[6] << 8 | u[7] << 20);
+                std::memcpy(out, &lo, 8);
+                std::memcpy(out + 8, &hi, 4);
+        }
+        for (; i < n; i++, v += 2, out += 3)
+        {
+                uint16_t a = static_cast<uint16_t>(v[0]) >> 4;
+                uint16_t b = static_cast<uint16_t>(v[1]) >> 4;
+                out[0] = a & 0xFF;
+                out[1] = (a >> 8) | ((b & 0xF) << 4);
+                out[2] = b >> 4;
+        }
+}
+
+inline void unpack12(const uint8_t *in, size_t n, sc16 *out)
+{
+        int16_t *v = reinterpret_cast<int16_t *>(out);
+        for (size_t i = 0; i < n; i++, in += 3, v += 2)
+        {
+                uint16_t a = in[0] | ((in[1] & 0xF) << 8);
+                uint16_t b = (in[1] >> 4) | (in[2] << 4);
+                v[0] = static_cast<int16_t>(a << 4);
+                v[1] = static_cast<int16_t>(b << 4);
+        }
+}
+
+/***********************************************************************
+ * delta + byte planes (+ zstd)
+ **********************************************************************/
+// out must hold 4 * n bytes: all low bytes first, then all high bytes
+inline void delta_planes(const sc16 *in, size_t n, uint8_t *out)
+{
+        const int16_t *v = reinterpret_cast<const int16_t *>(in);
+        uint16_t prev_i = 0, prev_q = 0;
+        uint8_t *lo = out, *hi = out + 2 * n;
+        for (size_t i = 0; i < n; i++)
+        {
+                uint16_t di = static_cast<uint16_t>(v[2 * i]) - prev_i;
+                uint16_t dq = static_cast<uint16_t>(v[2 * i + 1]) - prev_q;
+                prev_i = static_cast<uint16_t>(v[2 * i]);
+                prev_q = static_cast<uint16_t>(v[2 * i + 1]);
+                lo[2 * i] = di & 0xFF;
+                lo[2 * i + 1] = dq & 0xFF;
+                hi[2 * i] = di >> 8;
+                hi[2 * i + 1] = dq >> 8;
+        }
+}
+
+inline void undelta_planes(const uint8_t *in, size_t n, sc16 *out)
+{
+        int16_t *v = reinterpret_cast<int16_t *>(out);
+        const uint8_t *lo = in, *hi = in + 2 * n;
+        uint16_t acc_i = 0, acc_q = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+                acc_i += static_cast<uint16_t>(lo[2 * i] | hi[2 * i] << 8);
+                acc_q += static_cast<uint16_t>(lo[2 * i + 1] | hi[2 * i + 1] << 8);
+                v[2 * i] = static_cast<int16_t>(acc_i);
+                v[2 * i + 1] = static_cast<int16_t>(acc_q);
+        }
+}
+
+/***********************************************************************
+ * encoder / decoder
+ **********************************************************************/
+class encoder
+{
+public:
+        explicit encoder(codec_id id) : _id(id) {}
+
+        codec_id id() const { return _id; }
+
+        // The returned view stays valid until the next call. Raw sc16 returns the input itself.
+        template <typename sample_type>
+        view encode(const sample_type *in, size_t n)
+        {
+                auto start = std::chrono::steady_clock::now();
+                view out = encode_frame(in, n);
+                _encode_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                _bytes_in += n * sizeof(sample_type);
+                _bytes_out += out.size;
+                return out;
+        }
+
+        // compression ratio and throughput of the thread that called encode()
+        void report() const
+        {
+                if (_id == codec_id::raw || _bytes_out == 0)
+                        return;
+                double mb_in = _bytes_in / 1e6;
+                std::cout << boost::format("[codec] %s: %.1f MB -> %.1f MB (%.2fx), %.0f MB/s on one core, %d raw fallback frames")
+                                 % codec_name(_id) % mb_in % (_bytes_out / 1e6) % (double(_bytes_in) / _bytes_out)
+                                 % (_encode_ns > 0 ? mb_in / (_encode_ns / 1e9) : 0.0) % _fallback_frames
+                          << std::endl;
+        }
+
+private:
+        template <typename sample_type>
+        view encode_frame(const sample_type *in, size_t n)
+        {
+                constexpr sample::format fmt = sample::traits<sample_type>::id;
+                size_t payload = n * sizeof(sample_type);
+                _frame.resize(sizeof(frame_header) + payload);
+                std::memcpy(_frame.data() + sizeof(frame_header), in, payload);
+                frame_header h{FRAME_MAGIC, FRAME_VERSION, static_cast<uint8_t>(codec_id::raw), static_cast<uint8_t>(fmt), 0,
+                               static_cast<uint32_t>(n), static_cast<uint32_t>(payload)};
+                std::memcpy(_frame.data(), &h, sizeof(h));
+                return view{_frame.data(), _frame.size()};
+        }
+
+        view encode_frame(const sc16 *in, size_t n)
+        {
+                if (_id == codec_id::raw)
+                        return view{reinterpret_cast<const uint8_t *>(in), n * sizeof(sc16)};
+
+                codec_id used = _id;
+                size_t payload = 0;
+                if (_id == codec_id::pack12 && fits_12bit(in, n))
+                {
+                        _frame.resize(sizeof(frame_header) + 3 * n);
+                        pack12(in, n, _frame.data() + sizeof(frame_header));
+                        payload = 3 * n;
+                }
+#ifdef HAVE_ZSTD
+                else if (_id == codec_id::zstd)
+                {
+                        _scratch.resize(4 * n);
+                        delta_planes(in, n, _scratch.data());
+                        _frame.resize(sizeof(frame_header) + ZSTD_compressBound(_scratch.size()));
+                        payload = ZSTD_compress(_frame.data() + sizeof(frame_header), _frame.size() - sizeof(frame_header),
+                                                _scratch.data(), _scratch.size(), 1);
+                        if (ZSTD_isError(payload))
+                                throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(payload));
+                        _frame.resize(sizeof(frame_header) + payload);
+                }
+#endif
+                else
+                {
+                        used = codec_id::raw;
+                        payload = n * sizeof(sc16);
+                        _frame.resize(sizeof(frame_header) + payload);
+                        std::memcpy(_frame.data() + sizeof(frame_header), in, payload);
+                        _fallback_frames++;
+                }
+
+                frame_header h{FRAME_MAGIC, FRAME_VERSION, static_cast<uint8_t>(used), static_cast<uint8_t>(sample::format::sc16), 0,
+                               static_cast<uint32_t>(n), static_cast<uint32_t>(payload)};
+                std::memcpy(_frame.data(), &h, sizeof(h));
+                return view{_frame.data(), _frame.size()};
+        }
+
+        codec_id _id;
+        std::vector<uint8_t> _frame;
+        std::vector<uint8_t> _scratch;
+        uint64_t _bytes_in = 0;
+        uint64_t _bytes_out = 0;
+        uint64_t _encode_ns = 0;
+        uint64_t _fallback_frames = 0;
+};
+
+// Decodes one sc16 frame (or, without a frame header, the whole buffer as raw
+// int16 I/Q) and appends the samples to out. Returns the bytes consumed. Only
+// the full magic, version and reserved byte make a frame header, and a frame
+// whose samples do not fit its payload is rejected.
+inline size_t decode(const uint8_t *data, size_t size, std::vector<sc16> &out)
+{
+        frame_header h;
+        if (size < sizeof(h) || (std::memcpy(&h, data, sizeof(h)), h.magic != FRAME_MAGIC) ||
+            h.version != FRAME_VERSION || h.reserved != 0)
+        {
+                size_t n = size / sizeof(sc16);
+                size_t old = out.size();
+                out.resize(old + n);
+                std::memcpy(out.data() + old, data, n * sizeof(sc16));
+                return size;
+        }
+        if (sizeof(h) + h.payload_bytes > size)
+                throw std::runtime_error("Truncated sc16 frame");
+        if (h.format != static_cast<uint8_t>(sample::format::sc16))
+                throw std::runtime_error("decode() only handles sc16 frames");
+        // one channel per frame; zstd checks its decompressed size below
+        size_t needed = 0;
+        if (h.codec == static_cast<uint8_t>(codec_id::raw))
+                needed = size_t(h.nsamps) * sizeof(sc16);
+        else if (h.codec == static_cast<uint8_t>(codec_id::pack12))
+                needed = 3 * size_t(h.nsamps);
+        if (needed > h.payload_bytes)
+                throw std::runtime_error("Corrupt sc16 frame, the samples do not fit its payload");
+
+        const uint8_t *payload = data + sizeof(h);
+        size_t old = out.size();
+        out.resize(old + h.nsamps);
+        switch (static_cast<codec_id>(h.codec))
+        {
+        case codec_id::raw:
+                std::memcpy(out.data() + old, payload, h.nsamps * sizeof(sc16));
+                break;
+        case codec_id::pack12:
+                unpack12(payload, h.nsamps, out.data() + old);
+                break;
+        case codec_id::zstd:
+        {
+#ifdef HAVE_ZSTD
+                std::vector<uint8_t> planes(4 * size_t(h.nsamps));
+                size_t got = ZSTD_decompress(planes.data(), planes.size(), payload, h.payload_bytes);
+                if (ZSTD_isError(got) || got != planes.size())
+                        throw std::runtime_error("Corrupt zstd sc16 frame");
+                undelta_planes(planes.data(), h.nsamps, out.data() + old);
+                break;
+#else
+                throw std::runtime_error("zstd sc16 frame but this binary was built without libzstd");
+#endif
+        }
+        default:
+                throw std::runtime_error("Unknown sc16 codec in frame");
+        }
+        return sizeof(h) + h.payload_bytes;
+}
+
+} // namespace codec
+
+#endif /* SC16_CODEC_HPP */
@@ -0,0 +1,449 @@
+// Shared streaming loops for every binary that receives or transmits samples.
+//
+// receive() and transmit() are templated on the sample type and the channel
+// count, so the per-channel work (buffer pointers, file writes, ...) is a
+// fixed-size std::array the compiler unrolls, and the sink is a policy class
+// whose consume() is inlined into the loop. Runtime channel counts and --type
+// values are turned into template arguments once, outside the loop:
+//
+//      sample::dispatch(rx_format, [&](auto tag) {
+//              using sample_type = decltype(tag);
+//              stream::dispatch_channels(rx_channel_nums.size(), [&](auto nc) {
+//                      constexpr size_t N = decltype(nc)::value;
+//                      stream::file_sink<sample_type, N> sink(buffs, names, codec_id);
+//                      stream::receive<sample_type, N>(rx_stream, sink, spb, nsamps, start_time, rate, &stop_signal_called);
+//              });
+//      });
+//
+// A sink provides the buffers the next recv() writes to and consumes what was
+// received:
+//      std::array<sample_type *, N> buffers();
+//      void consume(const std::array<sample_type *, N> &buffs, size_t nsamps);
+// Sinks that need the time of a block (e.g. sweep::step_sink) take the
+// metadata as well:
+//      void consume(const std::array<sample_type *, N> &buffs, size_t nsamps, const uhd::rx_metadata_t &md);
+//
+// On the transmit side, transmit_from() asks a source for the buffers of
+// every send(), first_sample counting from the start of the burst (see
+// weights::source in tx_weights.hpp):
+//      std::array<const sample_type *, N> next(size_t first_sample, size_t nsamps);
+
+#ifndef STREAM_CORE_HPP
+#define STREAM_CORE_HPP
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/format.hpp>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "latency_stats.hpp"
+#include "sc16_codec.hpp"
+#include "thread_placement.hpp"
+#include "trace_events.hpp"
+
+namespace stream
+{
+
+template <typename T, size_t N>
+using channel_ptrs = std::array<T *, N>;
+
+template <typename T, size_t N>
+channel_ptrs<T, N> to_array(const std::vector<T *> &ptrs)
+{
+        if (ptrs.size() < N)
+                throw std::runtime_error("Not enough channel buffers");
+        channel_ptrs<T, N> out;
+        for (size_t ch = 0; ch < N; ch++)
+                out[ch] = ptrs[ch];
+        return out;
+}
+
+// Calls fn with std::integral_constant<size_t, n> for the supported channel counts (1 or 2)
+template <typename F>
+void dispatch_channels(size_t n, F &&fn)
+{
+        switch (n)
+        {
+        case 1:
+                fn(std::integral_constant<size_t, 1>());
+                break;
+        case 2:
+                fn(std::integral_constant<size_t, 2>());
+                break;
+        default:
+                throw std::runtime_error("Only 1 or 2 channels are supported, got " + std::to_string(n));
+        }
+}
+
+/***********************************************************************
+ * Sinks
+ **********************************************************************/
+// Receives into fixed buffers and drops the samples (benchmarks, dry runs).
+template <typename T, size_t N>
+class null_sink
+{
+public:
+        explicit null_sink(const channel_ptrs<T, N> &buffs) : _buffs(buffs) {}
+
+        channel_ptrs<T, N> buffers() const { return _buffs; }
+        void consume(const channel_ptrs<T, N> &, size_t) {}
+
+private:
+        channel_ptrs<T, N> _buffs;
+};
+
+// One file per channel, every buffer through the codec stage (see sc16_codec.hpp).
+template <typename T, size_t N>
+class file_sink
+{
+public:
+        file_sink(const channel_ptrs<T, N> &buffs, const std::array<std::string, N> &filenames, codec::codec_id codec_id)
+            : _buffs(buffs)
+        {
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        _files[ch].open(filenames[ch], std::ofstream::binary);
+                        _encoders[ch].reset(new codec::encoder(codec_id));
+                }
+        }
+
+        ~file_sink()
+        {
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        _files[ch].close();
+                        _encoders[ch]->report();
+                }
+        }
+
+        channel_ptrs<T, N> buffers() const { return _buffs; }
+
+        void consume(const channel_ptrs<T, N> &buffs, size_t nsamps)
+        {
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        codec::view frame;
+                        {
+                                LATENCY_SCOPE(stats::stage::encode);
+                                frame = _encoders[ch]->encode(buffs[ch], nsamps);
+                        }
+                        LATENCY_SCOPE(stats::stage::file_write);
+                        _files[ch].write((const char *)frame.data, frame.size);
+                }
+        }
+
+private:
+        channel_ptrs<T, N> _buffs;
+        std::array<std::ofstream, N> _files;
+        std::array<std::unique_ptr<codec::encoder>, N> _encoders;
+};
+
+// One file per channel with the plain samples, for GNU Radio file sources.
+template <typename T, size_t N>
+class raw_file_sink
+{
+public:
+        raw_file_sink(const channel_ptrs<T, N> &buffs, std::array<std::ofstream *, N> files)
+            : _buffs(buffs), _files(files)
+        {
+        }
+
+        channel_ptrs<T, N> buffers() const { return _buffs; }
+
+        void consume(const channel_ptrs<T, N> &buffs, size_t nsamps)
+        {
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        if (!_files[ch]->is_open())
+                                continue;
+                        LATENCY_SCOPE(stats::stage::file_write);
+                        _files[ch]->write((const char *)buffs[ch], nsamps * sizeof(T));
+                }
+        }
+
+private:
+        channel_ptrs<T, N> _buffs;
+        std::array<std::ofstream *, N> _files;
+};
+
+// Channel 0 through the codec stage, each frame handed to publish(data, size),
+// e.g. a lambda wrapping a ZMQ push socket.
+template <typename T, size_t N, typename Publish>
+class publish_sink
+{
+public:
+        publish_sink(const channel_ptrs<T, N> &buffs, codec::encoder &encoder, Publish publish)
+            : _buffs(buffs), _encoder(encoder), _publish(publish)
+        {
+        }
+
+        channel_ptrs<T, N> buffers() const { return _buffs; }
+
+        void consume(const channel_ptrs<T, N> &buffs, size_t nsamps)
+        {
+                codec::view frame;
+                {
+                        LATENCY_SCOPE(stats::stage::encode);
+                        frame = _encoder.encode(buffs[0], nsamps);
+                }
+                LATENCY_SCOPE(stats::stage::zmq_send);
+                _publish(frame.data, frame.size);
+        }
+
+private:
+        channel_ptrs<T, N> _buffs;
+        codec::encoder &_encoder;
+        Publish _publish;
+};
+
+template <typename T, size_t N, typename Publish>
+publish_sink<T, N, Publish> make_publish_sink(const channel_ptrs<T, N> &buffs, codec::encoder &encoder, Publish publish)
+{
+        return publish_sink<T, N, Publish>(buffs, encoder, publish);
+}
+
+// Receives straight into one large buffer per channel (capture to memory,
+// written out after streaming).
+template <typename T, size_t N>
+class memory_sink
+{
+public:
+        memory_sink(const channel_ptrs<T, N> &capture, size_t capacity) : _capture(capture), _capacity(capacity) {}
+
+        channel_ptrs<T, N> buffers() const
+        {
+                channel_ptrs<T, N> next;
+                for (size_t ch = 0; ch < N; ch++)
+                        next[ch] = _capture[ch] + _offset;
+                return next;
+        }
+
+        void consume(const channel_ptrs<T, N> &, size_t nsamps) { _offset += nsamps; }
+
+        size_t size() const { return _offset; }
+        size_t capacity() const { return _capacity; }
+
+private:
+        channel_ptrs<T, N> _capture;
+        size_t _capacity;
+        size_t _offset = 0;
+};
+
+/***********************************************************************
+ * Receive
+ **********************************************************************/
+// Calls sink.consume(buffs, nsamps, md) when the sink takes the metadata,
+// sink.consume(buffs, nsamps) otherwise.
+template <typename Sink, typename Buffs>
+auto consume(Sink &sink, const Buffs &buffs, size_t nsamps, const uhd::rx_metadata_t &md, int)
+    -> decltype(sink.consume(buffs, nsamps, md), void())
+{
+        sink.consume(buffs, nsamps, md);
+}
+
+template <typename Sink, typename Buffs>
+void consume(Sink &sink, const Buffs &buffs, size_t nsamps, const uhd::rx_metadata_t &, long)
+{
+        sink.consume(buffs, nsamps);
+}
+
+// Issues a timed stream command at start_time (continuous when num_requested_samples
+// is 0), receives spb samples per call into sink.buffers() and hands them to the sink.
+// issued runs right after the stream command went out, e.g. to queue other
+// timed commands behind it. Returns the number of samples received.
+template <typename T, size_t N, typename Sink>
+size_t receive(uhd::rx_streamer::sptr rx_stream,
+               Sink &sink,
+               size_t spb,
+               size_t num_requested_samples,
+               double start_time,
+               double rate,
+               const bool *stop = nullptr,
+               placement::jitter_meter *jitter = nullptr,
+               const std::function<void()> &issued = nullptr)
+{
+        UHD_ASSERT_THROW(rx_stream->get_num_channels() == N);
+
+        size_t num_total_samps = 0;
+        uhd::rx_metadata_t md;
+        bool overflow_message = true;
+        // We increase the first timeout to cover for the delay between now + the
+        // command time, plus 500ms of buffer. In the loop, we will then reduce the
+        // timeout for subsequent receives.
+        double timeout = start_time + 0.5f;
+
+        uhd::stream_cmd_t stream_cmd((num_requested_samples == 0)
+                                         ? uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS
+                                         : uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+        stream_cmd.num_samps = num_requested_samples;
+        stream_cmd.stream_now = false;
+        stream_cmd.time_spec = uhd::time_spec_t(start_time);
+        rx_stream->issue_stream_cmd(stream_cmd);
+        if (issued)
+                issued();
+
+        // the first recv blocks until the timed stream command starts
+        std::unique_ptr<trace::scope> wait_scope(new trace::scope("rx_wait_start"));
+
+        while (!(stop && *stop) && (num_requested_samples > num_total_samps || num_requested_samples == 0))
+        {
+                channel_ptrs<T, N> buffs = sink.buffers();
+                size_t recv_samps = spb;
+                if (num_requested_samples > 0 && num_requested_samples - num_total_samps < spb)
+                        recv_samps = num_requested_samples - num_total_samps;
+
+                size_t num_rx_samps;
+                {
+                        LATENCY_SCOPE(stats::stage::rx_recv);
+                        num_rx_samps = rx_stream->recv(buffs, recv_samps, md, timeout);
+                }
+                wait_scope.reset();
+                timeout = 0.1f; // small timeout for subsequent recv
+
+                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+                {
+                        std::cout << boost::format("Timeout while streaming after %d rx samples") % num_total_samps << std::endl;
+                        break;
+                }
+                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
+                {
+                        if (overflow_message)
+                        {
+                                overflow_message = false;
+                                std::cerr
+                                    << boost::format(
+                                           "Got an overflow indication. Please consider the following:\n"
+                                           "  Your write medium must sustain a rate of %fMB/s.\n"
+                                           "  Dropped samples will not be written to the file.\n"
+                                           "  Please modify this example for your purposes.\n"
+                                           "  This message will not appear again.\n") %
+                                           (rate * N * sizeof(T) / 1e6);
+                        }
+                        continue;
+                }
+                if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+                {
+                        throw std::runtime_error("Receiver error " + md.strerror());
+                }
+                if (jitter)
+                        jitter->tick();
+
+                num_total_samps += num_rx_samps;
+                consume(sink, buffs, num_rx_samps, md, 0);
+        }
+
+        // Shut down receiver
+        stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
+        rx_stream->issue_stream_cmd(stream_cmd);
+
+        return num_total_samps;
+}
+
+/***********************************************************************
+ * Transmit
+ **********************************************************************/
+// Sends the same buffers every time.
+template <typename T, size_t N>
+class fixed_source
+{
+public:
+        explicit fixed_source(const std::array<const T *, N> &buffs) : _buffs(buffs) {}
+
+        std::array<const T *, N> next(size_t, size_t) const { return _buffs; }
+
+private:
+        std::array<const T *, N> _buffs;
+};
+
+// Sends spb-sample buffers from source.next() until num_requested_samples are
+// out, then a mini EOB packet. md carries the time spec of the first packet.
+template <typename T, size_t N, typename Source>
+size_t transmit_from(uhd::tx_streamer::sptr tx_stream,
+                     Source &source,
+                     size_t spb,
+                     size_t num_requested_samples,
+                     uhd::tx_metadata_t md,
+                     double timeout,
+                     const bool *stop = nullptr,
+                     placement::jitter_meter *jitter = nullptr)
+{
+        UHD_ASSERT_THROW(tx_stream->get_num_channels() == N);
+
+        TRACE_SCOPE("tx_burst");
+        size_t num_total_samps = 0;
+        while (num_requested_samples > num_total_samps && !(stop && *stop))
+        {
+                std::array<const T *, N> buffs = source.next(num_total_samps, spb);
+
+                // send a single packet
+                size_t num_tx_samps;
+                {
+                        LATENCY_SCOPE(stats::stage::tx_send);
+                        num_tx_samps = tx_stream->send(buffs, spb, md, timeout);
+                }
+                if (jitter)
+                        jitter->tick();
+
+                // do not use time spec for subsequent packets
+                md.has_time_spec = false;
+
+                if (num_tx_samps < spb)
+                        std::cerr << "Send timeout..." << std::endl;
+
+                num_total_samps += num_tx_samps;
+        }
+
+        // send a mini EOB packet
+        md.end_of_burst = true;
+        tx_stream->send("", 0, md);
+
+        return num_total_samps;
+}
+
+// Sends the same spb-sample buffers until num_requested_samples are out, then
+// a mini EOB packet. md carries the time spec of the first packet.
+template <typename T, size_t N>
+size_t transmit(uhd::tx_streamer::sptr tx_stream,
+                const std::array<const T *, N> &buffs,
+                size_t spb,
+                size_t num_requested_samples,
+                uhd::tx_metadata_t md,
+                double timeout,
+                const bool *stop = nullptr,
+                placement::jitter_meter *jitter = nullptr)
+{
+        fixed_source<T, N> source(buffs);
+        return transmit_from<T, N>(tx_stream, source, spb, num_requested_samples, md, timeout, stop, jitter);
+}
+
+// Loops through the async messages until the burst ACK of every channel
+// (there may be underflow messages in the queue first, and UHD sends one ACK
+// per channel of the streamer).
+inline bool wait_burst_ack(uhd::tx_streamer::sptr tx_stream, double timeout)
+{
+        TRACE_SCOPE("tx_burst_ack");
+        uhd::async_metadata_t async_md;
+        std::vector<bool> acked(tx_stream->get_num_channels(), false);
+        size_t missing = acked.size();
+        while (missing > 0 and tx_stream->recv_async_msg(async_md, timeout))
+        {
+                if (async_md.event_code == uhd::async_metadata_t::EVENT_CODE_BURST_ACK
+                    and async_md.channel < acked.size() and not acked[async_md.channel])
+                {
+                        acked[async_md.channel] = true;
+                        missing--;
+                }
+        }
+        return missing == 0;
+}
+
+} // namespace stream
+
+#endif /* STREAM_CORE_HPP */
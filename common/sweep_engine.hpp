@@ -0,0 +1,248 @@
+// Back-to-back frequency/gain sweeps on one continuous RX stream.
+//
+// Every step is (frequency, gain, dwell). The engine lays the steps out on
+// the device timeline from a start time: step i retunes at tune_time(i) and
+// its samples are valid from tune_time(i) + settle for dwell seconds; the
+// next step retunes right after. The stream keeps running across steps.
+//
+// The B210 (AD9361) does not time frequency and gain changes: a retune takes
+// effect when the host issues it, whatever the command time. run() therefore
+// waits for the device clock to reach tune_time(i) before it issues the
+// retune, so the previous dwell window is never touched, and settle has to
+// cover the host wake-up and the retune itself. A retune that is still
+// running at the start of its dwell window is reported.
+//
+// step_sink<T, N> tags the received blocks with the active step from the
+// rx metadata time: samples inside a dwell window are written to one file per
+// channel, samples in the settle gaps are dropped, and an index (CSV) records
+// where every step starts in the files:
+//      step,freq,gain,dwell_start,first_sample,nsamps
+//
+// Step files hold one step per line, "freq gain dwell", e.g. "400e6 40 0.5";
+// empty lines and lines starting with # are skipped.
+
+#ifndef SWEEP_ENGINE_HPP
+#define SWEEP_ENGINE_HPP
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "timed_command.hpp"
+
+namespace sweep
+{
+
+struct step
+{
+        double freq;  // Hz
+        double gain;  // dB
+        double dwell; // s
+};
+
+inline std::vector<step> load_steps(const std::string &path)
+{
+        std::ifstream file(path);
+        if (!file)
+                throw std::runtime_error("Could not open sweep file " + path);
+
+        std::vector<step> steps;
+        std::string line;
+        while (std::getline(file, line))
+        {
+                if (line.empty() || line[0] == '#')
+                        continue;
+                std::istringstream ss(line);
+                step s;
+                if (!(ss >> s.freq >> s.gain >> s.dwell) || s.dwell <= 0.0)
+                        throw std::runtime_error("Invalid sweep step \"" + line + "\" in " + path);
+                steps.push_back(s);
+        }
+        if (steps.empty())
+                throw std::runtime_error("No sweep steps in " + path);
+        return steps;
+}
+
+class engine
+{
+public:
+        // settle: time from tune_time to valid samples, including the retune
+        engine(uhd::usrp::multi_usrp::sptr usrp,
+               const std::vector<step> &steps,
+               const std::vector<size_t> &channels,
+               double start_time,
+               double settle = 0.1)
+            : _usrp(usrp), _steps(steps), _channels(channels), _settle(settle)
+        {
+                if (settle <= 0.0)
+                        throw std::runtime_error("Sweep settle time must be positive");
+                double t = start_time;
+                for (const step &s : _steps)
+                {
+                        _tune_times.push_back(t);
+                        t += _settle + s.dwell;
+                }
+                _end_time = t;
+        }
+
+        size_t size() const { return _steps.size(); }
+        const step &operator[](size_t i) const { return _steps[i]; }
+
+        double tune_time(size_t i) const { return _tune_times[i]; }
+        double dwell_start(size_t i) const { return _tune_times[i] + _settle; }
+        double dwell_end(size_t i) const { return dwell_start(i) + _steps[i].dwell; }
+
+        // first valid sample and the end of the last dwell window
+        double rx_start() const { return dwell_start(0); }
+        double end_time() const { return _end_time; }
+
+        size_t num_samples(double rate) const { return size_t(std::ceil((end_time() - rx_start()) * rate)); }
+
+        // Issues the retunes at their tune times until the last one or *stop is
+        // set.
+        void run(const bool *stop = nullptr)
+        {
+                for (size_t i = 0; i < _steps.size() && !(stop && *stop); i++)
+                {
+                        double now = 0.0;
+                        while (!(stop && *stop) && (now = _usrp->get_time_now().get_real_secs()) < _tune_times[i])
+                                std::this_thread::sleep_for(std::chrono::duration<double>(std::min(0.01, _tune_times[i] - now)));
+                        if (stop && *stop)
+                                break;
+
+                        uhd::tune_request_t tune_request(_steps[i].freq);
+                        tune_request.rf_freq_policy = uhd::tune_request_t::POLICY_MANUAL;
+                        tune_request.rf_freq = _steps[i].freq;
+                        tune_request.args = uhd::device_addr_t("mode_n=integer");
+
+                        // untimed retune: clear any command time a GPIO edge left
+                        // behind, under the lock so none is set meanwhile
+                        {
+                                std::lock_guard<std::mutex> lock(timed::command_time_mutex());
+                                _usrp->clear_command_time();
+                                for (size_t ch : _channels)
+                                {
+                                        _usrp->set_rx_freq(tune_request, ch);
+                                        _usrp->set_rx_gain(_steps[i].gain, ch);
+                                }
+                        }
+
+                        double done = _usrp->get_time_now().get_real_secs();
+                        if (done > dwell_start(i))
+                                std::cerr << boost::format("Sweep step %d retune ended %.3f ms into its dwell window, increase the settle time") %
+                                                 i % ((done - dwell_start(i)) * 1e3)
+                                          << std::endl;
+
+                        std::cout << boost::format("Sweep step %d/%d: %f MHz, %f dB at t=%f s") % (i + 1) % _steps.size() %
+                                         (_steps[i].freq / 1e6) % _steps[i].gain % _tune_times[i]
+                                  << std::endl;
+                }
+        }
+
+private:
+        uhd::usrp::multi_usrp::sptr _usrp;
+        std::vector<step> _steps;
+        std::vector<size_t> _channels;
+        double _settle;
+        std::vector<double> _tune_times;
+        double _end_time;
+};
+
+// Writes the dwell-window samples of every step to one file per channel and
+// indexes them per step (see above). Receive buffers are fixed like raw_file_sink.
+template <typename T, size_t N>
+class step_sink
+{
+public:
+        step_sink(const std::array<T *, N> &buffs,
+                  const engine &sweep,
+                  double rate,
+                  std::array<std::ofstream *, N> files,
+                  const std::string &index_filename)
+            : _buffs(buffs), _sweep(sweep), _rate(rate), _files(files), _index(index_filename)
+        {
+                if (!_index)
+                        throw std::runtime_error("Could not open sweep index " + index_filename);
+                _index << "step,freq,gain,dwell_start,first_sample,nsamps" << std::endl;
+        }
+
+        ~step_sink()
+        {
+                flush_step();
+        }
+
+        std::array<T *, N> buffers() const { return _buffs; }
+
+        void consume(const std::array<T *, N> &buffs, size_t nsamps, const uhd::rx_metadata_t &md)
+        {
+                // sample k of the block is at md.time_spec + k / rate
+                double t0 = md.time_spec.get_real_secs();
+                size_t k = 0;
+                while (k < nsamps && _step < _sweep.size())
+                {
+                        double t = t0 + k / _rate;
+                        if (t >= _sweep.dwell_end(_step))
+                        {
+                                flush_step();
+                                _step++;
+                                continue;
+                        }
+                        if (t < _sweep.dwell_start(_step))
+                        {
+                                // settle gap: skip to the start of the window
+                                size_t start = size_t(std::ceil((_sweep.dwell_start(_step) - t0) * _rate - 1e-6));
+                                k = std::min(nsamps, std::max(start, k + 1));
+                                continue;
+                        }
+                        size_t end = std::min(nsamps, size_t(std::ceil((_sweep.dwell_end(_step) - t0) * _rate - 1e-6)));
+                        end = std::max(end, k + 1);
+                        for (size_t ch = 0; ch < N; ch++)
+                                if (_files[ch]->is_open())
+                                        _files[ch]->write((const char *)(buffs[ch] + k), (end - k) * sizeof(T));
+                        if (_step_samps == 0)
+                                _step_first = _written;
+                        _step_samps += end - k;
+                        _written += end - k;
+                        k = end;
+                }
+        }
+
+        size_t step() const { return _step; }
+
+private:
+        void flush_step()
+        {
+                if (_step >= _sweep.size() || _step_samps == 0)
+                        return;
+                _index << boost::format("%d,%f,%f,%f,%d,%d") % _step % _sweep[_step].freq % _sweep[_step].gain %
+                              _sweep.dwell_start(_step) % _step_first % _step_samps
+                       << std::endl;
+                _step_samps = 0;
+        }
+
+        std::array<T *, N> _buffs;
+        const engine &_sweep;
+        double _rate;
+        std::array<std::ofstream *, N> _files;
+        std::ofstream _index;
+
+        size_t _step = 0;
+        size_t _step_first = 0;
+        size_t _step_samps = 0;
+        size_t _written = 0;
+};
+
+} // namespace sweep
+
+#endif /* SWEEP_ENGINE_HPP */
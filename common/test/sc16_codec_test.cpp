@@ -0,0 +1,100 @@
+// Tests of codec::decode() (see sc16_codec.hpp): round trips through the
+// encoder, and frames it has to reject or take as raw samples.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "sc16_codec.hpp"
+
+using codec::sc16;
+
+#define CHECK(cond)                                                                              \
+        do                                                                                       \
+        {                                                                                        \
+                if (!(cond))                                                                     \
+                {                                                                                \
+                        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+                        std::exit(1);                                                            \
+                }                                                                                \
+        } while (0)
+
+static std::vector<uint8_t> frame(const codec::frame_header &h, size_t payload_bytes)
+{
+        std::vector<uint8_t> f(sizeof(h) + payload_bytes);
+        std::memcpy(f.data(), &h, sizeof(h));
+        return f;
+}
+
+static bool rejected(const std::vector<uint8_t> &f)
+{
+        std::vector<sc16> out;
+        try
+        {
+                codec::decode(f.data(), f.size(), out);
+        }
+        catch (const std::runtime_error &)
+        {
+                return true;
+        }
+        return false;
+}
+
+static void test_round_trip()
+{
+        std::vector<sc16> in(100);
+        for (size_t i = 0; i < in.size(); i++)
+                in[i] = sc16(int16_t(16 * i), int16_t(-32 * i));
+        for (codec::codec_id id : {codec::codec_id::raw, codec::codec_id::pack12})
+        {
+                codec::encoder enc(id);
+                codec::view v = enc.encode(in.data(), in.size());
+                std::vector<sc16> out;
+                CHECK(codec::decode(v.data, v.size, out) == v.size);
+                CHECK(out == in);
+        }
+}
+
+// nsamps larger than the payload holds: a corrupt or truncated frame
+static void test_nsamps_past_payload()
+{
+        codec::frame_header h{codec::FRAME_MAGIC, codec::FRAME_VERSION, uint8_t(codec::codec_id::raw),
+                              uint8_t(sample::format::sc16), 0, 26, 100};
+        CHECK(rejected(frame(h, 100)));
+        h.nsamps = 25;
+        CHECK(!rejected(frame(h, 100)));
+
+        h.codec = uint8_t(codec::codec_id::pack12);
+        h.nsamps = 34;
+        CHECK(rejected(frame(h, 100)));
+        h.nsamps = 33;
+        CHECK(!rejected(frame(h, 100)));
+}
+
+// Only the full magic, version and reserved byte make a header
+static void test_magic_and_version()
+{
+        codec::frame_header h{codec::FRAME_MAGIC, codec::FRAME_VERSION + 1, uint8_t(codec::codec_id::raw),
+                              uint8_t(sample::format::sc16), 0, 1000, 100};
+        std::vector<uint8_t> f = frame(h, 100);
+        std::vector<sc16> out;
+        CHECK(codec::decode(f.data(), f.size(), out) == f.size());
+        CHECK(out.size() == f.size() / sizeof(sc16));
+
+        h.version = codec::FRAME_VERSION;
+        h.reserved = 1;
+        f = frame(h, 100);
+        out.clear();
+        CHECK(codec::decode(f.data(), f.size(), out) == f.size());
+        CHECK(out.size() == f.size() / sizeof(sc16));
+}
+
+int main()
+{
+        test_round_trip();
+        test_nsamps_past_payload();
+        test_magic_and_version();
+        std::printf("sc16_codec: all tests passed\n");
+        return 0;
+}
@@ -0,0 +1,118 @@
+// Tests of weights::bank and weights::source (see tx_weights.hpp): when the
+// immediate and timed updates reach the air, and which timed updates survive
+// the end of a burst.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "tx_weights.hpp"
+
+using weights::sample;
+
+#define CHECK(cond)                                                                              \
+        do                                                                                       \
+        {                                                                                        \
+                if (!(cond))                                                                     \
+                {                                                                                \
+                        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+                        std::exit(1);                                                            \
+                }                                                                                \
+        } while (0)
+
+static const double rate = 1000.0; // sample k of a burst at start + k / 1000 s
+static const size_t spb = 100;
+
+static bool near(sample a, sample b)
+{
+        return std::abs(a - b) < 1e-5f;
+}
+
+static std::vector<sample> make_base()
+{
+        std::vector<sample> base(spb);
+        for (size_t i = 0; i < spb; i++)
+                base[i] = sample(float(i), 1.0f);
+        return base;
+}
+
+// Samples [begin, end) of the buffer are the base samples times w
+static bool weighted(const sample *buff, const std::vector<sample> &base, size_t begin, size_t end, sample w)
+{
+        for (size_t i = begin; i < end; i++)
+                if (!near(buff[i], base[i] * w))
+                        return false;
+        return true;
+}
+
+static void test_immediate_and_timed()
+{
+        weights::bank bank;
+        std::vector<sample> base = make_base();
+        {
+                weights::source<2> source(bank, base, 3.0, rate);
+                std::array<const sample *, 2> b = source.next(0, spb);
+                CHECK(weighted(b[0], base, 0, spb, 1.0f) && weighted(b[1], base, 0, spb, 1.0f));
+
+                bank.post(weights::parse("0 1 2 0", 2));        // next buffer
+                bank.post(weights::parse("@3.150 1 0 -1 0", 2)); // sample 150
+                b = source.next(100, spb);
+                CHECK(weighted(b[0], base, 0, 50, sample(0, 1)) && weighted(b[1], base, 0, 50, 2.0f));
+                CHECK(weighted(b[0], base, 50, spb, 1.0f) && weighted(b[1], base, 50, spb, -1.0f));
+
+                bank.post(weights::parse("@3.1 5 0 5 0", 2)); // late: next buffer
+                b = source.next(200, spb);
+                CHECK(weighted(b[0], base, 0, spb, 5.0f));
+        }
+        CHECK(near(bank.current()[0], 5.0f));
+        CHECK(!bank.pending());
+}
+
+// An update posted during a burst for a time after it waits for the next burst
+static void test_timed_for_next_burst()
+{
+        weights::bank bank;
+        std::vector<sample> base = make_base();
+        {
+                weights::source<2> source(bank, base, 3.0, rate);
+                source.next(0, spb);
+                bank.post(weights::parse("@9.05 7 0 7 0", 2));
+                std::array<const sample *, 2> b = source.next(100, spb);
+                CHECK(weighted(b[0], base, 0, spb, 1.0f));
+        }
+        CHECK(bank.pending());
+        CHECK(near(bank.current()[0], 1.0f));
+
+        // next burst from 9 s: sample 50 on
+        {
+                weights::source<2> source(bank, base, 9.0, rate);
+                std::array<const sample *, 2> b = source.next(0, spb);
+                CHECK(weighted(b[0], base, 0, 50, 1.0f) && weighted(b[1], base, 50, spb, 7.0f));
+        }
+        CHECK(!bank.pending());
+        CHECK(near(bank.current()[1], 7.0f));
+}
+
+// An update for a time before the burst started is dropped, not applied late
+static void test_timed_before_burst()
+{
+        weights::bank bank;
+        std::vector<sample> base = make_base();
+        bank.post(weights::parse("@2.5 3 0 3 0", 2));
+        {
+                weights::source<2> source(bank, base, 3.0, rate);
+                std::array<const sample *, 2> b = source.next(0, spb);
+                CHECK(weighted(b[0], base, 0, spb, 1.0f));
+        }
+        CHECK(!bank.pending());
+        CHECK(near(bank.current()[0], 1.0f));
+}
+
+int main()
+{
+        test_immediate_and_timed();
+        test_timed_for_next_burst();
+        test_timed_before_burst();
+        std::printf("tx_weights: all tests passed\n");
+        return 0;
+}
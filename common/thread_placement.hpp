@@ -0,0 +1,167 @@
+// CPU affinity, real-time priority and memory locking for the streaming threads.
+//
+// Every role (recv loop, transmit_worker, ...) gets an optional CPU and an
+// optional SCHED_FIFO priority. The options can be given on the command line
+// or in a config file (one "key = value" per line, same names as the options):
+//
+//      # placement.cfg
+//      recv-cpu = 2
+//      recv-prio = 80
+//      tx-cpu = 3
+//      tx-prio = 80
+//      mlock = true
+//
+// Failing to apply a setting (no CAP_SYS_NICE, CPU not present, ...) is
+// reported once and the thread keeps running with the default placement.
+//
+// jitter_meter measures the spacing between successive recv()/send() calls of
+// a thread, which is what the placement is supposed to tighten.
+
+#ifndef THREAD_PLACEMENT_HPP
+#define THREAD_PLACEMENT_HPP
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+namespace placement
+{
+
+struct thread_config
+{
+        int cpu = -1;     // -1: let the scheduler decide
+        int priority = 0; // 0: keep SCHED_OTHER, 1..99: SCHED_FIFO
+
+        std::string to_string() const
+        {
+                std::string s = (cpu < 0) ? "cpu any" : "cpu " + std::to_string(cpu);
+                s += (priority > 0) ? ", fifo " + std::to_string(priority) : ", other";
+                return s;
+        }
+};
+
+struct config
+{
+        thread_config recv;
+        thread_config tx;
+        bool lock_memory = false;
+        std::string file;
+};
+
+inline boost::program_options::options_description options(config &cfg)
+{
+        namespace po = boost::program_options;
+        po::options_description desc("Thread placement");
+        // clang-format off
+    desc.add_options()
+        ("recv-cpu", po::value<int>(&cfg.recv.cpu)->default_value(-1), "pin the receive loop to this CPU (-1: no pinning)")
+        ("recv-prio", po::value<int>(&cfg.recv.priority)->default_value(0), "SCHED_FIFO priority of the receive loop (1-99, 0: SCHED_OTHER)")
+        ("tx-cpu", po::value<int>(&cfg.tx.cpu)->default_value(-1), "pin the transmit worker to this CPU (-1: no pinning)")
+        ("tx-prio", po::value<int>(&cfg.tx.priority)->default_value(0), "SCHED_FIFO priority of the transmit worker (1-99, 0: SCHED_OTHER)")
+        ("mlock", po::bool_switch(&cfg.lock_memory), "lock all current and future pages in RAM (mlockall)")
+    ;
+        // clang-format on
+        return desc;
+}
+
+// Command line values take precedence over the config file, as both are
+// stored in the same variables_map and po::store() never overwrites.
+inline void load_file(const std::string &path, const boost::program_options::options_description &desc,
+                      boost::program_options::variables_map &vm)
+{
+        if (path.empty())
+                return;
+        boost::program_options::store(boost::program_options::parse_config_file<char>(path.c_str(), desc), vm);
+}
+
+// Applies the placement to the calling thread.
+inline void apply(const char *role, const thread_config &cfg)
+{
+        if (cfg.cpu >= 0)
+        {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cfg.cpu, &set);
+                int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if (err != 0)
+                        std::cerr << boost::format("[%s] Could not pin to CPU %d: %s") % role % cfg.cpu % std::strerror(err)
+                                  << std::endl;
+        }
+
+        if (cfg.priority > 0)
+        {
+                sched_param param;
+                param.sched_priority = std::min(cfg.priority, sched_get_priority_max(SCHED_FIFO));
+                int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+                if (err != 0)
+                        std::cerr << boost::format("[%s] Could not set SCHED_FIFO priority %d: %s") % role % param.sched_priority % std::strerror(err)
+                                  << std::endl;
+        }
+}
+
+inline void lock_memory(bool enable)
+{
+        if (!enable)
+                return;
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+                std::cerr << "Could not lock memory: " << std::strerror(errno) << std::endl;
+        else
+                std::cout << "Memory locked (mlockall)" << std::endl;
+}
+
+// Interval statistics between successive tick() calls (Welford running variance).
+class jitter_meter
+{
+public:
+        void tick()
+        {
+                auto now = std::chrono::steady_clock::now();
+                if (_started)
+                {
+                        double dt = std::chrono::duration<double, std::micro>(now - _last).count();
+                        _n++;
+                        double delta = dt - _mean;
+                        _mean += delta / _n;
+                        _m2 += delta * (dt - _mean);
+                        _min = std::min(_min, dt);
+                        _max = std::max(_max, dt);
+                }
+                _started = true;
+                _last = now;
+        }
+
+        void report(const char *role, const thread_config &cfg) const
+        {
+                if (_n < 2)
+                        return;
+                double stddev = std::sqrt(_m2 / (_n - 1));
+                double worst = std::max(_max - _mean, _mean - _min);
+                std::cout << boost::format("[%s] %s: %d intervals, mean %.1f us, std %.1f us, min %.1f us, max %.1f us, worst deviation %.1f us")
+                                 % role % cfg.to_string() % _n % _mean % stddev % _min % _max % worst
+                          << std::endl;
+        }
+
+private:
+        bool _started = false;
+        std::chrono::steady_clock::time_point _last;
+        size_t _n = 0;
+        double _mean = 0.0;
+        double _m2 = 0.0;
+        double _min = std::numeric_limits<double>::max();
+        double _max = 0.0;
+};
+
+} // namespace placement
+
+#endif /* THREAD_PLACEMENT_HPP */
@@ -0,0 +1,37 @@
+// Timed commands from more than one thread.
+//
+// set_command_time() applies to every command of the motherboard until
+// clear_command_time(), so two threads scheduling commands (the GPIO
+// sequencer and the sweep engine, say) must not interleave their
+// set/clear pairs. timed::at() runs the commands under one process-wide lock:
+//
+//      timed::at(usrp, uhd::time_spec_t(t), [&]() { usrp->set_rx_freq(tune_request, 0); });
+
+#ifndef TIMED_COMMAND_HPP
+#define TIMED_COMMAND_HPP
+
+#include <uhd/usrp/multi_usrp.hpp>
+#include <mutex>
+
+namespace timed
+{
+
+inline std::mutex &command_time_mutex()
+{
+        static std::mutex mutex;
+        return mutex;
+}
+
+// Runs fn() with the command time set to time
+template <typename F>
+void at(uhd::usrp::multi_usrp::sptr usrp, const uhd::time_spec_t &time, F &&fn, size_t mboard = 0)
+{
+        std::lock_guard<std::mutex> lock(command_time_mutex());
+        usrp->set_command_time(time, mboard);
+        fn();
+        usrp->clear_command_time(mboard);
+}
+
+} // namespace timed
+
+#endif /* TIMED_COMMAND_HPP */
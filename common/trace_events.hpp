@@ -0,0 +1,196 @@
+// Scoped trace events exported as Chrome trace / Perfetto JSON.
+//
+// Meant for the coarse steps of a calibration cycle (sync, PPS wait, RX,
+// TX burst, phase query, ...), not for per-packet work: every event takes a
+// mutex. Open the resulting file in chrome://tracing or ui.perfetto.dev.
+//
+// Recording is off until a session is created with a non-empty path, so
+// TRACE_SCOPE() costs one relaxed load when tracing is not requested.
+//
+// Usage:
+//      trace::session trace_session("cal.json"); // written when it goes out of scope
+//      trace::set_thread_name("main");
+//      {
+//              TRACE_SCOPE("sync");
+//              ...
+//      }
+//      trace::counter("phase_rad", phase);
+
+#ifndef TRACE_EVENTS_HPP
+#define TRACE_EVENTS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace trace
+{
+
+struct event
+{
+        char phase; // 'X' complete, 'C' counter, 'M' metadata (thread name)
+        std::string name;
+        double ts_us;
+        double dur_us;
+        double value;
+        uint32_t tid;
+};
+
+class recorder
+{
+public:
+        static recorder &instance()
+        {
+                static recorder r;
+                return r;
+        }
+
+        bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+        void start()
+        {
+                _origin = std::chrono::steady_clock::now();
+                _enabled.store(true, std::memory_order_relaxed);
+        }
+
+        double now_us() const
+        {
+                return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _origin).count();
+        }
+
+        void add(event e)
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _events.push_back(std::move(e));
+        }
+
+        static uint32_t thread_id()
+        {
+                static std::atomic<uint32_t> next_id{1};
+                thread_local uint32_t id = next_id.fetch_add(1);
+                return id;
+        }
+
+        bool write(const std::string &path)
+        {
+                std::FILE *out = std::fopen(path.c_str(), "w");
+                if (out == nullptr)
+                        return false;
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                int pid = static_cast<int>(getpid());
+                std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+                for (size_t i = 0; i < _events.size(); i++)
+                {
+                        const event &e = _events[i];
+                        const char *sep = (i + 1 < _events.size()) ? "," : "";
+                        switch (e.phase)
+                        {
+                        case 'X':
+                                std::fprintf(out, "{\"name\":\"%s\",\"cat\":\"cal\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}%s\n",
+                                             e.name.c_str(), e.ts_us, e.dur_us, pid, e.tid, sep);
+                                break;
+                        case 'C':
+                                std::fprintf(out, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"value\":%.9g}}%s\n",
+                                             e.name.c_str(), e.ts_us, pid, e.tid, e.value, sep);
+                                break;
+                        case 'M':
+                                std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}%s\n",
+                                             pid, e.tid, e.name.c_str(), sep);
+                                break;
+                        }
+                }
+                std::fprintf(out, "]}\n");
+                std::fclose(out);
+                return true;
+        }
+
+private:
+        recorder() = default;
+
+        std::atomic<bool> _enabled{false};
+        std::chrono::steady_clock::time_point _origin;
+        std::mutex _mutex;
+        std::vector<event> _events;
+};
+
+inline void set_thread_name(const std::string &name)
+{
+        recorder &r = recorder::instance();
+        if (r.enabled())
+                r.add(event{'M', name, 0.0, 0.0, 0.0, recorder::thread_id()});
+}
+
+inline void counter(const std::string &name, double value)
+{
+        recorder &r = recorder::instance();
+        if (r.enabled())
+                r.add(event{'C', name, r.now_us(), 0.0, value, recorder::thread_id()});
+}
+
+class scope
+{
+public:
+        explicit scope(const char *name) : _name(name)
+        {
+                if (recorder::instance().enabled())
+                        _start_us = recorder::instance().now_us();
+        }
+
+        ~scope()
+        {
+                recorder &r = recorder::instance();
+                if (_start_us >= 0.0 && r.enabled())
+                        r.add(event{'X', _name, _start_us, r.now_us() - _start_us, 0.0, recorder::thread_id()});
+        }
+
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+private:
+        const char *_name;
+        double _start_us = -1.0;
+};
+
+// Enables recording for its lifetime and writes the JSON file when destroyed.
+// An empty path leaves tracing disabled.
+class session
+{
+public:
+        explicit session(const std::string &path) : _path(path)
+        {
+                if (!_path.empty())
+                        recorder::instance().start();
+        }
+
+        ~session()
+        {
+                if (_path.empty())
+                        return;
+                if (recorder::instance().write(_path))
+                        std::cout << "Trace written to " << _path << std::endl;
+                else
+                        std::cerr << "Could not write trace file " << _path << std::endl;
+        }
+
+        session(const session &) = delete;
+        session &operator=(const session &) = delete;
+
+private:
+        std::string _path;
+};
+
+} // namespace trace
+
+#define TRACE_EVENTS_CONCAT_(a, b) a##b
+#define TRACE_EVENTS_CONCAT(a, b) TRACE_EVENTS_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::scope TRACE_EVENTS_CONCAT(_trace_scope_, __LINE__)(name)
+
+#endif /* TRACE_EVENTS_HPP */
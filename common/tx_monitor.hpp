@@ -0,0 +1,236 @@
+// Live health of a transmit stream.
+//
+// UHD reports underflows, sequence errors and late packets as async messages
+// on the tx_streamer. Nobody reads them while a burst is running, so
+// marginal TX timing only shows up afterwards as a phase glitch. A
+// txmon::monitor owns the async queue of one tx_streamer: its thread drains
+// recv_async_msg() all the time, counts the events (stats::count(), trace
+// counters), prints the first event of every kind in a burst with its device
+// time, and hands the burst ACKs to the transmit thread:
+//
+//      txmon::monitor monitor(tx_stream);             // once per tx_streamer
+//      stream::transmit<...>(tx_stream, ...);
+//      monitor.wait_burst_ack(timeout);               // not stream::wait_burst_ack()
+//      monitor.report_burst();                        // "TX burst: 3 underflows (3.204 s to 3.871 s) ..."
+//
+// An optional hook sees every error event on the monitor thread, e.g. to
+// give the next burst a larger lead.
+
+#ifndef TX_MONITOR_HPP
+#define TX_MONITOR_HPP
+
+#include <uhd/stream.hpp>
+#include <boost/format.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency_stats.hpp"
+#include "trace_events.hpp"
+
+namespace txmon
+{
+
+struct event_count
+{
+        uint64_t count = 0;
+        double first = -1.0; // device time (s) of the first event, -1 if it had none
+        double last = -1.0;
+};
+
+// Error events of one burst (or of the whole session), indexed by stats::event
+struct counts
+{
+        std::array<event_count, static_cast<size_t>(stats::event::num_events)> events;
+
+        uint64_t total() const
+        {
+                uint64_t n = 0;
+                for (const event_count &e : events)
+                        n += e.count;
+                return n;
+        }
+};
+
+inline const char *event_label(stats::event e)
+{
+        switch (e)
+        {
+        case stats::event::tx_underflow:
+                return "underflows";
+        case stats::event::tx_seq_error:
+                return "sequence errors";
+        case stats::event::tx_time_error:
+                return "late packets";
+        default:
+                return "unknown";
+        }
+}
+
+class monitor
+{
+public:
+        using hook = std::function<void(stats::event, const uhd::async_metadata_t &)>;
+
+        explicit monitor(uhd::tx_streamer::sptr tx_stream, hook on_event = nullptr)
+            : _tx_stream(tx_stream), _on_event(on_event),
+              _acks(tx_stream->get_num_channels(), 0), _acks_seen(tx_stream->get_num_channels(), 0),
+              _thread([this]() { run(); })
+        {
+        }
+
+        ~monitor()
+        {
+                _stop = true;
+                _thread.join();
+        }
+
+        monitor(const monitor &) = delete;
+        monitor &operator=(const monitor &) = delete;
+
+        // Waits up to timeout seconds for the ACK of the next burst on every
+        // channel. Every burst, acked in time or not, takes one ACK per
+        // channel, so a late ACK of an earlier burst does not ack this one.
+        bool wait_burst_ack(double timeout)
+        {
+                TRACE_SCOPE("tx_burst_ack");
+                std::unique_lock<std::mutex> lock(_mutex);
+                bool acked = _cv.wait_for(lock, std::chrono::duration<double>(timeout), [this]() {
+                        for (size_t ch = 0; ch < _acks.size(); ch++)
+                                if (_acks[ch] <= _acks_seen[ch])
+                                        return false;
+                        return true;
+                });
+                for (uint64_t &seen : _acks_seen)
+                        seen++;
+                return acked;
+        }
+
+        // Prints the error events since the previous call (nothing if there
+        // were none) and starts counting the next burst
+        void report_burst()
+        {
+                counts burst;
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        burst = _burst;
+                        _burst = counts();
+                }
+                if (burst.total() == 0)
+                        return;
+
+                std::cerr << "TX burst:";
+                for (size_t i = 0; i < burst.events.size(); i++)
+                {
+                        const event_count &e = burst.events[i];
+                        if (e.count == 0)
+                                continue;
+                        std::cerr << boost::format(" %d %s") % e.count % event_label(static_cast<stats::event>(i));
+                        if (e.first >= 0.0)
+                                std::cerr << boost::format(" (%.6f s to %.6f s)") % e.first % e.last;
+                }
+                std::cerr << std::endl;
+        }
+
+        counts session() const
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _session;
+        }
+
+private:
+        void run()
+        {
+                trace::set_thread_name("tx_monitor");
+                uhd::async_metadata_t md;
+                while (!_stop)
+                {
+                        if (!_tx_stream->recv_async_msg(md, 0.1))
+                                continue;
+
+                        switch (md.event_code)
+                        {
+                        case uhd::async_metadata_t::EVENT_CODE_BURST_ACK:
+                        {
+                                std::lock_guard<std::mutex> lock(_mutex);
+                                if (md.channel < _acks.size())
+                                        _acks[md.channel]++;
+                                _cv.notify_all();
+                                break;
+                        }
+                        case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW:
+                        case uhd::async_metadata_t::EVENT_CODE_UNDERFLOW_IN_PACKET:
+                                record(stats::event::tx_underflow, md);
+                                break;
+                        case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR:
+                        case uhd::async_metadata_t::EVENT_CODE_SEQ_ERROR_IN_BURST:
+                                record(stats::event::tx_seq_error, md);
+                                break;
+                        case uhd::async_metadata_t::EVENT_CODE_TIME_ERROR:
+                                record(stats::event::tx_time_error, md);
+                                break;
+                        default:
+                                break;
+                        }
+                }
+        }
+
+        void record(stats::event ev, const uhd::async_metadata_t &md)
+        {
+                stats::count(ev);
+                double t = md.has_time_spec ? md.time_spec.get_real_secs() : -1.0;
+                size_t i = static_cast<size_t>(ev);
+
+                uint64_t total;
+                bool first_in_burst;
+                {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        for (counts *c : {&_burst, &_session})
+                        {
+                                event_count &e = c->events[i];
+                                if (e.count == 0)
+                                        e.first = t;
+                                e.last = t;
+                                e.count++;
+                        }
+                        total = _session.events[i].count;
+                        first_in_burst = _burst.events[i].count == 1;
+                }
+
+                trace::counter(stats::event_name(ev), double(total));
+                if (first_in_burst)
+                {
+                        std::cerr << boost::format("TX %s: first of this burst on channel %d") % event_label(ev) % md.channel;
+                        if (t >= 0.0)
+                                std::cerr << boost::format(" at %.6f s") % t;
+                        std::cerr << std::endl;
+                }
+                if (_on_event)
+                        _on_event(ev, md);
+        }
+
+        uhd::tx_streamer::sptr _tx_stream;
+        hook _on_event;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _cv;
+        std::vector<uint64_t> _acks;      // burst ACKs per channel
+        std::vector<uint64_t> _acks_seen; // ACKs per channel taken by wait_burst_ack()
+        counts _burst;
+        counts _session;
+
+        std::atomic<bool> _stop{false};
+        std::thread _thread; // last: starts once everything above is constructed
+};
+
+} // namespace txmon
+
+#endif /* TX_MONITOR_HPP */
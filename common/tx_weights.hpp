@@ -0,0 +1,402 @@
+// Per-channel complex transmit weights (beamforming) applied in the send loop.
+//
+// The transmit worker keeps one baseband buffer; weights::source<N> renders
+// out[ch][i] = base[i] * w[ch] into one buffer per channel before a send().
+// New weights are posted to a weights::bank from any thread (e.g. a ZMQ
+// listener) and picked up by the send loop without stopping the burst:
+// immediate updates on the next buffer boundary, timed updates at the exact
+// sample of their device time, splitting the buffer they fall in. Timed
+// updates for a device time after the burst wait in the bank for the next
+// one; those for a time before the burst started are dropped (and counted).
+//
+//      weights::bank tx_weights;                       // outlives the bursts
+//      tx_weights.post(weights::parse("@3.5 0.8 0 0 0.8", 2));
+//
+//      weights::source<N> source(tx_weights, seq, md.time_spec.get_real_secs(), rate);
+//      stream::transmit_from<sample_fc32, N>(tx_stream, source, spb, nsamps, md, timeout, &stop_signal_called);
+//
+// The output buffers are only rendered again when the weights change, so a
+// constant weight vector costs nothing per buffer.
+//
+// Update messages are text, an optional device time followed by one real and
+// imaginary part per channel:
+//      "0.8 0 0 0.8"           apply on the next buffer
+//      "@3.5 0.8 0 0 0.8"      apply from device time 3.5 s
+//
+// For beam sweeps, weights::codebook_source<N> cycles through a codebook
+// instead, dwell seconds per entry from the start of the burst. Every entry
+// is rendered once up front, so a beam change is a pointer swap on a buffer
+// boundary and a copy inside a buffer, with no host round-trip. Tiles that
+// start their bursts at the same device time and load the same codebook put
+// entry k on air at the same time. Codebook files hold one entry per line,
+// a real and imaginary part per column; every tile reads its channels from
+// its own first column on:
+//      # tile 0 ch0  tile 0 ch1  tile 1 ch0  tile 1 ch1
+//      0.8 0         0.8 0       0.8 0       0.8 0
+//      0.8 0         0 0.8       -0.8 0      0 -0.8
+
+#ifndef TX_WEIGHTS_HPP
+#define TX_WEIGHTS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "latency_stats.hpp"
+#include "trace_events.hpp"
+
+namespace weights
+{
+
+constexpr size_t max_channels = 2;
+
+using sample = std::complex<float>;
+using vector = std::array<sample, max_channels>;
+
+struct update
+{
+        vector w;
+        bool timed = false;
+        double time = 0.0; // device time (s) the weights apply from, if timed
+};
+
+inline update parse(const std::string &msg, size_t num_channels)
+{
+        if (num_channels == 0 || num_channels > max_channels)
+                throw std::runtime_error("Only 1 or 2 weight channels are supported, got " + std::to_string(num_channels));
+
+        std::istringstream ss(msg);
+        update u;
+        u.w.fill(sample(1.0f));
+        if (ss >> std::ws && ss.peek() == '@')
+        {
+                ss.get();
+                if (!(ss >> u.time))
+                        throw std::runtime_error("Invalid weight time in \"" + msg + "\"");
+                u.timed = true;
+        }
+        for (size_t ch = 0; ch < num_channels; ch++)
+        {
+                float re, im;
+                if (!(ss >> re >> im) || !std::isfinite(re) || !std::isfinite(im))
+                        throw std::runtime_error("Expected " + std::to_string(num_channels) + " weights (re im) in \"" + msg + "\"");
+                u.w[ch] = sample(re, im);
+        }
+        if (ss >> std::ws && !ss.eof())
+                throw std::runtime_error("Trailing characters in weights \"" + msg + "\"");
+        return u;
+}
+
+// out[i] = in[i] * w for nsamps samples. Written on the interleaved floats so
+// the compiler vectorises it: std::complex<float>::operator* goes through
+// __mulsc3 for the NaN/inf corner cases and does not.
+inline void apply(const sample *in, sample *out, size_t nsamps, sample w)
+{
+        const float *__restrict x = reinterpret_cast<const float *>(in);
+        float *__restrict y = reinterpret_cast<float *>(out);
+        const float wr = w.real();
+        const float wi = w.imag();
+        for (size_t i = 0; i < 2 * nsamps; i += 2)
+        {
+                const float re = x[i];
+                const float im = x[i + 1];
+                y[i] = re * wr - im * wi;
+                y[i + 1] = re * wi + im * wr;
+        }
+}
+
+// Weights in force and the updates not yet applied. post() may be called from
+// any thread; the send loop only takes the lock when an update is pending.
+class bank
+{
+public:
+        bank() { _current.fill(sample(1.0f)); }
+
+        void post(const update &u)
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.push_back(u);
+                _pending.store(true, std::memory_order_release);
+        }
+
+        vector current() const
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _current;
+        }
+
+        bool pending() const { return _pending.load(std::memory_order_acquire); }
+
+        // Moves the posted updates into out, in the order they were posted
+        void take(std::vector<update> &out)
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                out.insert(out.end(), _queue.begin(), _queue.end());
+                _queue.clear();
+                _pending.store(false, std::memory_order_relaxed);
+        }
+
+        // Called at the end of a burst: the weights it ended with and the
+        // timed updates for after its end, ahead of anything posted since
+        void store(const vector &w, const std::vector<update> &later)
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _current = w;
+                _queue.insert(_queue.begin(), later.begin(), later.end());
+                if (!_queue.empty())
+                        _pending.store(true, std::memory_order_release);
+        }
+
+private:
+        mutable std::mutex _mutex;
+        vector _current;
+        std::vector<update> _queue;
+        std::atomic<bool> _pending{false};
+};
+
+// Transmit source (see stream::transmit_from) for one burst: the base buffer
+// times the weights of every channel. start_time and rate map the sample index
+// of the burst to device time for the timed updates.
+template <size_t N>
+class source
+{
+public:
+        source(bank &weights, const std::vector<sample> &base, double start_time, double rate)
+            : _bank(weights), _base(base), _start_time(start_time), _rate(rate), _w(weights.current())
+        {
+                static_assert(N >= 1 && N <= max_channels, "Unsupported number of weight channels");
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        _out[ch].resize(_base.size());
+                        _ptrs[ch] = _out[ch].data();
+                }
+        }
+
+        ~source()
+        {
+                // the timed updates the burst did not reach are for a later burst
+                std::vector<update> later;
+                for (const scheduled &s : _schedule)
+                        later.push_back(s.u);
+                _bank.store(_w, later);
+                if (_late)
+                        std::cerr << _late << " timed weight update(s) arrived after their time and were applied late" << std::endl;
+                if (_dropped)
+                        std::cerr << _dropped << " timed weight update(s) were for before the burst and were dropped" << std::endl;
+        }
+
+        std::array<const sample *, N> next(size_t first_sample, size_t nsamps)
+        {
+                if (nsamps > _base.size())
+                        throw std::runtime_error("Transmit buffer larger than the weight base buffer");
+
+                if (_bank.pending())
+                        pull(first_sample);
+
+                // render up to every weight change inside this buffer, then the rest
+                size_t done = 0;
+                while (!_schedule.empty() && _schedule.front().at < first_sample + nsamps)
+                {
+                        size_t at = std::max<size_t>(_schedule.front().at, first_sample) - first_sample;
+                        if (at > done)
+                                render(done, at);
+                        done = std::max(done, at);
+                        _w = _schedule.front().u.w;
+                        _schedule.erase(_schedule.begin());
+                        _rendered = false;
+                        trace::counter("tx_weight_updates", double(++_applied));
+                }
+                if (done > 0)
+                        render(done, nsamps); // mixed buffer, the next one renders again
+                else if (!_rendered)
+                {
+                        render(0, _base.size());
+                        _rendered = true;
+                }
+                return _ptrs;
+        }
+
+        const vector &weights() const { return _w; }
+
+private:
+        struct scheduled
+        {
+                size_t at; // sample index in the burst
+                update u;
+        };
+
+        void pull(size_t first_sample)
+        {
+                std::vector<update> updates;
+                _bank.take(updates);
+                for (const update &u : updates)
+                {
+                        size_t at = first_sample;
+                        if (u.timed)
+                        {
+                                // first sample at or after u.time, 1e-6 samples of slack
+                                // for the rounding of the time
+                                double index = std::ceil((u.time - _start_time) * _rate - 1e-6);
+                                if (index < 0.0)
+                                {
+                                        // before the burst started
+                                        _dropped++;
+                                        continue;
+                                }
+                                if (index < double(first_sample))
+                                        _late++;
+                                else
+                                        at = size_t(index);
+                        }
+                        // stable: updates for the same sample apply in posting order
+                        auto pos = std::upper_bound(_schedule.begin(), _schedule.end(), at,
+                                                    [](size_t a, const scheduled &s) { return a < s.at; });
+                        _schedule.insert(pos, scheduled{at, u});
+                }
+        }
+
+        void render(size_t begin, size_t end)
+        {
+                LATENCY_SCOPE(stats::stage::tx_weights);
+                for (size_t ch = 0; ch < N; ch++)
+                        apply(_base.data() + begin, _out[ch].data() + begin, end - begin, _w[ch]);
+        }
+
+        bank &_bank;
+        const std::vector<sample> &_base;
+        double _start_time;
+        double _rate;
+        vector _w;
+        std::array<std::vector<sample>, N> _out;
+        std::array<const sample *, N> _ptrs;
+        std::vector<scheduled> _schedule;
+        bool _rendered = false;
+        size_t _applied = 0;
+        size_t _late = 0;
+        size_t _dropped = 0;
+};
+
+struct codebook
+{
+        std::vector<vector> entries;
+        double dwell = 0.0; // s per entry
+};
+
+inline codebook load_codebook(const std::string &path, size_t num_channels, size_t first_column, double dwell)
+{
+        if (num_channels == 0 || num_channels > max_channels)
+                throw std::runtime_error("Only 1 or 2 weight channels are supported, got " + std::to_string(num_channels));
+        if (!(dwell > 0.0))
+                throw std::runtime_error("The codebook dwell time must be positive");
+
+        std::ifstream file(path);
+        if (!file)
+                throw std::runtime_error("Could not open codebook " + path);
+
+        codebook cb;
+        cb.dwell = dwell;
+        std::string line;
+        while (std::getline(file, line))
+        {
+                if (line.empty() || line[0] == '#')
+                        continue;
+                std::istringstream ss(line);
+                std::vector<float> parts;
+                float part;
+                while (ss >> part)
+                        parts.push_back(part);
+                if (!ss.eof() || parts.size() % 2 != 0 || 2 * (first_column + num_channels) > parts.size())
+                        throw std::runtime_error("Invalid codebook entry \"" + line + "\" in " + path);
+
+                vector w;
+                w.fill(sample(1.0f));
+                for (size_t ch = 0; ch < num_channels; ch++)
+                        w[ch] = sample(parts[2 * (first_column + ch)], parts[2 * (first_column + ch) + 1]);
+                cb.entries.push_back(w);
+        }
+        if (cb.entries.empty())
+                throw std::runtime_error("No codebook entries in " + path);
+        return cb;
+}
+
+// Transmit source that cycles through the codebook, entry k on air from
+// sample k * dwell of the burst (modulo the codebook length).
+template <size_t N>
+class codebook_source
+{
+public:
+        codebook_source(const codebook &cb, const std::vector<sample> &base, double rate)
+            : _dwell(size_t(std::llround(cb.dwell * rate))), _beams(cb.entries.size())
+        {
+                static_assert(N >= 1 && N <= max_channels, "Unsupported number of weight channels");
+                if (_dwell == 0)
+                        throw std::runtime_error("The codebook dwell time is shorter than one sample");
+
+                LATENCY_SCOPE(stats::stage::tx_weights);
+                for (size_t e = 0; e < _beams.size(); e++)
+                {
+                        for (size_t ch = 0; ch < N; ch++)
+                        {
+                                _beams[e][ch].resize(base.size());
+                                apply(base.data(), _beams[e][ch].data(), base.size(), cb.entries[e][ch]);
+                        }
+                }
+                for (size_t ch = 0; ch < N; ch++)
+                {
+                        _out[ch].resize(base.size());
+                        _ptrs[ch] = _out[ch].data();
+                }
+        }
+
+        std::array<const sample *, N> next(size_t first_sample, size_t nsamps)
+        {
+                if (nsamps > _out[0].size())
+                        throw std::runtime_error("Transmit buffer larger than the codebook base buffer");
+
+                // the whole buffer in one entry: send its rendered buffers
+                size_t slot = first_sample / _dwell;
+                if (first_sample + nsamps <= (slot + 1) * _dwell)
+                        return beam(slot % _beams.size());
+
+                // stitch the entries that change inside this buffer
+                LATENCY_SCOPE(stats::stage::tx_weights);
+                size_t done = 0;
+                while (done < nsamps)
+                {
+                        size_t k = first_sample + done;
+                        size_t run = std::min(nsamps - done, (k / _dwell + 1) * _dwell - k);
+                        const std::array<std::vector<sample>, N> &b = _beams[(k / _dwell) % _beams.size()];
+                        for (size_t ch = 0; ch < N; ch++)
+                                std::copy(b[ch].begin() + done, b[ch].begin() + done + run, _out[ch].begin() + done);
+                        done += run;
+                }
+                return _ptrs;
+        }
+
+private:
+        std::array<const sample *, N> beam(size_t e) const
+        {
+                std::array<const sample *, N> ptrs;
+                for (size_t ch = 0; ch < N; ch++)
+                        ptrs[ch] = _beams[e][ch].data();
+                return ptrs;
+        }
+
+        size_t _dwell; // samples per entry
+        std::vector<std::array<std::vector<sample>, N>> _beams;
+        std::array<std::vector<sample>, N> _out;
+        std::array<const sample *, N> _ptrs;
+};
+
+} // namespace weights
+
+#endif /* TX_WEIGHTS_HPP */
@@ -0,0 +1,302 @@
+// Computes the AD9361 BBPLL and RFPLL settings for a grid of master clock
+// rates and RF frequencies, without a B210 attached.
+//
+// The arithmetic mirrors UHD's ad9361_device_t (_setup_rates, _tune_bbvco and
+// _tune_helper), i.e. the values sweep_rates.py scrapes from the trace log:
+//      BBPLL: 40 MHz reference, modulus 2088960, VCO 672 MHz - 1430 MHz
+//      RFPLL: 80 MHz reference, modulus 8388593, VCO 6 GHz - 12 GHz
+//
+// A combination is phase-repeatable when the BBPLL and RFPLL are both
+// integer-N (nfrac == 0) and the LO lands on the requested frequency, so no
+// residual is left for the DSP CORDIC: every retune then brings back the same
+// LO and sample clock relationship.
+//
+//      ./tune_explorer --freq-start 400e6 --freq-stop 6e9 --freq-step 1e6 --integer-only
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+
+struct bbpll_result
+{
+        bool valid = false;
+        int divfactor = 0;
+        double adcclk_req = 0.0; // master clock rate * divfactor
+        double vcorate = 0.0;
+        int vcodiv = 0;
+        int nint = 0;
+        int nfrac = 0;
+        double adcclk = 0.0;
+        double dacclk = 0.0;
+        double actual_rate = 0.0; // actual master clock rate
+};
+
+struct rfpll_result
+{
+        bool valid = false;
+        double vcorate = 0.0;
+        int vcodiv = 0;
+        int nint = 0;
+        int nfrac = 0;
+        double actual_lo = 0.0;
+};
+
+// ad9361_device_t::_setup_rates: decimation/interpolation factor of the FIR chain
+int divfactor(double rate)
+{
+        if (rate < 0.33e6)
+                return 48;
+        if (rate < 0.66e6)
+                return 32;
+        if (rate <= 20e6)
+                return 16;
+        if (rate < 23e6)
+                return 24;
+        if (rate < 41e6)
+                return 16;
+        if (rate <= 58e6)
+                return 12;
+        if (rate <= 61.44e6)
+                return 8;
+        return 0;
+}
+
+// ad9361_device_t::_setup_rates + _tune_bbvco
+bbpll_result tune_bbpll(double rate)
+{
+        const double fref = 40e6;
+        const int modulus = 2088960;
+        const double vcomax = 1430e6;
+        const double vcomin = 672e6;
+
+        bbpll_result r;
+        r.divfactor = divfactor(rate);
+        if (r.divfactor == 0)
+                return r;
+        r.adcclk_req = rate * r.divfactor;
+
+        int i = 1;
+        for (; i <= 6; i++)
+        {
+                r.vcodiv = 1 << i;
+                r.vcorate = r.adcclk_req * r.vcodiv;
+                if (r.vcorate >= vcomin && r.vcorate <= vcomax)
+                        break;
+        }
+        if (i == 7)
+                return r;
+
+        // Fo = Fref * (Nint + Nfrac / mod)
+        r.nint = int(std::floor(r.vcorate / fref));
+        r.nfrac = int(std::round((r.vcorate / fref - r.nint) * modulus));
+        double actual_vcorate = fref * (r.nint + double(r.nfrac) / modulus);
+
+        r.adcclk = actual_vcorate / r.vcodiv;
+        // the DAC clock must be <= 336 MHz, else it runs at half the ADC clock
+        r.dacclk = (r.adcclk > 336e6) ? r.adcclk / 2.0 : r.adcclk;
+        r.actual_rate = r.adcclk / r.divfactor;
+        r.valid = true;
+        return r;
+}
+
+// ad9361_device_t::_tune_helper
+rfpll_result tune_rfpll(double freq)
+{
+        const double fref = 80e6;
+        const int modulus = 8388593;
+        const double vcomax = 12e9;
+        const double vcomin = 6e9;
+
+        rfpll_result r;
+        int i = 0;
+        for (; i <= 6; i++)
+        {
+                r.vcodiv = 2 << i;
+                r.vcorate = freq * r.vcodiv;
+                if (r.vcorate >= vcomin && r.vcorate <= vcomax)
+                        break;
+        }
+        if (i == 7)
+                return r;
+
+        r.nint = int(r.vcorate / fref);
+        r.nfrac = int(std::lround((r.vcorate / fref - r.nint) * modulus));
+        double actual_vcorate = fref * (r.nint + double(r.nfrac) / modulus);
+        r.actual_lo = actual_vcorate / r.vcodiv;
+        r.valid = true;
+        return r;
+}
+
+// requested - actual LO, left to the DSP
+double residual(double freq, const rfpll_result &rf)
+{
+        return freq - rf.actual_lo;
+}
+
+bool repeatable(const bbpll_result &bb, const rfpll_result &rf, double freq)
+{
+        return bb.valid && rf.valid && bb.nfrac == 0 && rf.nfrac == 0 && std::abs(residual(freq, rf)) < 1e-3;
+}
+
+std::vector<double> parse_list(const std::string &list)
+{
+        std::vector<double> values;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+                values.push_back(std::stod(item));
+        return values;
+}
+
+std::vector<double> range(double start, double stop, double step)
+{
+        if (step <= 0.0)
+                throw std::runtime_error("Step must be positive");
+        std::vector<double> values;
+        for (size_t i = 0;; i++)
+        {
+                double v = start + i * step;
+                if (v > stop + step * 1e-9)
+                        break;
+                values.push_back(v);
+        }
+        return values;
+}
+
+int main(int argc, char *argv[])
+{
+        std::string rates_list, out_file;
+        double rate_start, rate_stop, rate_step;
+        double freq_start, freq_stop, freq_step;
+        size_t num_threads;
+        bool integer_only = false;
+
+        po::options_description desc("Allowed options");
+        // clang-format off
+        desc.add_options()
+                ("help", "help message")
+                ("rates", po::value<std::string>(&rates_list)->default_value("4e6,8e6,10e6,12.5e6,16e6,20e6,25e6,32e6,40e6,50e6,61e6"), "comma separated master clock rates (ignored with --rate-step)")
+                ("rate-start", po::value<double>(&rate_start)->default_value(1e6), "first master clock rate of a range")
+                ("rate-stop", po::value<double>(&rate_stop)->default_value(61.44e6), "last master clock rate of a range")
+                ("rate-step", po::value<double>(&rate_step), "master clock rate step, enables the range")
+                ("freq-start", po::value<double>(&freq_start)->default_value(917e6), "first RF frequency")
+                ("freq-stop", po::value<double>(&freq_stop)->default_value(917e6), "last RF frequency")
+                ("freq-step", po::value<double>(&freq_step)->default_value(1e6), "RF frequency step")
+                ("integer-only", po::bool_switch(&integer_only), "only list phase-repeatable combinations")
+                ("threads", po::value<size_t>(&num_threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "worker threads")
+                ("out", po::value<std::string>(&out_file)->default_value("clock_tuning_grid.csv"), "CSV file with the full table")
+        ;
+        // clang-format on
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+                std::cout << "AD9361 tune parameter explorer " << desc << std::endl;
+                return EXIT_SUCCESS;
+        }
+
+        std::vector<double> rates = vm.count("rate-step") ? range(rate_start, rate_stop, rate_step) : parse_list(rates_list);
+        std::vector<double> freqs = range(freq_start, freq_stop, freq_step);
+
+        // the BBPLL only depends on the master clock rate
+        std::vector<bbpll_result> bbplls(rates.size());
+        for (size_t i = 0; i < rates.size(); i++)
+                bbplls[i] = tune_bbpll(rates[i]);
+
+        // the RFPLL only depends on the RF frequency
+        std::vector<rfpll_result> rfplls(freqs.size());
+        for (size_t i = 0; i < freqs.size(); i++)
+                rfplls[i] = tune_rfpll(freqs[i]);
+
+        std::ofstream out(out_file);
+        if (!out)
+                throw std::runtime_error("Could not open " + out_file);
+        out << "master_clock_rate,divfactor,adcclk_req,bb_vcorate,bb_vcodiv,bb_nint,bb_nfrac,adcclk,dacclk,actual_rate,"
+               "freq,rf_vcorate,rf_vcodiv,rf_nint,rf_nfrac,actual_lo,residual,repeatable\n";
+
+        // one master clock rate (a row of the grid) per thread, rows written in order
+        num_threads = std::max<size_t>(1, std::min(num_threads, rates.size()));
+        std::vector<std::string> rows(num_threads);
+        std::vector<size_t> row_repeatable(num_threads);
+        auto worker = [&](size_t slot, size_t r)
+        {
+                const bbpll_result &bb = bbplls[r];
+                std::string &row = rows[slot];
+                char line[256];
+                row.clear();
+                row_repeatable[slot] = 0;
+                for (size_t f = 0; f < freqs.size(); f++)
+                {
+                        const rfpll_result &rf = rfplls[f];
+                        bool ok = repeatable(bb, rf, freqs[f]);
+                        row_repeatable[slot] += ok;
+                        if (integer_only && !ok)
+                                continue;
+                        if (!bb.valid || !rf.valid)
+                        {
+                                snprintf(line, sizeof(line), "%.1f,,,,,,,,,,%.1f,,,,,,,0\n", rates[r], freqs[f]);
+                                row += line;
+                                continue;
+                        }
+                        // snprintf, boost::format is the bottleneck on large grids
+                        snprintf(line, sizeof(line), "%.1f,%d,%.1f,%.1f,%d,%d,%d,%.3f,%.3f,%.6f,%.1f,%.1f,%d,%d,%d,%.6f,%.6f,%d\n",
+                                 rates[r], bb.divfactor, bb.adcclk_req, bb.vcorate, bb.vcodiv, bb.nint, bb.nfrac,
+                                 bb.adcclk, bb.dacclk, bb.actual_rate, freqs[f], rf.vcorate, rf.vcodiv, rf.nint,
+                                 rf.nfrac, rf.actual_lo, residual(freqs[f], rf), int(ok));
+                        row += line;
+                }
+        };
+
+        size_t num_repeatable = 0;
+        for (size_t first = 0; first < rates.size(); first += num_threads)
+        {
+                size_t count = std::min(num_threads, rates.size() - first);
+                std::vector<std::thread> threads;
+                for (size_t t = 0; t < count; t++)
+                        threads.emplace_back(worker, t, first + t);
+                for (size_t t = 0; t < count; t++)
+                {
+                        threads[t].join();
+                        out << rows[t];
+                        num_repeatable += row_repeatable[t];
+                }
+        }
+
+        // per master clock rate: the BBPLL settings, as in example_output.txt
+        std::cout << boost::format("%18s %12s %10s %14s %7s %5s %8s %12s") % "master_clock_rate" % "rate" % "divfactor" %
+                         "vcorate" % "vcodiv" % "nint" % "nfrac" % "adcclk"
+                  << std::endl;
+        for (size_t i = 0; i < rates.size(); i++)
+        {
+                const bbpll_result &bb = bbplls[i];
+                if (!bb.valid)
+                {
+                        std::cout << boost::format("%18.1f  (no valid BBPLL setting)") % rates[i] << std::endl;
+                        continue;
+                }
+                std::cout << boost::format("%18.1f %12.1f %10d %14.1f %7d %5d %8d %12.1f") % rates[i] % bb.adcclk_req %
+                                 bb.divfactor % bb.vcorate % bb.vcodiv % bb.nint % bb.nfrac % bb.adcclk
+                          << std::endl;
+        }
+
+        std::cout << std::endl
+                  << boost::format("%d of %d combinations (%d rates x %d frequencies) are phase-repeatable, %d threads")
+                         % num_repeatable % (rates.size() * freqs.size()) % rates.size() % freqs.size() % num_threads
+                  << std::endl;
+        std::cout << "Table written to " << out_file << std::endl;
+        return EXIT_SUCCESS;
+}
@@ -35,9 +35,33 @@
 #include "MAX2871.h"
 // #include <math.h>
 #include <stdio.h>
-// #include <SPI.h>
+#include <SPI.h>
 
 double myRound(double number);
+
+#ifdef MAX2871_PRESETS
+// Precomputed dividers (max2871Solve output) for the frequencies we retune to
+// most, build with -D MAX2871_PRESETS to skip the solver for these.
+struct MAX2871_Preset
+{
+    uint16_t freq;
+    uint16_t ref;
+    uint16_t rdiv;
+    MAX2871_Dividers dividers;
+};
+
+const MAX2871_Preset max2871Presets[] PROGMEM = {
+    { 400, 10, 1, {  40,    0, MAX2871_MODULUS, 3, 0}},
+    { 433, 10, 1, { 346, 1600, MAX2871_MODULUS, 3, 1}},
+    { 868, 10, 1, { 347,  800, MAX2871_MODULUS, 2, 1}},
+    { 915, 10, 1, {  91,    0, MAX2871_MODULUS, 2, 0}},
+    { 917, 10, 1, {  91,    0, MAX2871_MODULUS, 2, 0}},
+    { 920, 10, 1, {  92,    0, MAX2871_MODULUS, 2, 0}},
+    {2400, 10, 1, { 240,    0, MAX2871_MODULUS, 1, 0}},
+    {2450, 10, 1, { 245,    0, MAX2871_MODULUS, 1, 0}},
+    {5800, 10, 1, { 580,    0, MAX2871_MODULUS, 0, 0}},
+};
+#endif
  
 //****************************************************************************
 MAX2871::MAX2871(uint8_t le, uint8_t mosi, uint8_t sclk, uint8_t miso){
@@ -46,11 +70,29 @@ MAX2871::MAX2871(uint8_t le, uint8_t mosi, uint8_t sclk, uint8_t miso){
     m_mosi = mosi;
     m_sclk = sclk;
     m_miso = miso;
+    m_lePort = portOutputRegister(digitalPinToPort(le));
+    m_leMask = digitalPinToBitMask(le);
+    m_transport = MAX2871_SPI_HARDWARE;
+    f_pfd = 0;
+    m_ref = 0;
+    m_rdiv = 1;
+    m_hold = false;
+    m_latchOnPPS = false;
+    m_latchPending = false;
+    m_latchCount = 0;
+    m_latchMicros = 0;
+    for(uint8_t addr = 0; addr < 6; addr++){
+        m_written[addr] = 0;
+    }
 }
 
 
 //****************************************************************************
-void MAX2871::begin(){
+void MAX2871::begin(const uint8_t transport){
+    m_transport = transport;
+    if(m_transport == MAX2871_SPI_HARDWARE)
+        SPI.begin();
+
     reg0.all = 0x007d0000;
     reg1.all = 0x2000fff9;
     reg2.all = 0x00004042;
@@ -77,69 +119,214 @@ void MAX2871::begin(){
 //****************************************************************************    
 void MAX2871::write(const uint32_t data)
 {
-    // m_le = 0;
-    // digitalWrite(m_le, LOW);
-    // SPI.transfer((0xFF000000 & data) >> 24);
-    // SPI.transfer((0x00FF0000 & data) >> 16);
-    // SPI.transfer((0x0000FF00 & data) >> 8);
-    // SPI.transfer( 0x000000FF & data);
-    // digitalWrite(m_le, HIGH);
-    // m_le = 1;
-
-    digitalWrite(m_le, LOW);
-
-    shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0xFF000000) >> 24));
-    shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0x00FF0000) >> 16));
-    shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0x0000FF00) >> 8));
-    shiftOut(m_mosi, m_sclk, MSBFIRST, (data & 0x000000FF));
-
-    digitalWrite(m_le, HIGH);
+    // LE through its port register, digitalWrite costs more than a byte on the SPI bus
+    *m_lePort &= ~m_leMask;
+
+    if(m_transport == MAX2871_SPI_HARDWARE){
+        SPI.beginTransaction(SPISettings(MAX2871_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+        SPI.transfer((0xFF000000 & data) >> 24);
+        SPI.transfer((0x00FF0000 & data) >> 16);
+        SPI.transfer((0x0000FF00 & data) >> 8);
+        SPI.transfer( 0x000000FF & data);
+        SPI.endTransaction();
+    }else{
+        shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0xFF000000) >> 24));
+        shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0x00FF0000) >> 16));
+        shiftOut(m_mosi, m_sclk, MSBFIRST, ((data & 0x0000FF00) >> 8));
+        shiftOut(m_mosi, m_sclk, MSBFIRST, (data & 0x000000FF));
+    }
+
+    *m_lePort |= m_leMask;
+}
+
+//****************************************************************************    
+uint8_t MAX2871::readByte()
+{
+    if(m_transport == MAX2871_SPI_HARDWARE)
+        return SPI.transfer(0x00);
+    return shiftIn(m_miso, m_sclk, MSBFIRST);
+}
+
+//****************************************************************************    
+uint32_t MAX2871::getRegister(const uint8_t addr)
+{
+    switch(addr){
+        case 0: return reg0.all;
+        case 1: return reg1.all;
+        case 2: return reg2.all;
+        case 3: return reg3.all;
+        case 4: return reg4.all;
+        case 5: return reg5.all;
+        default: return reg6.all;
+    }
+}
+
+//****************************************************************************    
+void MAX2871::writeRegister(const uint8_t addr)
+{
+    m_written[addr] = getRegister(addr);
+    if(addr == 0)
+        m_latchCount++;
+    write(m_written[addr]);
+    if(addr == 0)
+        m_latchMicros = micros();
+}
+
+//****************************************************************************    
+uint16_t MAX2871::getLatchCount()
+{
+    // two bytes on the AVR, the PPS interrupt may count in between
+    uint8_t sreg = SREG;
+    noInterrupts();
+    uint16_t count = m_latchCount;
+    SREG = sreg;
+    return count;
+}
+
+//****************************************************************************    
+uint32_t MAX2871::getLatchMicros()
+{
+    uint8_t sreg = SREG;
+    noInterrupts();
+    uint32_t time = m_latchMicros;
+    SREG = sreg;
+    return time;
 }
 
 //****************************************************************************    
 void MAX2871::updateAll()
 {
-    write(reg5.all);
-    write(reg4.all);
-    write(reg3.all);
-    write(reg2.all);
-    write(reg1.all);
-    write(reg0.all);
+    for(int8_t addr = 5; addr >= 0; addr--){
+        writeRegister(addr);
+    }
+}
+
+//****************************************************************************    
+void MAX2871::update()
+{
+    if(m_hold)
+        return;
+
+    // A staged set that is still current keeps waiting for the edge. Otherwise
+    // take it back before latch() can write it, it is staged again below.
+    if(m_latchPending){
+        uint8_t sreg = SREG;
+        noInterrupts();
+        bool same = true;
+        for(uint8_t addr = 0; addr < 6; addr++){
+            if(getRegister(addr) != m_staged[addr])
+                same = false;
+        }
+        if(!same)
+            m_latchPending = false;
+        SREG = sreg;
+        if(same)
+            return;
+    }
+
+    // R0 goes out when its contents or any double buffered setting changed;
+    // the output stage bits of R4 take effect without R0
+    bool latch = reg0.all != m_written[0];
+    for(uint8_t addr = 1; addr < 6; addr++){
+        uint32_t changed = getRegister(addr) ^ m_written[addr];
+        if(changed == 0)
+            continue;
+        if(addr != 4 || (changed & ~MAX2871_REG4_OUTPUT_BITS))
+            latch = true;
+    }
+
+    if(m_latchOnPPS && latch){
+        // nothing goes out before the edge, latch() writes the whole set
+        for(uint8_t addr = 0; addr < 6; addr++){
+            m_staged[addr] = getRegister(addr);
+        }
+        m_latchPending = true;
+        return;
+    }
+
+    // R5 down to R1 as in updateAll, only the ones that changed
+    for(int8_t addr = 5; addr >= 1; addr--){
+        if(getRegister(addr) != m_written[addr])
+            writeRegister(addr);
+    }
+
+    // R0 last: it latches the double buffered dividers and starts the VCO autoselect
+    if(latch)
+        writeRegister(0);
+}
+
+//****************************************************************************    
+void MAX2871::setLatchOnPPS(const bool enable)
+{
+    m_latchOnPPS = enable;
+    // DIVA in R4 waits for R0 as well
+    reg2.bits.reg4db = enable;
+    update();
+}
+
+//****************************************************************************    
+bool MAX2871::latchPending()
+{
+    return m_latchPending;
+}
+
+//****************************************************************************    
+void MAX2871::latch()
+{
+    if(!m_latchPending)
+        return;
+    for(int8_t addr = 5; addr >= 1; addr--){
+        if(m_staged[addr] != m_written[addr]){
+            write(m_staged[addr]);
+            m_written[addr] = m_staged[addr];
+        }
+    }
+    m_latchCount++;
+    write(m_staged[0]);
+    m_latchMicros = micros();
+    m_written[0] = m_staged[0];
+    m_latchPending = false;
+}
+
+//****************************************************************************    
+void MAX2871::holdUpdates(const bool hold)
+{
+    m_hold = hold;
+    if(!hold)
+        update();
 }
 
 //****************************************************************************    
 uint32_t MAX2871::readRegister6()
 {
-    uint32_t raw, reg6read;
+    uint32_t raw, reg6read = 0;
     
     reg5.bits.mux = 1;
     reg2.bits.mux = 0x4;
-    write(reg5.all);
-    write(reg2.all);
+    writeRegister(5);
+    writeRegister(2);
     
     write(0x00000006);
     
-    // m_spiBus.format(8,1);
-    // SPI.setDataMode(SPI_MODE3);
+    // MUX shifts the data out on the rising edge, sample on the falling one
+    if(m_transport == MAX2871_SPI_HARDWARE)
+        SPI.beginTransaction(SPISettings(MAX2871_SPI_CLOCK, MSBFIRST, SPI_MODE1));
     
-    // raw = SPI.transfer(0x00);
-    raw = shiftIn(m_miso, m_sclk, MSBFIRST); 
+    raw = readByte();
     reg6read = (reg6read & 0x01FFFFF) + (raw << 25);
-    // raw = SPI.transfer(0x00);
-    raw = shiftIn(m_miso, m_sclk, MSBFIRST); 
+    raw = readByte();
     reg6read = (reg6read & 0xFE01FFFF) + (raw << 17); 
-    // raw = SPI.transfer(0x00);
-    raw = shiftIn(m_miso, m_sclk, MSBFIRST); 
+    raw = readByte();
     reg6read = (reg6read & 0xFFFE01FF) + (raw << 9);
-    // raw = SPI.transfer(0x00);
-    raw = shiftIn(m_miso, m_sclk, MSBFIRST); 
+    raw = readByte();
     reg6read = (reg6read & 0xFFFFFE01) + (raw << 1);
     
-    // SPI.transfer(0x00);
-    shiftOut(m_mosi, m_sclk, MSBFIRST, 0x00); 
-    
-    // m_spiBus.format(8,0);
-    // SPI.setDataMode(SPI_MODE0);
+    if(m_transport == MAX2871_SPI_HARDWARE){
+        SPI.transfer(0x00);
+        SPI.endTransaction();
+    }else{
+        shiftOut(m_mosi, m_sclk, MSBFIRST, 0x00); 
+    }
     
     return reg6read;
 }
@@ -151,60 +338,105 @@ double myRound(double number) {
 //****************************************************************************    
 void MAX2871::setRFOUTA(const double freq)
 {
-    uint32_t n,frac,m,diva = 0;
-    double pll_coefficient,fractional = 0;
-    
-    double f_pfd = getPFD();
-    
-    while(freq*powf(2,diva) < 3000.0)
-    {
-        diva = diva + 1;
-    }
-    pll_coefficient = freq*powf(2,diva)/f_pfd;
+    // no setPFD() yet
+    if(f_pfd <= 0)
+        return;
+    setDividers(max2871SolveReference<double>(freq, getPFD()));
+}
 
-    n = floor(round(pll_coefficient));
-    // n = static_cast<uint32_t>(round(pll_coefficient));
-    
-    fractional = pll_coefficient - n;
+//****************************************************************************    
+void MAX2871::setRFOUTA(const uint16_t freq)
+{
+    if(m_ref == 0){
+        setRFOUTA((double) freq);
+        return;
+    }
 
-    if(fractional < 0){
-        fractional = 0;
+#ifdef MAX2871_PRESETS
+    for(uint8_t i = 0; i < sizeof(max2871Presets) / sizeof(max2871Presets[0]); i++){
+        MAX2871_Preset p;
+        memcpy_P(&p, &max2871Presets[i], sizeof(p));
+        if(p.freq == freq && p.ref == m_ref && p.rdiv == m_rdiv){
+            setDividers(p.dividers);
+            return;
+        }
     }
+#endif
+
+    setDividers(max2871Solve(freq, m_ref, m_rdiv));
+}
 
-    m = 4000;
-    // frac = rint(m*fractional);
-    frac = myRound(m*fractional);
+//****************************************************************************    
+bool MAX2871::setRFOUTAkHz(const uint32_t freq)
+{
+    MAX2871_Dividers d;
+    if(m_ref == 0 || m_rdiv > 255 || !max2871SolveKHz(freq, m_ref, m_rdiv, d))
+        return false;
+    setDividers(d);
+    return true;
+}
 
-    // Serial.println("Frac: " + String(frac) + " | n: " + String(n) + " | m: " + String(m) + " | diva: " + String(diva));
+//****************************************************************************    
+MAX2871_Dividers MAX2871::getDividers()
+{
+    MAX2871_Dividers d;
+    d.n = reg0.bits.n;
+    d.frac = reg0.bits.frac;
+    d.m = reg1.bits.m;
+    d.diva = reg4.bits.diva;
+    d.fb = reg4.bits.fb;
+    return d;
+}
 
+//****************************************************************************    
+uint32_t MAX2871::getRFOUTAkHz()
+{
+    if(m_ref == 0)
+        return getRFOUTA()*1000;
+    return max2871FrequencyKHz(getDividers(), m_ref, m_rdiv);
+}
+
+//****************************************************************************    
+void MAX2871::setDividers(const MAX2871_Dividers &d)
+{
         // My code (Jarne Van Mulders)
-    if(frac == 0){
+    if(d.frac == 0){
         reg0.bits.intfrac = 1;
-        reg4.bits.fb = 0;
         reg2.bits.ldf = 1;
         reg1.bits.cpl = 0x00;
-
-        n = n / powf(2, diva);
+    }else{
+        // back to the fractional-N defaults of begin()
+        reg0.bits.intfrac = 0;
+        reg2.bits.ldf = 0;
+        reg1.bits.cpl = 0x01;
     }
+    reg4.bits.fb = d.fb;
     
-    reg0.bits.frac = frac;
-    reg0.bits.n = n;
-    reg1.bits.m = m;
-    reg4.bits.diva = diva;
+    reg0.bits.frac = d.frac;
+    reg0.bits.n = d.n;
+    reg1.bits.m = d.m;
+    reg4.bits.diva = d.diva;
 
 #ifdef DEBUG
-    Serial.println("Frac: " + String(frac) + " | n: " + String(n) + " | m: " + String(m) + " | diva: " + String(diva));
+    Serial.println("Frac: " + String(d.frac) + " | n: " + String(d.n) + " | m: " + String(d.m) + " | diva: " + String(d.diva));
 #endif
     reg3.bits.mutedel = 1;
     
-    updateAll();
-    f_rfouta = f_pfd*(reg0.bits.n+1.0*reg0.bits.frac/reg1.bits.m)/powf(2,reg4.bits.diva);
+    update();
 }
 
 void MAX2871::setPFD(const double ref_in,const uint16_t rdiv)
 {
+    // R is 1 - 1023, a zero reference or divider (e.g. from the I2C registers) keeps the last PFD
+    if(ref_in <= 0 || rdiv == 0 || rdiv > 1023)
+        return;
+
     f_pfd = ref_in/rdiv;//*2;
 
+    // whole MHz references take the integer divider solver
+    m_ref = (ref_in == (uint16_t) ref_in) ? (uint16_t) ref_in : 0;
+    m_rdiv = rdiv;
+
     // x2
     //reg2.bits.dbr = 1;
     
@@ -241,23 +473,23 @@ void MAX2871::setPFD(const double ref_in,const uint16_t rdiv)
     // // Value p = 0
     // reg1.bits.p = 2000;
     
-    updateAll();
+    update();
 }
 
 double MAX2871::readADC()
 {   
     reg5.bits.adcm = 0x4;
     reg5.bits.adcs = 1;
-    write(reg5.all);
+    writeRegister(5);
     delayMicroseconds(100);
     
     reg6.all = readRegister6();
     
     reg5.bits.adcm = 0;
     reg5.bits.adcs = 0;
-    write(reg5.all);
+    writeRegister(5);
     
-    if((reg6.bits.vasa == 0) & (reg6.bits.adcv = 1))
+    if((reg6.bits.vasa == 0) & (reg6.bits.adcv == 1))
     {
         double volts = 0.315 + 0.0165*(double)reg6.bits.adc; 
         return volts;
@@ -282,7 +514,7 @@ void MAX2871::powerOn(const bool pwr)
     reg4.bits.sdvco = !pwr;
     reg5.bits.sdpll = !pwr;
         
-    updateAll();
+    update();
 }
 
 double MAX2871::getPFD()
@@ -300,14 +532,14 @@ double MAX2871::readTEMP()
 {   
     reg5.bits.adcm = 0x1;
     reg5.bits.adcs = 1;
-    write(reg5.all);
+    writeRegister(5);
     delayMicroseconds(100);
     
     reg6.all = readRegister6();
     
     reg5.bits.adcm = 0;
     reg5.bits.adcs = 0;
-    write(reg5.all);
+    writeRegister(5);
     
     if(reg6.bits.adcv == 1)
     {
@@ -324,12 +556,12 @@ uint8_t MAX2871::getMode(){
 void MAX2871::disable_output(){
     reg4.bits.rfa_en = 0;
     reg4.bits.rfb_en = 0;
-    updateAll();
+    update();
 }
 
 void MAX2871::enable_output(){
     reg4.bits.rfa_en = 1;
     reg4.bits.rfb_en = 0;
     
-    updateAll(); 
+    update(); 
 }
\ No newline at end of file
@@ -39,6 +39,18 @@
 // #include "mbed.h"
 
 #include <Arduino.h>
+
+#include "MAX2871_solver.h"
+
+// Register write transports, see begin()
+#define MAX2871_SPI_BITBANG      0
+#define MAX2871_SPI_HARDWARE     1
+
+// MAX2871 takes up to 20 MHz, the AVR SPI rounds this down to F_CPU/2
+#define MAX2871_SPI_CLOCK        8000000
+
+// R4 output stage bits (APWR, RFA_EN, BPWR, RFB_EN), not double buffered
+#define MAX2871_REG4_OUTPUT_BITS 0x000001F8
  
  
 /** 
@@ -280,7 +292,14 @@ public:
     ///@param le - Pin used for latch enable
     MAX2871(uint8_t le, uint8_t mosi, uint8_t sclk, uint8_t miso);
 
-    void begin();
+    ///@brief Writes the power-up register defaults.\n
+    ///
+    ///On Entry:
+    ///@param[in] transport - MAX2871_SPI_HARDWARE (mosi/sclk/miso must be the
+    /// SPI peripheral pins) or MAX2871_SPI_BITBANG (shiftOut on any pins)
+    ///
+    ///@returns None
+    void begin(const uint8_t transport = MAX2871_SPI_HARDWARE);
     
     ///@brief MAX2871 Destructor
     // ~MAX2871();
@@ -305,11 +324,45 @@ public:
     ///
     ///@returns None
     void setRFOUTA(const double freq);
+
+    ///@brief Same as setRFOUTA(double) for whole MHz, solved in integer arithmetic
+    /// (see MAX2871_solver.h) when the reference set by setPFD is whole MHz too.\n
+    ///
+    ///On Entry:
+    ///@param[in] freq - Frequency in MHz
+    ///
+    ///@returns None
+    void setRFOUTA(const uint16_t freq);
+
+    ///@brief Sets RFOUTA with kHz resolution (see max2871SolveKHz). Needs a
+    /// whole MHz reference and R <= 255.\n
+    ///
+    ///On Entry:
+    ///@param[in] freq - Frequency in kHz
+    ///
+    ///@returns false if no valid divider setting exists, nothing is changed then
+    bool setRFOUTAkHz(const uint32_t freq);
+
+    ///@brief Actual RFOUTA frequency in kHz, from the divider registers.
+    uint32_t getRFOUTAkHz();
+
+    MAX2871_Dividers getDividers();
+
+    ///@brief Sets precomputed dividers (see MAX2871_solver.h), skipping the
+    /// solver of setRFOUTA.\n
+    ///
+    ///On Entry:
+    ///@param[in] d - dividers, e.g. from max2871SolveKHz
+    ///
+    ///@returns None
+    void setDividers(const MAX2871_Dividers &d);
     
     ///@brief Provide frequency input to REF_IN pin.\n
     ///
     ///On Entry:
     ///@param[in] ref_in - Frequency in MHz
+    ///@param[in] rdiv - R divider, 1 - 1023 (other values, or ref_in <= 0,
+    /// are ignored)
     ///
     ///@returns None
     void setPFD(const double ref_in, const uint16_t rdiv);
@@ -331,8 +384,42 @@ public:
     
     double readTEMP();
     
+    ///@brief Writes R5 to R0, changed or not. Needed at power up.
     void updateAll();
 
+    ///@brief Writes the registers that changed since they were last written,
+    /// R5 down to R1, then R0 if its contents or any double buffered setting
+    /// changed. Called by all setters below.
+    void update();
+
+    ///@brief While held, setters only change the register copies; releasing
+    /// writes everything that changed in one update().
+    void holdUpdates(const bool hold);
+
+    ///@brief With enable set, update() writes nothing that needs R0. It stages
+    /// R0-R5 as they are, and latch() writes the changed ones and R0 from the
+    /// PPS interrupt, so the PLL never runs on a mix of old and new registers.
+    /// A change of the R4 output stage bits alone is still written at once.\n
+    ///
+    ///On Entry:
+    ///@param[in] enable - stage the register set for latch() instead of writing it
+    ///
+    ///@returns None
+    void setLatchOnPPS(const bool enable);
+
+    ///@brief Writes the staged registers that changed, R5 down to R1, and R0,
+    /// if a set is staged. Meant for the PPS interrupt.
+    void latch();
+
+    bool latchPending();
+
+    ///@brief Number of R0 writes (retunes) so far, wraps around. Counted
+    /// before the word goes out, so an LD drop it causes is never a lock loss.
+    uint16_t getLatchCount();
+
+    ///@brief micros() at the last R0 write, to time the lock from.
+    uint32_t getLatchMicros();
+
     uint8_t getMode();
 
     void disable_output();
@@ -345,6 +432,9 @@ private:
     uint8_t m_mosi;
     uint8_t m_sclk;
     uint8_t m_miso;
+    volatile uint8_t *m_lePort;
+    uint8_t m_leMask;
+    uint8_t m_transport;
     
     REG0_u reg0;
     REG1_u reg1;
@@ -356,6 +446,21 @@ private:
     
     double f_pfd;
     double f_rfouta;
+
+    uint16_t m_ref;  // reference in MHz, 0 when not a whole number
+    uint16_t m_rdiv;
+
+    uint32_t m_written[6]; // R0-R5 as last written to the device
+    bool m_hold;
+    bool m_latchOnPPS;
+    volatile bool m_latchPending;
+    uint32_t m_staged[6];  // R0-R5 waiting for latch()
+    volatile uint16_t m_latchCount;
+    volatile uint32_t m_latchMicros;
+
+    uint32_t getRegister(const uint8_t addr);
+    void writeRegister(const uint8_t addr);
+    uint8_t readByte();
 };
  
 #endif /* _MAX2871_H_ */
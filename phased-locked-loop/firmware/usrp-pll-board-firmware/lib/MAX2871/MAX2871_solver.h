@@ -0,0 +1,190 @@
+/*
+ * Divider solver for MAX2871::setRFOUTA.
+ *
+ * On the ATmega328P a double is a 32-bit soft float: the original solver
+ * (powf, division, two roundings) takes milliseconds. With the reference and
+ * the output frequency in whole MHz, as the register bank provides them, the
+ * same N/F/M/DIVA follow from 32-bit integer arithmetic:
+ *
+ *      f_RFOUTA * 2^DIVA = f_PFD * (N + F/M),  f_PFD = REF / R,  M = 4000
+ *
+ * max2871Solve() gives the same dividers as max2871SolveReference() (the
+ * original floating point code), including its quirks: N is rounded to the
+ * nearest integer, so a coefficient with a fractional part >= 0.5 drops to
+ * integer mode, and in integer mode N is divided by 2^DIVA. Exact .5 ties,
+ * which floating point resolves by its rounding error, are handed to the
+ * reference.
+ *
+ * max2871SolveKHz() is the solver for kHz resolution. It rounds F to the
+ * nearest 1/M and only uses integer mode when F is 0. It feeds the divided
+ * output back only when that leaves N in range.
+ *
+ * No Arduino dependencies, so it also builds on the host.
+ */
+
+#ifndef _MAX2871_SOLVER_H_
+#define _MAX2871_SOLVER_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#define MAX2871_MODULUS     4000
+#define MAX2871_VCO_MIN_MHZ 3000
+#define MAX2871_VCO_MIN_KHZ 3000000UL
+
+struct MAX2871_Dividers
+{
+    uint16_t n;
+    uint16_t frac;
+    uint16_t m;
+    uint8_t diva;
+    uint8_t fb;     // 1: VCO fed back, 0: divided output fed back (N excludes DIVA)
+};
+
+///@brief The original floating point solver of setRFOUTA, kept as reference
+/// for non-integer inputs and for the host comparison. Real is double on the
+/// host; on the AVR double is float anyway.
+template <typename Real>
+MAX2871_Dividers max2871SolveReference(const Real freq, const Real f_pfd)
+{
+    MAX2871_Dividers d;
+    uint32_t n, frac, diva = 0;
+    Real pll_coefficient, fractional = 0;
+
+    while (freq * powf(2, diva) < 3000.0)
+    {
+        diva = diva + 1;
+    }
+    pll_coefficient = freq * powf(2, diva) / f_pfd;
+
+    n = floor(round(pll_coefficient));
+
+    fractional = pll_coefficient - n;
+
+    if (fractional < 0)
+    {
+        fractional = 0;
+    }
+
+    Real mf = MAX2871_MODULUS * fractional;
+    frac = (mf < 0.0) ? ceil(mf - 0.5) : floor(mf + 0.5);
+
+    if (frac == 0)
+    {
+        n = n / powf(2, diva);
+    }
+
+    d.n = n;
+    d.frac = frac;
+    d.m = MAX2871_MODULUS;
+    d.diva = diva;
+    d.fb = (frac == 0) ? 0 : 1;
+    return d;
+}
+
+///@brief Integer divider solver.
+///
+///@param[in] freq - RFOUTA frequency in MHz (>= 24)
+///@param[in] ref - reference frequency in MHz
+///@param[in] rdiv - reference divider R
+inline MAX2871_Dividers max2871Solve(const uint16_t freq, const uint16_t ref, const uint16_t rdiv)
+{
+    MAX2871_Dividers d;
+    d.m = MAX2871_MODULUS;
+    d.diva = 0;
+
+    // smallest DIVA that puts the VCO at or above 3 GHz
+    uint32_t vco = freq;
+    while (vco < MAX2871_VCO_MIN_MHZ && d.diva < 7)
+    {
+        vco <<= 1;
+        d.diva++;
+    }
+
+    // N + F/M = vco * R / REF, N rounded half up
+    uint32_t num = vco * rdiv;
+    uint32_t n = (2 * num + ref) / (2UL * ref);
+    uint32_t frac = 0;
+    if (n * ref < num)
+    {
+        uint32_t rem = num - n * ref;
+        frac = (2UL * MAX2871_MODULUS * rem + ref) / (2UL * ref);
+
+        // exact .5 ties: floating point rounds them either way, depending on
+        // how REF / R was rounded, so let the reference decide (rare)
+        if ((2UL * MAX2871_MODULUS * rem) % ref == 0 && ((2UL * MAX2871_MODULUS * rem) / ref) % 2 == 1)
+            return max2871SolveReference<double>(freq, (double)ref / rdiv);
+    }
+    else if ((2 * num) % ref == 0 && ((2 * num) / ref) % 2 == 1)
+    {
+        return max2871SolveReference<double>(freq, (double)ref / rdiv);
+    }
+
+    if (frac == 0)
+        n >>= d.diva;
+
+    d.n = n;
+    d.frac = frac;
+    d.fb = (frac == 0) ? 0 : 1;
+    return d;
+}
+
+///@brief Divider solver with kHz resolution, F rounded to the nearest 1/M.
+///
+///@param[in] freq - RFOUTA frequency in kHz
+///@param[in] ref - reference frequency in MHz
+///@param[in] rdiv - reference divider R
+///@param[out] d - dividers
+///
+///@returns false when N falls outside the range of the mode (d untouched)
+inline bool max2871SolveKHz(const uint32_t freq, const uint16_t ref, const uint8_t rdiv, MAX2871_Dividers &d)
+{
+    uint8_t diva = 0;
+    uint32_t vco = freq;
+    while (vco < MAX2871_VCO_MIN_KHZ && diva < 7)
+    {
+        vco <<= 1;
+        diva++;
+    }
+
+    // N + F/M = vco * R / (REF * 1000), with M = 4000: F = 4 * rem / REF
+    uint32_t num = vco * rdiv;
+    uint32_t den = ref * 1000UL;
+    uint32_t n = num / den;
+    uint32_t frac = (8UL * (num % den) + ref) / (2UL * ref);
+    if (frac == MAX2871_MODULUS)
+    {
+        n++;
+        frac = 0;
+    }
+
+    uint8_t fb = 1;
+    if (frac == 0 && (n & ((1UL << diva) - 1)) == 0 && (n >> diva) >= 16)
+    {
+        // divided output in the loop, as setRFOUTA(MHz) does in integer mode;
+        // below N = 16 (e.g. 100 MHz from 10 MHz) the VCO stays in the loop
+        n >>= diva;
+        fb = 0;
+    }
+
+    if (frac == 0 ? (n < 16 || n > 65535) : (n < 19 || n > 4091))
+        return false;
+
+    d.n = n;
+    d.frac = frac;
+    d.m = MAX2871_MODULUS;
+    d.diva = diva;
+    d.fb = fb;
+    return true;
+}
+
+///@brief RFOUTA frequency in kHz (rounded) that the dividers produce.
+inline uint32_t max2871FrequencyKHz(const MAX2871_Dividers &d, const uint16_t ref, const uint16_t rdiv)
+{
+    // f = REF / R * (N + F/M) / 2^DIVA, without the 2^DIVA when the divided output is fed back
+    uint64_t num = (uint64_t)ref * 1000 * ((uint64_t)d.n * d.m + d.frac);
+    uint64_t den = (uint64_t)d.m * rdiv << (d.fb ? d.diva : 0);
+    return (num + den / 2) / den;
+}
+
+#endif /* _MAX2871_SOLVER_H_ */
@@ -0,0 +1,169 @@
+/*
+ * Write-behind, wear-levelled storage of the register map in EEPROM, see
+ * SettingsStore.h.
+ */
+
+#include "SettingsStore.h"
+#include <EEPROM.h>
+
+// Offsets in a slot
+#define SLOT_MAGIC      0
+#define SLOT_SEQUENCE   1
+#define SLOT_LENGTH     2
+#define SLOT_DATA       3
+
+//****************************************************************************
+SettingsStore::SettingsStore()
+{
+    // without records the first one goes to slot 1: slot 0 holds the layout of older firmware
+    m_slot = 0;
+    m_sequence = 0xFF;
+    m_dirty = false;
+    m_commit = false;
+    m_firstChange = 0;
+    m_lastChange = 0;
+    m_length = 0;
+    m_index = 0;
+    m_writing = false;
+    m_records = 0;
+}
+
+//****************************************************************************
+uint8_t SettingsStore::crc8(uint8_t crc, const uint8_t data)
+{
+    crc ^= data;
+    for(uint8_t i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    return crc;
+}
+
+//****************************************************************************
+uint16_t SettingsStore::slotAddress(const uint8_t slot)
+{
+    return (uint16_t)slot * SETTINGS_STORE_SLOT_SIZE;
+}
+
+//****************************************************************************
+uint8_t SettingsStore::begin(uint8_t data[], const uint8_t size)
+{
+    bool found = false;
+    for(uint8_t slot = 0; slot < SETTINGS_STORE_SLOTS; slot++){
+        uint16_t address = slotAddress(slot);
+        uint8_t sequence = EEPROM.read(address + SLOT_SEQUENCE);
+        uint8_t length = EEPROM.read(address + SLOT_LENGTH);
+        if(EEPROM.read(address + SLOT_MAGIC) != SETTINGS_STORE_MAGIC || length > SETTINGS_STORE_MAX_LENGTH)
+            continue;
+
+        uint8_t crc = crc8(crc8(0, sequence), length);
+        for(uint8_t i = 0; i < length; i++)
+            crc = crc8(crc, EEPROM.read(address + SLOT_DATA + i));
+        if(crc != EEPROM.read(address + SLOT_DATA + length))
+            continue;
+
+        // newest by sequence number, which wraps
+        if(!found || (int8_t)(sequence - m_sequence) > 0){
+            m_slot = slot;
+            m_sequence = sequence;
+            found = true;
+        }
+    }
+    if(!found)
+        return 0;
+
+    uint16_t address = slotAddress(m_slot);
+    uint8_t length = EEPROM.read(address + SLOT_LENGTH);
+    for(uint8_t i = 0; i < length && i < size; i++)
+        data[i] = EEPROM.read(address + SLOT_DATA + i);
+    return length;
+}
+
+//****************************************************************************
+void SettingsStore::changed()
+{
+    uint32_t now = millis();
+    if(!m_dirty)
+        m_firstChange = now;
+    m_lastChange = now;
+    m_dirty = true;
+}
+
+//****************************************************************************
+void SettingsStore::commit()
+{
+    m_commit = true;
+}
+
+//****************************************************************************
+void SettingsStore::poll(const uint8_t data[], const uint8_t length)
+{
+    // Reads and writes wait for a write in progress, so only touch a ready EEPROM
+    if(!eeprom_is_ready())
+        return;
+
+    if(!m_writing){
+        if(!m_dirty && !m_commit)
+            return;
+        uint32_t now = millis();
+        if(!m_commit && now - m_lastChange < SETTINGS_STORE_QUIET_MS && now - m_firstChange < SETTINGS_STORE_MAX_AGE_MS)
+            return;
+        m_dirty = false;
+        m_commit = false;
+
+        uint8_t n = (length > SETTINGS_STORE_MAX_LENGTH) ? SETTINGS_STORE_MAX_LENGTH : length;
+        uint8_t sequence = m_sequence + 1;
+        m_record[SLOT_MAGIC] = SETTINGS_STORE_MAGIC;
+        m_record[SLOT_SEQUENCE] = sequence;
+        m_record[SLOT_LENGTH] = n;
+        uint8_t crc = crc8(crc8(0, sequence), n);
+        for(uint8_t i = 0; i < n; i++){
+            m_record[SLOT_DATA + i] = data[i];
+            crc = crc8(crc, data[i]);
+        }
+        m_record[SLOT_DATA + n] = crc;
+        m_length = SLOT_DATA + n + 1;
+
+        // Nothing to do when the newest record holds the same data
+        uint16_t address = slotAddress(m_slot);
+        bool same = EEPROM.read(address + SLOT_MAGIC) == SETTINGS_STORE_MAGIC;
+        for(uint8_t i = SLOT_LENGTH; i < m_length && same; i++)
+            same = EEPROM.read(address + i) == m_record[i];
+        if(same)
+            return;
+
+        m_index = 0;
+        m_writing = true;
+        return;
+    }
+
+    // Into the next slot: its magic cleared first and set last, so a record
+    // cut short by a reset is never taken for a valid one
+    uint8_t slot = (m_slot + 1) % SETTINGS_STORE_SLOTS;
+    uint16_t address = slotAddress(slot);
+    if(m_index == 0)
+        EEPROM.update(address + SLOT_MAGIC, 0x00);
+    else if(m_index < m_length)
+        EEPROM.update(address + m_index, m_record[m_index]);
+    else
+        EEPROM.update(address + SLOT_MAGIC, SETTINGS_STORE_MAGIC);
+
+    if(++m_index > m_length){
+        m_writing = false;
+        m_slot = slot;
+        m_sequence = m_record[SLOT_SEQUENCE];
+        m_records++;
+    }
+}
+
+//****************************************************************************
+uint8_t SettingsStore::status()
+{
+    if(m_writing)
+        return SETTINGS_STORE_WRITING;
+    return (m_dirty || m_commit) ? SETTINGS_STORE_PENDING : SETTINGS_STORE_CLEAN;
+}
+
+//****************************************************************************
+uint16_t SettingsStore::records()
+{
+    return m_records;
+}
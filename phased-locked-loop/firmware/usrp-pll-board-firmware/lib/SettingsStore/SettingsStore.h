@@ -0,0 +1,98 @@
+/*
+ * Write-behind, wear-levelled storage of the register map in EEPROM.
+ *
+ * An EEPROM byte takes 3.3 ms to write and wears out after ~100k writes.
+ * Writing the map synchronously on every change stalls loop() for the whole
+ * record and wears the same cells. Here a change only marks the store dirty.
+ * The record is written once the changes stop for SETTINGS_STORE_QUIET_MS,
+ * at the latest SETTINGS_STORE_MAX_AGE_MS after the first one, or at once
+ * after commit(). It is written one byte per poll(), and only when the
+ * EEPROM is ready, so poll() never waits on the EEPROM.
+ *
+ * Records rotate over SETTINGS_STORE_SLOTS slots of SETTINGS_STORE_SLOT_SIZE
+ * bytes, so each cell sees 1/SLOTS of the writes:
+ *
+ *      [magic][sequence][length][data ... ][CRC8 of sequence, length, data]
+ *
+ * begin() restores the valid slot with the newest sequence number. A record
+ * cut short by a reset fails its CRC, so the previous one is used.
+ */
+
+#ifndef _SETTINGS_STORE_H_
+#define _SETTINGS_STORE_H_
+
+#include <Arduino.h>
+
+#define SETTINGS_STORE_SLOT_SIZE    64
+#define SETTINGS_STORE_SLOTS        16      // 1 KB on the ATmega328P
+#define SETTINGS_STORE_MAX_LENGTH   (SETTINGS_STORE_SLOT_SIZE - 4)
+#define SETTINGS_STORE_MAGIC        0xA7
+
+#define SETTINGS_STORE_QUIET_MS     2000
+#define SETTINGS_STORE_MAX_AGE_MS   60000
+
+#define SETTINGS_STORE_CLEAN        0
+#define SETTINGS_STORE_PENDING      1       // changed, waiting for the quiet time
+#define SETTINGS_STORE_WRITING      2
+
+class SettingsStore
+{
+public:
+
+    SettingsStore();
+
+    ///@brief Finds the newest valid record.\n
+    ///
+    ///On Entry:
+    ///@param[out] data - receives the record
+    ///@param[in] size - size of data
+    ///
+    ///@returns the length of the record, 0 when there is none
+    uint8_t begin(uint8_t data[], const uint8_t size);
+
+    ///@brief Marks the data as changed. Call it on every change, it restarts
+    /// the quiet time.
+    void changed();
+
+    ///@brief Starts writing the changes on the next poll(), without waiting
+    /// for the quiet time.
+    void commit();
+
+    ///@brief Call from loop(): takes a copy of data when a write is due and
+    /// writes at most one byte of it, when the EEPROM is ready.\n
+    ///
+    ///On Entry:
+    ///@param[in] data - data to store
+    ///@param[in] length - bytes of data to store, at most SETTINGS_STORE_MAX_LENGTH
+    void poll(const uint8_t data[], const uint8_t length);
+
+    ///@brief SETTINGS_STORE_CLEAN, _PENDING or _WRITING
+    uint8_t status();
+
+    ///@brief Records written since begin()
+    uint16_t records();
+
+    ///@brief Dallas/Maxim CRC8 (polynomial 0x31)
+    static uint8_t crc8(uint8_t crc, const uint8_t data);
+
+private:
+
+    uint16_t slotAddress(const uint8_t slot);
+
+    uint8_t m_slot;             // slot of the newest record
+    uint8_t m_sequence;         // its sequence number
+    bool m_dirty;
+    bool m_commit;
+    uint32_t m_firstChange;
+    uint32_t m_lastChange;
+
+    // record being written, m_index bytes of it done
+    uint8_t m_record[SETTINGS_STORE_SLOT_SIZE];
+    uint8_t m_length;
+    uint8_t m_index;
+    bool m_writing;
+
+    uint16_t m_records;
+};
+
+#endif /* _SETTINGS_STORE_H_ */
@@ -133,6 +133,12 @@ uint8_t CTWI::GetQueueVacancy(void)
     return m_queue.Vacancy();
 }
 
+uint8_t CTWI::GetQueueDropped(void)
+{
+    // Return number of packets refused on a full queue
+    return m_queue.Dropped();
+}
+
 CTWI::status_t CTWI::MasterQueueNonBlocking(CTWI::Packet& packet, const CTWI::Register* const register_address)
 {
     // A locked state occurs if the queue is full and interrupts are disabled.
@@ -201,7 +207,18 @@ CTWI::status_t CTWI::MasterQueueNonBlocking(CTWI::Packet& packet, const CTWI::Re
     uint8_t sreg = SREG; // Save register
     cli();
     bool is_empty = m_queue.IsEmpty(); // Save status
-    m_queue.Push(packet); // Copy packet to queue
+    
+    // Copy packet to queue
+    if (!m_queue.Push(packet))
+    {
+        if (packet.mode == Mode::WRITE)
+        {
+            delete[] packet.data; // Message copy is not going anywhere
+        }
+        
+        SREG = sreg; // Restore register
+        return STATUS_BUSY;
+    }
     
     // Kick-start transmit if single packet in queue
     if (is_empty)
@@ -244,9 +261,6 @@ CTWI::status_t CTWI::SlaveQueueNonBlocking(const uint8_t data[], const uint8_t l
     
     //memcpy_fast(&m_slave_buffer[m_buffer_length], data, length);
     memcpy(&m_slave_buffer[m_buffer_length], data, length);
-    Serial.print(m_slave_buffer[m_buffer_length]);
-    Serial.print(m_slave_buffer[m_buffer_length+1]);
-    Serial.print(m_slave_buffer[m_buffer_length+2]);
     m_buffer_length += length;
     SREG = sreg; // Restore register
     
@@ -49,7 +49,7 @@ class CTWI
     
     enum size_t : uint8_t
     {
-        SIZE_BUFFER = 36,
+        SIZE_BUFFER = 64,
         SIZE_QUEUE = 4,
     };
     
@@ -170,7 +170,7 @@ class CTWI
 #ifdef CTWI_USING_BLOCKING_ACCESS
     uint8_t m_tx_buffer[SIZE_BUFFER + 1];  // Master/Slave data buffer
 #else
-    CQueue<Packet> m_queue{SIZE_QUEUE}; // Queue of packets
+    CRing<Packet, SIZE_QUEUE> m_queue;  // Queue of packets
 #endif
 
 #ifdef CTWI_ENABLE_SLAVE_MODE
@@ -187,6 +187,7 @@ class CTWI
     CTWI(void);
     // Get the number of vacant elements in the queue
     uint8_t GetQueueVacancy(void);
+    uint8_t GetQueueDropped(void);
     // Set the I2C transaction bitrate
     void SetSpeed(const Speed speed);
     // Set the timeout interval to wait for operation to complete
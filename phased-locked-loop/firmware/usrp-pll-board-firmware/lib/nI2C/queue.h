@@ -19,8 +19,8 @@
  * IN THE SOFTWARE.
  *
  * @file        queue.h
- * @summary     Dynamically allocated circular buffer queue implementation
- * @version     1.1
+ * @summary     Fixed capacity single-producer/single-consumer ring buffer
+ * @version     2.0
  * @author      nitacku
  * @data        15 July 2018
  */
@@ -29,6 +29,7 @@
 #define QUEUE_H_
 
 #include <inttypes.h>
+#include <string.h>
 
 #if defined(__AVR__)
 extern "C" {
@@ -38,16 +39,24 @@ void* memcpy_fast(void* dst, const void* src, uint16_t num) __attribute__ ((noin
 #define memcpy_fast memcpy
 #endif
 
+// Keeps the compiler from moving the element copy past the index update
+#define CRING_BARRIER() asm volatile("" ::: "memory")
 
-template <class T>
-class CQueue
+
+// One side pushes, the other pops (main loop and TWI ISR). Head and tail are
+// free-running 8-bit counters, each written by one side only, so every access
+// is a single atomic byte load or store on the AVR and no interrupts need to
+// be disabled. The capacity is a power of two, positions are masked.
+template <class T, uint8_t N>
+class CRing
 {
+    static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "CRing capacity must be a power of two <= 128");
+
     public:
     
-    CQueue(const uint8_t elements);
-    ~CQueue(void);
+    CRing(void);
     
-    void Push(const T& element);
+    bool Push(const T& element);
     void Pop(void);
     T* Front(void);
     void Clear(void);
@@ -55,138 +64,114 @@ class CQueue
     uint8_t Vacancy(void);
     bool IsFull(void);
     bool IsEmpty(void);
+    uint8_t Dropped(void);
     
     private:
     
-    uint8_t m_capacity;
-    volatile uint8_t m_head;
-    volatile uint8_t m_tail;
-    volatile uint8_t m_size;
-    T* m_array;
-
-    void Destroy(void);
-    uint8_t Next(const uint8_t position);
+    static const uint8_t MASK = N - 1;
+    
+    volatile uint8_t m_head;    // Written by the consumer only
+    volatile uint8_t m_tail;    // Written by the producer only
+    volatile uint8_t m_dropped; // Pushes refused while full, saturates at 255
+    T m_array[N];
 };
 
 // Constructor
-template <class T>
-CQueue<T>::CQueue(const uint8_t elements)
+template <class T, uint8_t N>
+CRing<T, N>::CRing(void)
 {
-    // Allocate memory for array
-    if (elements > 0)
-    {
-        m_array = new T[elements];
-    }
-
-    m_capacity = elements;
+    m_dropped = 0;
     Clear();
 }
 
-// Destructor
-template <class T>
-CQueue<T>::~CQueue(void)
-{
-    Destroy();
-}
-
-
-template <class T>
-uint8_t CQueue<T>::Next(const uint8_t position)
-{
-    if ((position + 1) >= m_capacity)
-    {
-        return 0;
-    }
-
-    return position + 1;
-}
-
 
-template <class T>
-void CQueue<T>::Push(const T& element)
+template <class T, uint8_t N>
+bool CRing<T, N>::Push(const T& element)
 {
-    if (m_array != nullptr) // Ensure array has been initialized
+    uint8_t tail = m_tail;
+    
+    if ((uint8_t)(tail - m_head) >= N)
     {
-        if (IsFull())
+        if (m_dropped < 0xFF)
         {
-            return; // Do nothing
-            //Pop(); // CQueue is full. Remove head entry
+            m_dropped++;
         }
-
-        // Copy element into queue
-        memcpy_fast(&m_array[m_tail], &element, sizeof(T));
-
-        m_size++;
-        m_tail = Next(m_tail);
+        
+        return false; // Caller decides what to do with the element
     }
+    
+    // Copy element into queue, then publish it
+    memcpy_fast(&m_array[tail & MASK], &element, sizeof(T));
+    CRING_BARRIER();
+    m_tail = tail + 1;
+    
+    return true;
 }
 
 
-template <class T>
-void CQueue<T>::Pop(void)
+template <class T, uint8_t N>
+void CRing<T, N>::Pop(void)
 {
-    if (m_size > 0)
+    uint8_t head = m_head;
+    
+    if (head != m_tail)
     {
-        m_size--;
-        m_head = Next(m_head);
+        CRING_BARRIER();
+        m_head = head + 1;
     }
 }
 
 
-template <class T>
-T* CQueue<T>::Front(void)
+template <class T, uint8_t N>
+T* CRing<T, N>::Front(void)
 {
-    return ((m_size > 0) ? &m_array[m_head] : nullptr);
+    uint8_t head = m_head;
+    
+    return ((head != m_tail) ? &m_array[head & MASK] : nullptr);
 }
 
 
-template <class T>
-void CQueue<T>::Clear(void)
+// Only when neither side is active
+template <class T, uint8_t N>
+void CRing<T, N>::Clear(void)
 {
-    m_size = 0;
     m_head = 0;
     m_tail = 0;
 }
 
 
-template <class T>
-uint8_t CQueue<T>::Size(void)
+template <class T, uint8_t N>
+uint8_t CRing<T, N>::Size(void)
 {
-    return m_size;
+    return m_tail - m_head;
 }
 
 
-template <class T>
-uint8_t CQueue<T>::Vacancy(void)
+template <class T, uint8_t N>
+uint8_t CRing<T, N>::Vacancy(void)
 {
-    return m_capacity - m_size;
+    return N - Size();
 }
 
 
-template <class T>
-bool CQueue<T>::IsFull(void)
+template <class T, uint8_t N>
+bool CRing<T, N>::IsFull(void)
 {
-    return (m_size >= m_capacity);
+    return (Size() >= N);
 }
 
 
-template <class T>
-bool CQueue<T>::IsEmpty(void)
+template <class T, uint8_t N>
+bool CRing<T, N>::IsEmpty(void)
 {
-    return (m_size == 0);
+    return (m_head == m_tail);
 }
 
 
-template <class T>
-void CQueue<T>::Destroy(void)
+template <class T, uint8_t N>
+uint8_t CRing<T, N>::Dropped(void)
 {
-    if (m_array != nullptr)
-    {
-        delete[] m_array;
-    }
-
-    m_array = nullptr; // Pointer now invalid
-    m_size = 0;
+    return m_dropped;
 }
 
 #endif
@@ -0,0 +1,111 @@
+/*
+ * Arduino core for the native (host) build, see sim.h.
+ *
+ * Only what src/main.cpp and lib/MAX2871 use. Pins are plain variables,
+ * millis()/micros() run on the simulated clock and interrupts are called
+ * directly by the simulator.
+ */
+
+#ifndef _ARDUINO_SIM_H_
+#define _ARDUINO_SIM_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH        1
+#define LOW         0
+#define INPUT       0
+#define OUTPUT      1
+#define CHANGE      1
+#define FALLING     2
+#define RISING      3
+#define LSBFIRST    0
+#define MSBFIRST    1
+#define HEX         16
+#define DEC         10
+
+#define PROGMEM
+#define memcpy_P                memcpy
+#define pgm_read_byte(p)        (*(const uint8_t *)(p))
+#define pgm_read_word(p)        (*(const uint16_t *)(p))
+
+#define bit(b)                  (1UL << (b))
+
+#define NUM_PINS                20
+
+namespace sim
+{
+    extern uint8_t pins[NUM_PINS];
+    extern uint32_t clock_us;
+    extern volatile uint8_t sreg;
+    extern volatile uint8_t ports[3];
+    extern volatile uint8_t pcmsk[3];
+    extern volatile uint8_t pcicr;
+    extern void (*external_interrupts[2])(void);
+    extern uint32_t shifted_bytes;  // bit-banged SPI bytes, not decoded
+    extern bool verbose;
+}
+
+// -------- time -----------
+inline unsigned long millis(void) { return sim::clock_us / 1000; }
+inline unsigned long micros(void) { return sim::clock_us; }
+inline void delay(unsigned long ms) { sim::clock_us += ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { sim::clock_us += us; }
+
+// -------- pins -----------
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) { sim::pins[pin % NUM_PINS] = value ? HIGH : LOW; }
+inline int digitalRead(uint8_t pin) { return sim::pins[pin % NUM_PINS]; }
+
+// ATmega328P: pins 0-7 PORTD, 8-13 PORTB, 14-19 PORTC
+#define digitalPinToPort(p)         ((p) < 8 ? 0 : (p) < 14 ? 1 : 2)
+#define digitalPinToBitMask(p)      (1 << ((p) < 8 ? (p) : (p) < 14 ? (p) - 8 : (p) - 14))
+#define portOutputRegister(port)    (&sim::ports[port])
+#define digitalPinToPCMSK(p)        (&sim::pcmsk[digitalPinToPort(p)])
+#define digitalPinToPCMSKbit(p)     ((p) < 8 ? (p) : (p) < 14 ? (p) - 8 : (p) - 14)
+#define digitalPinToPCICR(p)        (&sim::pcicr)
+#define digitalPinToPCICRbit(p)     (digitalPinToPort(p) == 1 ? 0 : digitalPinToPort(p) == 2 ? 1 : 2)
+
+inline void shiftOut(uint8_t, uint8_t, uint8_t, uint8_t value) { (void)value; sim::shifted_bytes++; }
+inline uint8_t shiftIn(uint8_t, uint8_t, uint8_t) { return 0; }
+
+// -------- interrupts -----------
+#define SREG                        sim::sreg
+#define ISR(vector)                 void vector(void)
+inline void noInterrupts(void) {}
+inline void interrupts(void) {}
+inline int digitalPinToInterrupt(uint8_t pin) { return pin == 2 ? 0 : pin == 3 ? 1 : -1; }
+inline void attachInterrupt(int interrupt, void (*isr)(void), int)
+{
+    if(interrupt == 0 || interrupt == 1)
+        sim::external_interrupts[interrupt] = isr;
+}
+
+// Pin change interrupt of PORTB, defined by the firmware with ISR()
+void PCINT0_vect(void);
+
+// -------- serial -----------
+class SimSerial
+{
+public:
+    void begin(unsigned long) {}
+    void print(const char *s) { if(sim::verbose) fputs(s, stdout); }
+    void print(char c) { if(sim::verbose) putchar(c); }
+    void print(long v, int base = DEC) { if(sim::verbose) printf(base == HEX ? "%lX" : "%ld", v); }
+    void print(int v, int base = DEC) { print((long)v, base); }
+    void print(unsigned int v, int base = DEC) { print((long)v, base); }
+    void print(unsigned long v, int base = DEC) { print((long)v, base); }
+    void print(double v) { if(sim::verbose) printf("%.2f", v); }
+    template <typename T> void println(T v) { print(v); print('\n'); }
+    void println(void) { print('\n'); }
+};
+
+extern SimSerial Serial;
+
+#endif /* _ARDUINO_SIM_H_ */
@@ -0,0 +1,66 @@
+/*
+ * EEPROM for the native (host) build: 1 KB like the ATmega328P, erased to
+ * 0xFF, with a count of the cell writes. A write takes 3.3 ms of simulated
+ * time in the background; an access before it is done waits for it, as
+ * eeprom_read_byte()/eeprom_write_byte() do.
+ */
+
+#ifndef _EEPROM_SIM_H_
+#define _EEPROM_SIM_H_
+
+#include <Arduino.h>
+
+#define EEPROM_SIM_SIZE         1024
+#define EEPROM_SIM_WRITE_US     3300
+
+#define eeprom_is_ready()       ((int32_t)(sim::clock_us - EEPROM.readyTime()) >= 0)
+
+class EEPROMClass
+{
+public:
+    EEPROMClass() { erase(); }
+
+    uint8_t read(int address)
+    {
+        wait();
+        return m_data[address % EEPROM_SIM_SIZE];
+    }
+    void write(int address, uint8_t value)
+    {
+        wait();
+        m_data[address % EEPROM_SIM_SIZE] = value;
+        m_writes++;
+        m_ready = sim::clock_us + EEPROM_SIM_WRITE_US;
+    }
+    void update(int address, uint8_t value)
+    {
+        if(read(address) != value)
+            write(address, value);
+    }
+    uint16_t length(void) const { return EEPROM_SIM_SIZE; }
+
+    void erase(void) { memset(m_data, 0xFF, sizeof(m_data)); }
+    uint32_t writes(void) const { return m_writes; }
+    uint32_t readyTime(void) const { return m_ready; }
+
+    // simulated time spent waiting for a write to finish
+    uint32_t waited(void) const { return m_waited; }
+
+private:
+    void wait(void)
+    {
+        if((int32_t)(m_ready - sim::clock_us) > 0){
+            m_waited += m_ready - sim::clock_us;
+            sim::clock_us = m_ready;
+        }
+    }
+
+    uint8_t m_data[EEPROM_SIM_SIZE];
+    uint32_t m_writes = 0;
+    uint32_t m_ready = 0;
+    uint32_t m_waited = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* _EEPROM_SIM_H_ */
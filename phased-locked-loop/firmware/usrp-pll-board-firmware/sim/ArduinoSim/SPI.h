@@ -0,0 +1,44 @@
+/*
+ * SPI for the native (host) build: MODE0 transactions of 4 bytes are the
+ * MAX2871 register writes and are captured as 32-bit words, see sim.h.
+ */
+
+#ifndef _SPI_SIM_H_
+#define _SPI_SIM_H_
+
+#include <Arduino.h>
+
+#define SPI_MODE0   0x00
+#define SPI_MODE1   0x04
+#define SPI_MODE2   0x08
+#define SPI_MODE3   0x0C
+
+class SPISettings
+{
+public:
+    SPISettings(uint32_t clock = 4000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+        : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+class SPIClass
+{
+public:
+    void begin(void) {}
+    void end(void) {}
+    void beginTransaction(SPISettings settings);
+    void endTransaction(void);
+    uint8_t transfer(uint8_t data);
+
+private:
+    SPISettings m_settings;
+    uint8_t m_count = 0;
+    uint32_t m_word = 0;
+};
+
+extern SPIClass SPI;
+
+#endif /* _SPI_SIM_H_ */
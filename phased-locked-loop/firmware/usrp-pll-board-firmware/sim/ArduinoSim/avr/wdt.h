@@ -0,0 +1,10 @@
+/*
+ * Watchdog for the native (host) build.
+ */
+
+#ifndef _WDT_SIM_H_
+#define _WDT_SIM_H_
+
+inline void wdt_reset(void) {}
+
+#endif /* _WDT_SIM_H_ */
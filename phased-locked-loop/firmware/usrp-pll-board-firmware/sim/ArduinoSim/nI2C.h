@@ -0,0 +1,73 @@
+/*
+ * Slave side of nI2C (CTWI) for the native (host) build. The simulated
+ * master in sim.h calls the handlers the way the TWI interrupt does:
+ * the receive handler on STOP or repeated START with up to SIZE_BUFFER
+ * bytes, the transmit handler on SLA+R. A master reading past the queued
+ * bytes gets the first byte again, as on the AVR.
+ */
+
+#ifndef _I2C_SIM_H_
+#define _I2C_SIM_H_
+
+#include <Arduino.h>
+
+class CTWI
+{
+public:
+    enum size_t : uint8_t
+    {
+        SIZE_BUFFER = 64,   // as lib/nI2C/nTWI.h
+    };
+
+    enum status_t : uint8_t
+    {
+        STATUS_OK = 0,
+        STATUS_BUSY,
+        STATUS_TIMEOUT,
+        STATUS_ERROR_BUFFER_OVERFLOW,
+    };
+
+    void SetLocalDeviceAddress(const uint8_t address) { m_address = address; }
+    uint8_t GetLocalDeviceAddress(void) const { return m_address; }
+
+    void SetSlaveReceiveHandler(void (*callback)(const uint8_t data[], const uint8_t length)) { m_rx = callback; }
+    void SetSlaveTransmitHandler(void (*callback)(void)) { m_tx = callback; }
+
+    status_t SlaveQueueNonBlocking(const uint8_t data[], const uint8_t length)
+    {
+        if(length + m_length > SIZE_BUFFER)
+            return STATUS_ERROR_BUFFER_OVERFLOW;
+        memcpy(&m_buffer[m_length], data, length);
+        m_length += length;
+        return STATUS_OK;
+    }
+
+    // Simulated master, see sim::i2cWrite()/sim::i2cRead()
+    void SimReceive(const uint8_t data[], uint8_t length)
+    {
+        if(length > SIZE_BUFFER)
+            length = SIZE_BUFFER;   // the rest is NACKed
+        memcpy(m_buffer, data, length);
+        if(m_rx != nullptr)
+            m_rx(m_buffer, length);
+    }
+
+    uint8_t SimTransmit(uint8_t data[], const uint8_t length)
+    {
+        m_length = 0;
+        if(m_tx != nullptr)
+            m_tx();
+        for(uint8_t i = 0; i < length; i++)
+            data[i] = (i < m_length) ? m_buffer[i] : m_buffer[0];
+        return m_length;
+    }
+
+private:
+    uint8_t m_address = 0;
+    void (*m_rx)(const uint8_t data[], const uint8_t length) = nullptr;
+    void (*m_tx)(void) = nullptr;
+    uint8_t m_buffer[SIZE_BUFFER];
+    uint8_t m_length = 0;
+};
+
+#endif /* _I2C_SIM_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Native (host) simulation of the PLL board, see sim.h.
+ */
+
+#include "sim.h"
+#include <SPI.h>
+#include <EEPROM.h>
+#include <nI2C.h>
+
+// The firmware, src/main.cpp
+extern CTWI i2c;
+void setup(void);
+void loop(void);
+
+#define PIN_LD      8
+#define PIN_PPS     2
+#define PIN_TRIGGER 3
+
+namespace sim
+{
+    uint8_t pins[NUM_PINS];
+    uint32_t clock_us = 0;
+    volatile uint8_t sreg = 0;
+    volatile uint8_t ports[3];
+    volatile uint8_t pcmsk[3];
+    volatile uint8_t pcicr = 0;
+    void (*external_interrupts[2])(void);
+    uint32_t shifted_bytes = 0;
+    bool verbose = false;
+
+    std::vector<SpiWord> spiWords;
+
+    void begin(void)
+    {
+        setup();
+    }
+
+    void step(uint32_t us)
+    {
+        loop();
+        clock_us += us;
+    }
+
+    void run(uint32_t ms)
+    {
+        uint32_t end = clock_us + ms * 1000;
+        while((int32_t)(end - clock_us) > 0)
+            step();
+    }
+
+    void i2cWrite(const uint8_t reg, const uint8_t data[], const uint8_t length)
+    {
+        uint8_t buffer[256];
+        buffer[0] = reg;
+        memcpy(&buffer[1], data, length);
+        i2c.SimReceive(buffer, length + 1);
+    }
+
+    uint8_t i2cRead(const uint8_t reg, uint8_t data[], const uint8_t length)
+    {
+        i2c.SimReceive(&reg, 1);
+        return i2c.SimTransmit(data, length);
+    }
+
+    void pps(void)
+    {
+        pins[PIN_PPS] = HIGH;
+        if(external_interrupts[digitalPinToInterrupt(PIN_PPS)] != nullptr)
+            external_interrupts[digitalPinToInterrupt(PIN_PPS)]();
+        pins[PIN_PPS] = LOW;
+    }
+
+    void trigger(void)
+    {
+        pins[PIN_TRIGGER] = HIGH;
+        if(external_interrupts[digitalPinToInterrupt(PIN_TRIGGER)] != nullptr)
+            external_interrupts[digitalPinToInterrupt(PIN_TRIGGER)]();
+        pins[PIN_TRIGGER] = LOW;
+    }
+
+    void setLockDetect(const bool locked)
+    {
+        if(pins[PIN_LD] == locked)
+            return;
+        pins[PIN_LD] = locked;
+        if((pcicr & bit(digitalPinToPCICRbit(PIN_LD))) && (*digitalPinToPCMSK(PIN_LD) & bit(digitalPinToPCMSKbit(PIN_LD))))
+            PCINT0_vect();
+    }
+
+    uint32_t lastWord(const uint8_t addr)
+    {
+        for(size_t i = spiWords.size(); i > 0; i--){
+            if((spiWords[i-1].word & 0x7) == addr)
+                return spiWords[i-1].word;
+        }
+        return 0;
+    }
+}
+
+SimSerial Serial;
+EEPROMClass EEPROM;
+SPIClass SPI;
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+    m_settings = settings;
+    m_count = 0;
+    m_word = 0;
+}
+
+void SPIClass::endTransaction(void)
+{
+    // register writes are MODE0 and 4 bytes, the register 6 readback is MODE1
+    if(m_settings.dataMode == SPI_MODE0 && m_count == 4)
+        sim::spiWords.push_back({sim::clock_us, m_word});
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    m_word = m_word << 8 | data;
+    m_count++;
+    // 8 MHz SPI clock: 1 us per byte
+    sim::clock_us += 1;
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Native (host) simulation of the PLL board, for `pio run -e native`.
+ *
+ * src/main.cpp and lib/MAX2871 are built unchanged against the stubs in this
+ * library. The simulator plays the I2C master, the PPS input and the LD
+ * output of the MAX2871. It captures every register word written over SPI
+ * and runs loop() on a simulated clock:
+ *
+ *      sim::begin();                               // setup()
+ *      sim::i2cWrite(0x20, khz, 4);                // one write transaction
+ *      sim::run(10);                               // loop() for 10 ms
+ *      sim::i2cRead(0x00, map, 0x3C);              // write 0x00, repeated start, read
+ *      sim::spiWords                               // R5..R0 as the MAX2871 got them
+ */
+
+#ifndef _PLL_SIM_H_
+#define _PLL_SIM_H_
+
+#include <Arduino.h>
+#include <vector>
+
+namespace sim
+{
+    struct SpiWord
+    {
+        uint32_t time;  // us
+        uint32_t word;
+    };
+
+    // MAX2871 register words in the order they were written
+    extern std::vector<SpiWord> spiWords;
+
+    // Calls setup() once
+    void begin(void);
+
+    // One loop() pass, then the clock moves on by us
+    void step(uint32_t us = 100);
+
+    // loop() for ms of simulated time
+    void run(uint32_t ms);
+
+    // One write transaction: register address followed by length bytes
+    void i2cWrite(const uint8_t reg, const uint8_t data[], const uint8_t length);
+
+    // Register address, repeated START, length bytes read. Returns the number
+    // of bytes the board queued.
+    uint8_t i2cRead(const uint8_t reg, uint8_t data[], const uint8_t length);
+
+    // Rising edge on the PPS input
+    void pps(void);
+
+    // Rising edge on the hop trigger input
+    void trigger(void);
+
+    // LD output of the MAX2871, fires the pin change interrupt on a change
+    void setLockDetect(const bool locked);
+
+    // Last word written to a MAX2871 register, 0 if none
+    uint32_t lastWord(const uint8_t addr);
+}
+
+#endif /* _PLL_SIM_H_ */
@@ -0,0 +1,469 @@
+/*
+ * Entry point of the native build, see sim.h.
+ *
+ *      .pio/build/native/program                   walk through a retune, lock, commit on PPS and a hop table
+ *      .pio/build/native/program fuzz [n] [seed]   n random transactions, checks the register protocol
+ *      .pio/build/native/program bench [n]         host time per I2C transaction and loop() pass
+ *      .pio/build/native/program bench-ring [n]    host time of CRing, the nI2C transfer queue
+ *
+ * Add -v to print the firmware's Serial output. fuzz exits with 1 when a
+ * check fails.
+ */
+
+// the tests in test/ bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+#include "sim.h"
+#include "MAX2871_solver.h"
+#include <EEPROM.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+
+// The native build stubs nI2C, its queue has no AVR dependencies off the AVR
+#include "../../lib/nI2C/queue.h"
+
+// Register bank of src/main.cpp
+#define REG_REFERENCE_CLOCK     0x04
+#define REG_REFERENCE_DIVIDER   0x06
+#define REG_SAVE_TO_EEPROM      0x03
+#define REG_POWER               0x10
+#define REG_COMMIT_MODE         0x16
+#define REG_COMMIT_PENDING      0x17
+#define REG_EEPROM_STATUS       0x19
+#define REG_FREQUENCY_KHZ       0x20
+#define REG_ACTUAL_KHZ          0x24
+#define REG_DIVIDER_N           0x28
+#define REG_DIVIDER_FRAC        0x2A
+#define REG_DIVIDER_M           0x2C
+#define REG_DIVIDER_DIVA        0x2E
+#define REG_FREQUENCY_STATUS    0x2F
+#define REG_LOCK_TIME           0x30
+#define REG_TELEMETRY_END       0x3D
+#define REG_HOP_MODE            0x40
+#define REG_HOP_LENGTH          0x41
+#define REG_HOP_INDEX           0x42
+#define REG_HOP_STEP            0x43
+#define REG_HOP_ENTRY           0x44
+#define REG_HOP_ENTRY_STATUS    0x45
+#define REG_HOP_ENTRY_KHZ       0x48
+#define REG_MAP_SIZE            0x4C
+
+#define RESPONSE_SIZE           64
+#define HOP_TABLE_SIZE          32
+
+static bool readOnly(const uint8_t reg)
+{
+    return reg == 0x14 || reg == 0x15 || reg == REG_COMMIT_PENDING || reg == REG_EEPROM_STATUS ||
+           (reg >= REG_ACTUAL_KHZ && reg < REG_TELEMETRY_END) || reg == REG_HOP_INDEX || reg == REG_HOP_ENTRY_STATUS;
+}
+
+static uint16_t get16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t get32(const uint8_t *p) { return (uint32_t)get16(p) | (uint32_t)get16(p + 2) << 16; }
+
+// The board answers at most RESPONSE_SIZE bytes
+static void readMap(uint8_t map[REG_MAP_SIZE])
+{
+    sim::i2cRead(0x00, map, RESPONSE_SIZE);
+    sim::i2cRead(RESPONSE_SIZE, map + RESPONSE_SIZE, REG_MAP_SIZE - RESPONSE_SIZE);
+}
+
+static void writeKHz(const uint32_t khz)
+{
+    uint8_t data[4] = {(uint8_t)khz, (uint8_t)(khz >> 8), (uint8_t)(khz >> 16), (uint8_t)(khz >> 24)};
+    sim::i2cWrite(REG_FREQUENCY_KHZ, data, 4);
+}
+
+// Entry index and frequency in one transaction, the board solves it in the next loop()
+static uint8_t uploadHop(const uint8_t entry, const uint32_t khz)
+{
+    uint8_t data[8] = {entry, 0, 0, 0, (uint8_t)khz, (uint8_t)(khz >> 8), (uint8_t)(khz >> 16), (uint8_t)(khz >> 24)};
+    sim::i2cWrite(REG_HOP_ENTRY, data, sizeof(data));
+    sim::step();
+    uint8_t status;
+    sim::i2cRead(REG_HOP_ENTRY_STATUS, &status, 1);
+    return status;
+}
+
+static uint8_t hopIndex(void)
+{
+    uint8_t index;
+    sim::i2cRead(REG_HOP_INDEX, &index, 1);
+    return index;
+}
+
+static void printWords(const size_t from)
+{
+    for(size_t i = from; i < sim::spiWords.size(); i++)
+        printf("    %8u us  R%u = 0x%08X\n", sim::spiWords[i].time, sim::spiWords[i].word & 0x7, sim::spiWords[i].word);
+}
+
+static void printFrequency(void)
+{
+    uint8_t map[REG_MAP_SIZE];
+    readMap(map);
+    uint32_t lock = get32(&map[REG_LOCK_TIME]);
+    printf("    status %u, actual %u kHz, N %u, F %u, M %u, DIVA %u, FB %u, pending %u, lock time %s\n",
+           map[REG_FREQUENCY_STATUS], get32(&map[REG_ACTUAL_KHZ]), get16(&map[REG_DIVIDER_N]),
+           get16(&map[REG_DIVIDER_FRAC]), get16(&map[REG_DIVIDER_M]), map[REG_DIVIDER_DIVA] & 0x7,
+           map[REG_DIVIDER_DIVA] >> 7, map[REG_COMMIT_PENDING],
+           lock == 0xFFFFFFFF ? "pending" : (std::to_string(lock) + " us").c_str());
+}
+
+static int scenario(void)
+{
+    sim::begin();
+    sim::run(10);
+    printf("setup(): %zu register writes\n", sim::spiWords.size());
+    printWords(0);
+
+    size_t from = sim::spiWords.size();
+    const uint8_t operation[] = {1, 900 & 0xFF, 900 >> 8, 1};    // power, 900 MHz, output on
+    sim::i2cWrite(REG_POWER, operation, sizeof(operation));
+    sim::run(10);
+    printf("Power on at 900 MHz:\n");
+    printWords(from);
+    printFrequency();
+
+    from = sim::spiWords.size();
+    writeKHz(917250);
+    sim::step(0);
+    sim::clock_us += 180;
+    sim::setLockDetect(true);
+    sim::run(10);
+    printf("917250 kHz, LD after 180 us:\n");
+    printWords(from);
+    printFrequency();
+
+    const uint8_t commitOnPPS = 1;
+    sim::i2cWrite(REG_COMMIT_MODE, &commitOnPPS, 1);
+    sim::run(10);
+    from = sim::spiWords.size();
+    writeKHz(2450000);
+    sim::run(10);
+    printf("2450000 kHz, commit on PPS, before the edge:\n");
+    printWords(from);
+    printFrequency();
+
+    from = sim::spiWords.size();
+    sim::pps();
+    sim::setLockDetect(false);
+    sim::clock_us += 250;
+    sim::setLockDetect(true);
+    sim::run(10);
+    printf("After the PPS edge, LD after 250 us:\n");
+    printWords(from);
+    printFrequency();
+
+    // Hop table: four entries, stepped on the PPS and then on the trigger input
+    const uint32_t hops[] = {2400000, 2420000, 2440000, 2460500};
+    for(uint8_t i = 0; i < 4; i++)
+        uploadHop(i, hops[i]);
+    const uint8_t hopOnPPS[] = {2, 4};  // mode, length
+    sim::i2cWrite(REG_HOP_MODE, hopOnPPS, sizeof(hopOnPPS));
+    sim::run(10);
+    printf("Hop table of 4 on PPS, staged: index 0x%02X\n", hopIndex());
+    for(uint8_t i = 0; i < 5; i++){
+        from = sim::spiWords.size();
+        sim::pps();
+        printf("PPS %u: index %u\n", i, hopIndex());
+        printWords(from);
+        sim::run(10);
+    }
+    const uint8_t hopOnTrigger = 3;
+    sim::i2cWrite(REG_HOP_MODE, &hopOnTrigger, 1);
+    sim::run(10);
+    sim::pps();
+    sim::run(10);
+    printf("Hop on trigger, a PPS edge: index 0x%02X\n", hopIndex());
+    from = sim::spiWords.size();
+    sim::trigger();
+    printf("Trigger: index %u\n", hopIndex());
+    printWords(from);
+
+    sim::run(3000);
+    printf("EEPROM: %u cell writes, loop() waited %u us on it\n", EEPROM.writes(), EEPROM.waited());
+    return 0;
+}
+
+static int fuzz(const uint32_t iterations, const uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    auto random = [&](uint32_t n) { return (uint32_t)(rng() % n); };
+    uint32_t failures = 0, writes = 0, reads = 0, passes = 0;
+    auto fail = [&](uint32_t i, const char *what, uint8_t reg) {
+        if(failures++ < 20)
+            printf("iteration %u: %s (register 0x%02X)\n", i, what, reg);
+    };
+
+    sim::begin();
+    sim::step();
+
+    for(uint32_t i = 0; i < iterations; i++){
+        uint8_t before[REG_MAP_SIZE], after[REG_MAP_SIZE];
+        uint32_t op = random(100);
+
+        if(op < 50){
+            // Random write, a third of them a valid frequency so the PLL retunes, some a hop table
+            uint8_t data[80];
+            uint8_t reg = random(REG_MAP_SIZE + 8);
+            uint8_t length = 1 + random(sizeof(data));
+            for(uint8_t j = 0; j < length; j++)
+                data[j] = rng();
+            if(op < 15){
+                reg = REG_FREQUENCY_KHZ;
+                length = 4;
+                uint32_t khz = 23500 + random(6000000 - 23500);
+                memcpy(data, &khz, 4);
+            }else if(op < 20){
+                reg = REG_HOP_ENTRY;
+                length = 8;
+                data[0] = random(HOP_TABLE_SIZE);
+                uint32_t khz = 23500 + random(6000000 - 23500);
+                memcpy(&data[4], &khz, 4);
+            }else if(op < 22){
+                reg = REG_HOP_MODE;
+                length = 2;
+                data[0] = random(4);
+                data[1] = 1 + random(8);
+            }
+
+            readMap(before);
+            sim::i2cWrite(reg, data, length);
+            readMap(after);
+            writes++;
+
+            // the board takes up to SIZE_BUFFER - 1 data bytes and drops writes past the map
+            uint8_t taken = (length > 63) ? 63 : length;
+            bool dropped = reg >= REG_MAP_SIZE || reg + taken > REG_MAP_SIZE;
+            for(uint8_t r = 0; r < REG_MAP_SIZE; r++){
+                bool written = !dropped && r >= reg && r < reg + taken;
+                uint8_t expected = (written && !readOnly(r)) ? data[r - reg] : before[r];
+                if(after[r] != expected)
+                    fail(i, written ? (readOnly(r) ? "read-only register written" : "write not applied") : "register outside the write changed", r);
+            }
+        }else if(op < 70){
+            // Random read against the map read in one go
+            uint8_t data[64];
+            uint8_t reg = random(REG_MAP_SIZE);
+            uint8_t length = 1 + random(sizeof(data));
+            readMap(before);
+            uint8_t queued = sim::i2cRead(reg, data, length);
+            reads++;
+            if(queued != std::min(REG_MAP_SIZE - reg, RESPONSE_SIZE))
+                fail(i, "wrong number of bytes queued", reg);
+            for(uint8_t j = 0; j < length && j < queued; j++){
+                if(data[j] != before[reg + j])
+                    fail(i, "read differs from the map", reg + j);
+            }
+        }else if(op < 90){
+            sim::run(1 + random(20));
+            passes++;
+
+            // What the readback registers report is what went out over SPI
+            readMap(after);
+            if(after[REG_COMMIT_PENDING] == 0){
+                uint32_t r0 = sim::lastWord(0), r1 = sim::lastWord(1), r4 = sim::lastWord(4);
+                if(get16(&after[REG_DIVIDER_N]) != ((r0 >> 15) & 0xFFFF))
+                    fail(i, "N differs from R0", REG_DIVIDER_N);
+                if(get16(&after[REG_DIVIDER_FRAC]) != ((r0 >> 3) & 0xFFF))
+                    fail(i, "F differs from R0", REG_DIVIDER_FRAC);
+                if(get16(&after[REG_DIVIDER_M]) != ((r1 >> 3) & 0xFFF))
+                    fail(i, "M differs from R1", REG_DIVIDER_M);
+                if((after[REG_DIVIDER_DIVA] & 0x7) != ((r4 >> 20) & 0x7))
+                    fail(i, "DIVA differs from R4", REG_DIVIDER_DIVA);
+
+                // and ACTUAL_KHZ what those dividers give (a zero reference or divider is ignored)
+                MAX2871_Dividers d = {get16(&after[REG_DIVIDER_N]), get16(&after[REG_DIVIDER_FRAC]),
+                                      get16(&after[REG_DIVIDER_M]), (uint8_t)(after[REG_DIVIDER_DIVA] & 0x7),
+                                      (uint8_t)(after[REG_DIVIDER_DIVA] >> 7)};
+                uint16_t ref = get16(&after[REG_REFERENCE_CLOCK]);
+                uint8_t rdiv = after[REG_REFERENCE_DIVIDER];
+                if(ref != 0 && rdiv != 0 && d.m != 0 && get32(&after[REG_ACTUAL_KHZ]) != max2871FrequencyKHz(d, ref, rdiv))
+                    fail(i, "ACTUAL_KHZ differs from the dividers", REG_ACTUAL_KHZ);
+            }
+
+            // The hop index stays inside the table, and is none with the table off
+            uint8_t length = std::min(after[REG_HOP_LENGTH], (uint8_t)HOP_TABLE_SIZE);
+            bool hopping = after[REG_HOP_MODE] >= 1 && after[REG_HOP_MODE] <= 3 && length > 0;
+            if(after[REG_HOP_INDEX] != 0xFF && (!hopping || after[REG_HOP_INDEX] >= length))
+                fail(i, "hop index outside the table", REG_HOP_INDEX);
+        }else if(op < 93){
+            sim::pps();
+        }else if(op < 95){
+            sim::trigger();
+        }else{
+            sim::setLockDetect(random(2));
+        }
+        sim::clock_us += random(1000);
+    }
+
+    printf("%u iterations (seed %u): %u writes, %u reads, %u loop runs, %zu SPI words, %u failures\n",
+           iterations, seed, writes, reads, passes, sim::spiWords.size(), failures);
+    return failures ? 1 : 0;
+}
+
+template <typename F>
+static double nsPer(const uint32_t n, F fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < n; i++)
+        fn(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / n;
+}
+
+static int bench(const uint32_t n)
+{
+    uint8_t data[REG_MAP_SIZE];
+    sim::begin();
+    sim::run(10);
+
+    const uint8_t on = 1;
+    sim::i2cWrite(REG_POWER, &on, 1);
+    writeKHz(917000);
+    sim::run(10);
+
+    // The EEPROM and MAX2871 only see changes, keep the written values the same
+    printf("write 1 register:     %8.1f ns\n", nsPer(n, [&](uint32_t) { sim::i2cWrite(REG_POWER, &on, 1); }));
+    printf("read whole map:       %8.1f ns\n", nsPer(n, [&](uint32_t) { readMap(data); }));
+    printf("loop(), idle:         %8.1f ns\n", nsPer(n, [&](uint32_t) { sim::step(); }));
+    printf("loop(), after write:  %8.1f ns\n", nsPer(n, [&](uint32_t) { sim::i2cWrite(REG_POWER, &on, 1); sim::step(); }));
+
+    size_t words = sim::spiWords.size();
+    double retune = nsPer(n, [&](uint32_t i) { writeKHz(900000 + (i % 1000) * 37); sim::step(); });
+    printf("retune (kHz + loop):  %8.1f ns, %.2f SPI words each\n", retune, double(sim::spiWords.size() - words) / n);
+
+    // The same retunes from the hop table, one strobe each
+    for(uint8_t i = 0; i < HOP_TABLE_SIZE; i++)
+        uploadHop(i, 900000 + i * 37);
+    const uint8_t hopOnStrobe[] = {1, HOP_TABLE_SIZE};
+    sim::i2cWrite(REG_HOP_MODE, hopOnStrobe, sizeof(hopOnStrobe));
+    sim::step();
+    words = sim::spiWords.size();
+    double hop = nsPer(n, [&](uint32_t) { sim::i2cWrite(REG_HOP_STEP, &on, 1); sim::step(); });
+    printf("hop (strobe + loop):  %8.1f ns, %.2f SPI words each\n", hop, double(sim::spiWords.size() - words) / n);
+    const uint8_t hopOff = 0;
+    sim::i2cWrite(REG_HOP_MODE, &hopOff, 1);
+    sim::step();
+
+    // A sweep with the whole map saved (EEPROM_ALL): one retune every 10 ms of simulated time
+    const uint8_t saveAll = 2;
+    sim::i2cWrite(REG_SAVE_TO_EEPROM, &saveAll, 1);
+    sim::run(5000);
+    uint32_t writes = EEPROM.writes(), waited = EEPROM.waited();
+    for(uint32_t i = 0; i < 1000; i++){
+        writeKHz(900000 + i * 100);
+        sim::run(10);
+    }
+    printf("1000 retunes, EEPROM_ALL: %u EEPROM cell writes, loop() waited %u us on the EEPROM\n",
+           EEPROM.writes() - writes, EEPROM.waited() - waited);
+    sim::run(3000);
+    printf("after the sweep:          %u EEPROM cell writes\n", EEPROM.writes() - writes);
+    return 0;
+}
+
+// An nTWI::Packet: mode, address, buffer, length, delay and callback
+struct RingPacket
+{
+    uint8_t mode;
+    uint8_t address;
+    uint8_t *data;
+    uint32_t length;
+    uint8_t delay;
+    void (*callback)(uint8_t);
+};
+
+static int benchRing(const uint32_t n)
+{
+    CRing<RingPacket, 4> ring;     // SIZE_QUEUE of nTWI.h
+    RingPacket packet = {};
+    uint32_t sum = 0;
+
+    printf("push + pop:           %8.1f ns\n", nsPer(n, [&](uint32_t i) {
+        packet.length = i;
+        ring.Push(packet);
+        sum += ring.Front()->length;
+        ring.Pop();
+    }));
+    printf("fill + drain (4):     %8.1f ns\n", nsPer(n, [&](uint32_t i) {
+        for(uint8_t k = 0; k < 4; k++){
+            packet.length = i + k;
+            ring.Push(packet);
+        }
+        while(RingPacket *p = ring.Front()){
+            sum += p->length;
+            ring.Pop();
+        }
+    }));
+    for(uint8_t k = 0; k < 4; k++)
+        ring.Push(packet);
+    printf("push to a full ring:  %8.1f ns\n", nsPer(n, [&](uint32_t) { sum += ring.Push(packet); }));
+    ring.Clear();
+
+    // One producer and one consumer thread, like loop() and the TWI ISR: every
+    // element arrives once and in order. Both yield while they have to wait, the
+    // host may have a single core.
+    const uint32_t elements = std::min<uint32_t>(n, 1000000);
+    CRing<uint32_t, 4> spsc;
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        for(uint32_t expected = 0; expected < elements;){
+            uint32_t *p = spsc.Front();
+            if(p == nullptr){
+                std::this_thread::yield();
+                continue;
+            }
+            if(*p != expected)
+                failed = true;
+            spsc.Pop();
+            expected++;
+        }
+    });
+    for(uint32_t i = 0; i < elements;){
+        if(spsc.Push(i))
+            i++;
+        else
+            std::this_thread::yield();
+    }
+    consumer.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    printf("two threads:          %8.1f ns per element, %s, %u pushes refused while full\n", elapsed.count() / elements,
+           failed ? "OUT OF ORDER" : "in order", spsc.Dropped());
+
+    // keeps the loops above from being optimised away
+    if(sum == 0xFFFFFFFF)
+        printf("\n");
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> args;
+    for(int i = 1; i < argc; i++){
+        if(std::string(argv[i]) == "-v")
+            sim::verbose = true;
+        else
+            args.push_back(argv[i]);
+    }
+
+    std::string mode = args.empty() ? "scenario" : args[0];
+    uint32_t n = args.size() > 1 ? std::stoul(args[1]) : 0;
+    if(mode == "fuzz")
+        return fuzz(n ? n : 100000, args.size() > 2 ? std::stoul(args[2]) : 1);
+    if(mode == "bench")
+        return bench(n ? n : 100000);
+    if(mode == "bench-ring")
+        return benchRing(n ? n : 10000000);
+    if(mode == "scenario")
+        return scenario();
+
+    printf("usage: %s [scenario | fuzz [n] [seed] | bench [n] | bench-ring [n]] [-v]\n", argv[0]);
+    return 2;
+}
+
+#endif /* PIO_UNIT_TESTING */
@@ -4,6 +4,7 @@
 #include <EEPROM.h>
 
 #include "MAX2871.h"
+#include "SettingsStore.h"
 #include <SPI.h>
 
 #define DEBUG
@@ -18,6 +19,7 @@
 #define CE        9 
 #define LED       6
 #define PPS       2
+#define TRIGGER   3 // External hop trigger (INT1), e.g. a GPIO of the USRP FP0 header
 
 // -------- REGISTER BANK -------------
 // 0x0?: SETTINGS
@@ -30,6 +32,7 @@
 #define REGISTER_SETTINGS_LED_MODE              0x07
 #define REGISTER_SETTINGS_LED_BLINK_ON_TIME     0x08
 #define REGISTER_SETTINGS_LED_BLINK_OFF_TIME    0x09
+#define REGISTER_SETTINGS_TELEMETRY_INTERVAL    0x0A // *100 ms, 0: off
 
 #define REGISTER_START_SETTINGS                 0x00
 #define REGISTER_END_SETTINGS                   0x10
@@ -40,14 +43,51 @@
 #define REGISTER_PLL_ENABLE_OUTPUT              0x13
 #define REGISTER_PLL_LOCK_DETECTED              0x14 // Read only
 #define REGISTER_PLL_MODE                       0x15 // Read only
-
-#define REGISTER_MAP_SIZE                       REGISTER_PLL_MODE+1
-#define REGISTER_MAP_NR_READ_ONLY               2
+#define REGISTER_PLL_COMMIT_MODE                0x16
+#define REGISTER_PLL_COMMIT_PENDING             0x17 // Read only
+#define REGISTER_EEPROM_COMMIT                  0x18 // Write 1: store now instead of after the quiet time, reads 0 once taken
+#define REGISTER_EEPROM_STATUS                  0x19 // Read only, 0: stored, 1: waiting for the quiet time, 2: writing
+
+// 0x2?: PLL FREQUENCY (kHz resolution)
+#define REGISTER_PLL_FREQUENCY_KHZ              0x20 // 4 byte (uint32), applied when byte 0x23 is written
+#define REGISTER_PLL_ACTUAL_FREQUENCY_KHZ       0x24 // 4 byte (uint32), read only
+#define REGISTER_PLL_DIVIDER_N                  0x28 // 2 byte (uint16), read only
+#define REGISTER_PLL_DIVIDER_FRAC               0x2A // 2 byte (uint16), read only
+#define REGISTER_PLL_DIVIDER_M                  0x2C // 2 byte (uint16), read only
+#define REGISTER_PLL_DIVIDER_DIVA               0x2E // Read only, bit 7: FB
+#define REGISTER_PLL_FREQUENCY_STATUS           0x2F // Read only
+
+// 0x3?: TELEMETRY (read only)
+#define REGISTER_TELEMETRY_LOCK_TIME            0x30 // 4 byte (uint32), us from the last R0 write to LD high
+#define REGISTER_TELEMETRY_LOCK_LOSSES          0x34 // 2 byte (uint16), LD drops without a retune
+#define REGISTER_TELEMETRY_TEMPERATURE          0x36 // 2 byte (int16), 0.1 degC
+#define REGISTER_TELEMETRY_ADC                  0x38 // 2 byte (uint16), VCO tuning voltage in mV
+#define REGISTER_TELEMETRY_VCO                  0x3A // VCO band selected by the autoselect
+#define REGISTER_TELEMETRY_AGE                  0x3B // *100 ms since the last sample, saturates at 255
+#define REGISTER_TELEMETRY_STATUS               0x3C // TELEMETRY_* flags of the last sample
+
+// 0x4?: HOP TABLE (not stored in EEPROM)
+#define REGISTER_HOP_MODE                       0x40 // 0: off, 1: on strobe, 2: on PPS, 3: on trigger
+#define REGISTER_HOP_LENGTH                     0x41 // Entries to step through, writing it or the mode starts at entry 0
+#define REGISTER_HOP_INDEX                      0x42 // Read only, entry the MAX2871 is at, 0xFF before the first
+#define REGISTER_HOP_STEP                       0x43 // Write 1: next entry (on strobe), reads 0 once taken
+#define REGISTER_HOP_ENTRY                      0x44 // Entry to upload, +1 after each upload
+#define REGISTER_HOP_ENTRY_STATUS               0x45 // Read only, PLL_FREQUENCY_* of the last upload
+#define REGISTER_HOP_ENTRY_KHZ                  0x48 // 4 byte (uint32), uploaded when byte 0x4B is written
+
+#define REGISTER_MAP_SIZE                       REGISTER_HOP_ENTRY_KHZ+4
+#define REGISTER_MAP_STORED_SIZE                REGISTER_TELEMETRY_LOCK_TIME // EEPROM_ALL stores up to here, not the telemetry
+#define REGISTER_MAP_NR_READ_ONLY               31
+
+#if REGISTER_MAP_STORED_SIZE > SETTINGS_STORE_MAX_LENGTH
+#error "Register map does not fit in a settings store record"
+#endif
 
 // Register bank settings
-#define EEPROM_STATUS_ADDRESS                   0
+#define EEPROM_STATUS_ADDRESS                   0 // EEPROM layout of firmware without the settings store, read once to migrate
 #define EEPROM_START_ADDRESS                    1
-#define REGISTER_RESPONSE_SIZE                  32
+#define EEPROM_LEGACY_MAP_SIZE                  0x16 // its register map, 0x00 - REGISTER_PLL_MODE
+#define REGISTER_RESPONSE_SIZE                  64 // nTWI SIZE_BUFFER
 
 // -------- VALUES CONSTANTS -----------
 #define EEPROM_DISABLE                          0
@@ -61,6 +101,30 @@
 #define LED_MODE_LOCK_DETECT                    4
 #define LED_MODE_PPS_BLINK_AND_LOCK_DETECT      5
 
+#define PLL_COMMIT_IMMEDIATE                    0
+#define PLL_COMMIT_ON_PPS                       1 // New dividers take effect on the next PPS edge
+
+#define PLL_FREQUENCY_OK                        0
+#define PLL_FREQUENCY_OUT_OF_RANGE              1
+#define PLL_FREQUENCY_NO_SOLUTION               2 // No valid N for this reference and divider
+
+#define PLL_FREQUENCY_MIN_KHZ                   23500UL
+#define PLL_FREQUENCY_MAX_KHZ                   6000000UL
+
+#define LOCK_TIME_PENDING                       0xFFFFFFFF // No LD rising edge since the last R0 write yet
+
+#define TELEMETRY_TEMPERATURE_INVALID           0x01 // MAX2871 ADC reading not valid, temperature reads TEMPERATURE_INVALID
+#define TELEMETRY_ADC_INVALID                   0x02 // same for the tuning voltage, reads ADC_INVALID
+#define TEMPERATURE_INVALID                     (int16_t) 0x8000
+#define ADC_INVALID                             0xFFFF
+
+#define HOP_OFF                                 0
+#define HOP_ON_STROBE                           1 // REGISTER_HOP_STEP, applied like a frequency write (commit mode)
+#define HOP_ON_PPS                              2
+#define HOP_ON_TRIGGER                          3
+#define HOP_TABLE_SIZE                          32 // 12 bytes of RAM each
+#define HOP_NONE                                0xFF
+
 // -------- DEFAULT VALUES -----------
 #define SETTINGS_DEVICE_ID                      0
 #define SETTINGS_HARDWARE_VERSION               0
@@ -71,6 +135,7 @@
 #define SETTINGS_LED_MODE                       LED_MODE_BLINK // 0: Off, 1: On, 2: Blink, 3: PPS blink, 4: Lock detect, 5: Lock detect && PPS blink, PPS not implemented in V1
 #define SETTINGS_LED_BLINK_ON_TIME              20 // *10 ms
 #define SETTINGS_LED_BLINK_OFF_TIME             80 // *10 ms
+#define SETTINGS_TELEMETRY_INTERVAL             10 // *100 ms
 
 enum address_i2c_t : byte{
     ADDRESS_I2C = 0x2F // Address of I2C device
@@ -80,12 +145,53 @@ enum address_i2c_t : byte{
 CTWI i2c;
 
 // Register map vars
-uint8_t readOnlyRegisters[] = {REGISTER_PLL_LOCK_DETECTED, REGISTER_PLL_MODE};
+uint8_t readOnlyRegisters[] = {REGISTER_PLL_LOCK_DETECTED, REGISTER_PLL_MODE, REGISTER_PLL_COMMIT_PENDING, REGISTER_EEPROM_STATUS,
+                               REGISTER_PLL_ACTUAL_FREQUENCY_KHZ, REGISTER_PLL_ACTUAL_FREQUENCY_KHZ+1,
+                               REGISTER_PLL_ACTUAL_FREQUENCY_KHZ+2, REGISTER_PLL_ACTUAL_FREQUENCY_KHZ+3,
+                               REGISTER_PLL_DIVIDER_N, REGISTER_PLL_DIVIDER_N+1,
+                               REGISTER_PLL_DIVIDER_FRAC, REGISTER_PLL_DIVIDER_FRAC+1,
+                               REGISTER_PLL_DIVIDER_M, REGISTER_PLL_DIVIDER_M+1,
+                               REGISTER_PLL_DIVIDER_DIVA, REGISTER_PLL_FREQUENCY_STATUS,
+                               REGISTER_TELEMETRY_LOCK_TIME, REGISTER_TELEMETRY_LOCK_TIME+1,
+                               REGISTER_TELEMETRY_LOCK_TIME+2, REGISTER_TELEMETRY_LOCK_TIME+3,
+                               REGISTER_TELEMETRY_LOCK_LOSSES, REGISTER_TELEMETRY_LOCK_LOSSES+1,
+                               REGISTER_TELEMETRY_TEMPERATURE, REGISTER_TELEMETRY_TEMPERATURE+1,
+                               REGISTER_TELEMETRY_ADC, REGISTER_TELEMETRY_ADC+1,
+                               REGISTER_TELEMETRY_VCO, REGISTER_TELEMETRY_AGE, REGISTER_TELEMETRY_STATUS,
+                               REGISTER_HOP_INDEX, REGISTER_HOP_ENTRY_STATUS};
 uint8_t registerMap[REGISTER_MAP_SIZE] = {0x00};
 bool registerMapUpdate = true;
 bool registerMapSettingsUpdate = true;
 uint8_t lastRegister = 0;
 
+// Register map in EEPROM, written behind loop()
+SettingsStore settingsStore;
+
+// Frequency in use: kHz register once committed, 0 when the MHz register is in use
+uint32_t frequencyKHz = 0;
+volatile bool frequencyKHzUpdate = false;
+volatile bool frequencyMHzUpdate = false;
+
+// Lock detect edges, from the pin change interrupt on LD
+volatile uint32_t lockTime = LOCK_TIME_PENDING;
+volatile uint16_t lockLosses = 0;
+volatile uint16_t lockLatchCount = 0; // R0 writes seen at the last LD rising edge
+uint32_t lastTelemetryTime = 0;
+
+// Hop table: frequencies with their dividers solved at upload, so a hop only writes registers
+struct HopEntry{
+  uint32_t kHz;
+  MAX2871_Dividers dividers; // m is 0 when there is no valid setting
+};
+HopEntry hopTable[HOP_TABLE_SIZE];
+volatile uint8_t hopMode = HOP_OFF;
+uint8_t hopLength = 0;
+uint8_t hopNext = 0;
+volatile uint8_t hopIndex = HOP_NONE;  // entry in the MAX2871
+volatile uint8_t hopStaged = HOP_NONE; // entry waiting for the next edge
+volatile bool hopRestart = false;
+volatile bool hopUpload = false;
+
 volatile bool ppsHappened = false;
 uint32_t lastLedTime = 0;
 uint16_t ledTimeout = 0;
@@ -93,9 +199,17 @@ uint16_t ledTimeout = 0;
 // Callback function prototype
 void i2cWriteCallback(const uint8_t data[], const uint8_t length);
 void i2cReadCallback(void);
-void readEEPROM(void);
-void updateEEPROM(void);
+bool readLegacyEEPROM(void);
+void storeSettings(void);
 void ppsISR(void);
+void triggerISR(void);
+void latchStaged(void);
+uint8_t solveHopEntry(uint8_t entry);
+uint32_t readRegister32(uint8_t reg);
+void writeRegister32(uint8_t reg, uint32_t value);
+void writeRegister16(uint8_t reg, uint16_t value);
+void updateFrequencyReadback(void);
+void updateTelemetry(void);
 
 // PLL Object
 MAX2871 max2871(LE, MOSI, SCLK, MISO);           //create object of class MAX2871, assign latch enable pin
@@ -113,10 +227,12 @@ void setup(){
   i2c.SetSlaveReceiveHandler(i2cWriteCallback);
   i2c.SetSlaveTransmitHandler(i2cReadCallback);
 
-  // Load config from EEPROM
-  if(EEPROM.read(EEPROM_STATUS_ADDRESS) == 1){
-    readEEPROM();
-  }else{
+  // Load config from EEPROM: the newest record, else what older firmware left (stored again in the new format)
+  bool restored = settingsStore.begin(registerMap, REGISTER_MAP_STORED_SIZE) > 0;
+  if(!restored && EEPROM.read(EEPROM_STATUS_ADDRESS) == 1){
+    restored = readLegacyEEPROM();
+  }
+  if(!restored){
     registerMap[REGISTER_SETTINGS_DEVICE_ID] = SETTINGS_DEVICE_ID;
     registerMap[REGISTER_SETTINGS_HARDWARE_VERSION] = SETTINGS_HARDWARE_VERSION;
     registerMap[REGISTER_SETTINGS_FIRMWARE_VERSION] = SETTINGS_FIRMWARE_VERSION;
@@ -126,9 +242,10 @@ void setup(){
     registerMap[REGISTER_SETTINGS_LED_MODE] = SETTINGS_LED_MODE;
     registerMap[REGISTER_SETTINGS_LED_BLINK_ON_TIME] = SETTINGS_LED_BLINK_ON_TIME;
     registerMap[REGISTER_SETTINGS_LED_BLINK_OFF_TIME] = SETTINGS_LED_BLINK_OFF_TIME;
-
-    updateEEPROM();
+    registerMap[REGISTER_SETTINGS_TELEMETRY_INTERVAL] = SETTINGS_TELEMETRY_INTERVAL;
   }
+  frequencyKHz = readRegister32(REGISTER_PLL_FREQUENCY_KHZ);
+  registerMap[REGISTER_HOP_INDEX] = HOP_NONE;
 
   // --- Setup for PLL ---
   // General IO setup
@@ -141,8 +258,14 @@ void setup(){
   pinMode(SCLK, OUTPUT);
   pinMode(LED, OUTPUT);
   pinMode(PPS, INPUT);
+  pinMode(TRIGGER, INPUT);
 
   attachInterrupt(digitalPinToInterrupt(PPS), ppsISR, RISING);
+  attachInterrupt(digitalPinToInterrupt(TRIGGER), triggerISR, RISING);
+
+  // LD (PB0) is no external interrupt pin, use its pin change interrupt (PCINT0_vect)
+  *digitalPinToPCMSK(LD) |= bit(digitalPinToPCMSKbit(LD));
+  *digitalPinToPCICR(LD) |= bit(digitalPinToPCICRbit(LD));
 
   digitalWrite(LE, HIGH);
   digitalWrite(LED, LOW);
@@ -188,9 +311,12 @@ void loop(){
     ppsHappened = false;
   }
 
+  // Collect the PLL changes of this pass, written at once below
+  max2871.holdUpdates(true);
+
   // Settings updated
   if(registerMapSettingsUpdate){
-    updateEEPROM();
+    storeSettings();
     uint16_t frequency = (uint16_t) ( registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK] | (uint16_t)registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK+1]<<8 );
     max2871.setPFD(frequency, registerMap[REGISTER_SETTINGS_PLL_REFERENCE_DIVIDER]);
 #ifdef DEBUG
@@ -200,13 +326,67 @@ void loop(){
     Serial.println(registerMap[REGISTER_SETTINGS_PLL_REFERENCE_DIVIDER]);
 #endif
 
+    // The hop table dividers depend on the reference
+    for(uint8_t entry = 0; entry < HOP_TABLE_SIZE; entry++){
+      if(hopTable[entry].kHz != 0)
+        solveHopEntry(entry);
+    }
+    if(hopMode != HOP_OFF)
+      hopRestart = true;
+
     registerMapSettingsUpdate = false;
   }
 
+  // Hop table entry uploaded: solve it now, not when it is applied
+  if(hopUpload){
+    noInterrupts();
+    uint8_t entry = registerMap[REGISTER_HOP_ENTRY];
+    uint32_t kHz = readRegister32(REGISTER_HOP_ENTRY_KHZ);
+    hopUpload = false;
+    interrupts();
+    uint8_t status = PLL_FREQUENCY_OUT_OF_RANGE;
+    if(entry < HOP_TABLE_SIZE){
+      hopTable[entry].kHz = kHz;
+      status = solveHopEntry(entry);
+    }
+    registerMap[REGISTER_HOP_ENTRY_STATUS] = status;
+    registerMap[REGISTER_HOP_ENTRY] = entry + 1;
+  }
+
+  // Hop mode or length written: start over at entry 0
+  bool hopStart = false;
+  if(hopRestart){
+    uint8_t mode = registerMap[REGISTER_HOP_MODE];
+    hopLength = (registerMap[REGISTER_HOP_LENGTH] > HOP_TABLE_SIZE) ? HOP_TABLE_SIZE : registerMap[REGISTER_HOP_LENGTH];
+    noInterrupts();
+    hopMode = (mode > HOP_ON_TRIGGER || hopLength == 0) ? HOP_OFF : mode;
+    hopIndex = HOP_NONE;
+    hopStaged = HOP_NONE;
+    hopRestart = false;
+    interrupts();
+    hopNext = 0;
+    hopStart = hopMode != HOP_OFF;
+  }
+
+  // Frequency written: the kHz register replaces the MHz one once all 4 bytes are in, and the other way around
+  if(frequencyKHzUpdate || frequencyMHzUpdate){
+    noInterrupts();
+    if(frequencyKHzUpdate){
+      frequencyKHz = readRegister32(REGISTER_PLL_FREQUENCY_KHZ);
+    }else{
+      frequencyKHz = 0;
+      writeRegister32(REGISTER_PLL_FREQUENCY_KHZ, 0);
+    }
+    frequencyKHzUpdate = false;
+    frequencyMHzUpdate = false;
+    interrupts();
+  }
+
   // Function registers updated
+  bool pllUpdated = registerMapUpdate;
   if(registerMapUpdate){
     if(registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] == EEPROM_ALL)
-      updateEEPROM();
+      storeSettings();
 
     if(registerMap[REGISTER_PLL_POWER] > 0){
       max2871.powerOn(true); 
@@ -214,19 +394,35 @@ void loop(){
       max2871.powerOn(false);
     }
 
+    max2871.setLatchOnPPS(registerMap[REGISTER_PLL_COMMIT_MODE] == PLL_COMMIT_ON_PPS || hopMode == HOP_ON_PPS || hopMode == HOP_ON_TRIGGER);
+
     // Repeat this, to be on the save side
     uint16_t frequency = (uint16_t) ( registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK] | (uint16_t)registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK+1]<<8 );
     max2871.setPFD(frequency, registerMap[REGISTER_SETTINGS_PLL_REFERENCE_DIVIDER]);
 
-    frequency = (uint16_t) ( registerMap[REGISTER_PLL_FREQUENCY] | (uint16_t)registerMap[REGISTER_PLL_FREQUENCY+1]<<8 );
-    if((frequency < 100) && (frequency > 6000)){ 
+    uint8_t status = PLL_FREQUENCY_OK;
+    if(hopMode != HOP_OFF){
+      // the hop table sets the frequency, see below
+    }else if(frequencyKHz != 0){
+      if(frequencyKHz < PLL_FREQUENCY_MIN_KHZ || frequencyKHz > PLL_FREQUENCY_MAX_KHZ)
+        status = PLL_FREQUENCY_OUT_OF_RANGE;
+      else if(!max2871.setRFOUTAkHz(frequencyKHz))
+        status = PLL_FREQUENCY_NO_SOLUTION;
+    }else{
+      frequency = (uint16_t) ( registerMap[REGISTER_PLL_FREQUENCY] | (uint16_t)registerMap[REGISTER_PLL_FREQUENCY+1]<<8 );
+      if(frequency*1000UL < PLL_FREQUENCY_MIN_KHZ || frequency*1000UL > PLL_FREQUENCY_MAX_KHZ)
+        status = PLL_FREQUENCY_OUT_OF_RANGE;
+      else
+        max2871.setRFOUTA(frequency);
+    }
+    registerMap[REGISTER_PLL_FREQUENCY_STATUS] = status;
+
+    if(status != PLL_FREQUENCY_OK){ 
 #ifdef DEBUG
         Serial.println("\n\rNot a valid frequency entry."); 
-        Serial.println(frequency) ;
+        Serial.println(status) ;
 #endif
     }else{
-      max2871.setRFOUTA((double) frequency);
-
       if(registerMap[REGISTER_PLL_ENABLE_OUTPUT] > 0){
         max2871.enable_output();
       }else{
@@ -236,49 +432,93 @@ void loop(){
   registerMapUpdate = false;
   }
 
+  // Next hop: right away on a strobe, staged in R0 for the PPS / trigger edge once the previous one is out
+  uint8_t hop = HOP_NONE;
+  bool hopOnEdge = hopMode == HOP_ON_PPS || hopMode == HOP_ON_TRIGGER;
+  // read and clear in one go, a step the I2C interrupt writes in between is not lost
+  noInterrupts();
+  bool hopStep = registerMap[REGISTER_HOP_STEP] > 0;
+  registerMap[REGISTER_HOP_STEP] = 0;
+  interrupts();
+  if(hopMode != HOP_OFF && (hopStart || (hopMode == HOP_ON_STROBE && hopStep) || (hopOnEdge && hopStaged == HOP_NONE && !max2871.latchPending()))){
+    hop = hopNext;
+    hopNext = (hopNext + 1 < hopLength) ? hopNext + 1 : 0;
+    // an entry without a valid setting keeps the frequency, but still takes its turn
+    if(hopTable[hop].dividers.m != 0)
+      max2871.setDividers(hopTable[hop].dividers);
+    pllUpdated = true;
+  }
+  uint16_t latches = max2871.getLatchCount();
+
+  // Only the MAX2871 registers that differ from what was written before go out
+  max2871.holdUpdates(false);
+
+  noInterrupts();
+  if(hop != HOP_NONE){
+    // On an edge it counts from that edge, even when R0 stays the same; an edge may have taken it already
+    if(max2871.latchPending() || (hopOnEdge && max2871.getLatchCount() == latches)){
+      hopStaged = hop;
+    }else{
+      hopIndex = hop;
+      hopStaged = HOP_NONE;
+    }
+  }else if(!hopOnEdge && hopStaged != HOP_NONE && !max2871.latchPending()){
+    // written at once after switching to commit immediate
+    hopIndex = hopStaged;
+    hopStaged = HOP_NONE;
+  }
+  registerMap[REGISTER_HOP_INDEX] = hopIndex;
+  interrupts();
+
+  if(pllUpdated)
+    updateFrequencyReadback();
+
   // Set readonly registers
   registerMap[REGISTER_PLL_MODE] = max2871.getMode();
   registerMap[REGISTER_PLL_LOCK_DETECTED] = digitalRead(LD);
+  registerMap[REGISTER_PLL_COMMIT_PENDING] = max2871.latchPending();
 
+  // Telemetry
+  updateTelemetry();
+
+  // EEPROM: at most one byte per pass, and only when the previous one is done
+  if(registerMap[REGISTER_EEPROM_COMMIT] > 0){
+    registerMap[REGISTER_EEPROM_COMMIT] = 0;
+    if(registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] != EEPROM_DISABLE)
+      settingsStore.commit();
+  }
+  settingsStore.poll(registerMap, (registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] == EEPROM_ALL) ? REGISTER_MAP_STORED_SIZE : REGISTER_END_SETTINGS);
+  registerMap[REGISTER_EEPROM_STATUS] = settingsStore.status();
 }
 
-void readEEPROM(){
+bool readLegacyEEPROM(){
 #ifdef DEBUG
   Serial.println("E0");
 #endif
 
-  // First read settings in temp buffer
-  uint8_t registerMapTemp[REGISTER_END_SETTINGS] = {0x00};
-  for(uint8_t reg = REGISTER_START_SETTINGS; reg < REGISTER_END_SETTINGS; reg++){
-    registerMapTemp[reg] = EEPROM.read(reg - REGISTER_START_SETTINGS + EEPROM_START_ADDRESS);
-  }
+  // That firmware stored the settings, or with EEPROM_ALL its whole map of 0x16 bytes
+  uint8_t save = EEPROM.read(REGISTER_SETTINGS_SAVE_TO_EEPROM - REGISTER_START_SETTINGS + EEPROM_START_ADDRESS);
+  if(save == EEPROM_DISABLE)
+    return false;
 
-  // Now read everything according to new settings
-  if(registerMapTemp[REGISTER_SETTINGS_SAVE_TO_EEPROM] != EEPROM_DISABLE){
-    uint8_t end = REGISTER_END_SETTINGS;
-    if(registerMapTemp[REGISTER_SETTINGS_SAVE_TO_EEPROM] == EEPROM_ALL)
-      end = REGISTER_MAP_SIZE;
-    for(uint8_t reg = REGISTER_START_SETTINGS; reg < end; reg++){
-      registerMap[reg] = EEPROM.read(reg - REGISTER_START_SETTINGS + EEPROM_START_ADDRESS);
-    }
+  uint8_t end = (save == EEPROM_ALL) ? EEPROM_LEGACY_MAP_SIZE : REGISTER_END_SETTINGS;
+  for(uint8_t reg = REGISTER_START_SETTINGS; reg < end; reg++){
+    registerMap[reg] = EEPROM.read(reg - REGISTER_START_SETTINGS + EEPROM_START_ADDRESS);
   }
+
+  // Registers it did not have start as on a new board, the ones past end are still 0
+  registerMap[REGISTER_SETTINGS_TELEMETRY_INTERVAL] = SETTINGS_TELEMETRY_INTERVAL;
+  return true;
 }
 
-void updateEEPROM(){
+void storeSettings(){
 #ifdef DEBUG
   Serial.println("E1");
 #endif
 
-  EEPROM.update(EEPROM_STATUS_ADDRESS, 1);
-
-  if(registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] != EEPROM_DISABLE){
-    uint8_t end = REGISTER_END_SETTINGS;
-    if(registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] == EEPROM_ALL)
-      end = REGISTER_MAP_SIZE;
-    for(uint8_t reg = REGISTER_START_SETTINGS; reg < end; reg++){
-      EEPROM.update(reg - REGISTER_START_SETTINGS + EEPROM_START_ADDRESS, registerMap[reg]);
-    }
-  }
+  // Only marks the map as changed: the store writes it once the changes stop for a while
+  if(registerMap[REGISTER_SETTINGS_SAVE_TO_EEPROM] != EEPROM_DISABLE)
+    settingsStore.changed();
 }
 
 void i2cWriteCallback(const uint8_t data[], const uint8_t length){
@@ -292,6 +532,9 @@ void i2cWriteCallback(const uint8_t data[], const uint8_t length){
 
     // If more bytes are transferred: write operation
     if(length > 1){
+      uint8_t last = lastRegister + length - 2;
+      if(last >= REGISTER_MAP_SIZE)
+        return;
 
       // Buffer the readonly regs that can be in between
       uint8_t readOnlyTemp[REGISTER_MAP_NR_READ_ONLY];
@@ -305,6 +548,18 @@ void i2cWriteCallback(const uint8_t data[], const uint8_t length){
         registerMap[readOnlyRegisters[i]] = readOnlyTemp[i];
       }
       registerMapUpdate = true;
+      // A multi-byte frequency only counts once its last byte is in
+      if(lastRegister <= REGISTER_PLL_FREQUENCY_KHZ+3 && last >= REGISTER_PLL_FREQUENCY_KHZ+3){
+        frequencyKHzUpdate = true;
+      }else if(lastRegister <= REGISTER_PLL_FREQUENCY+1 && last >= REGISTER_PLL_FREQUENCY){
+        frequencyMHzUpdate = true;
+      }
+      if(lastRegister <= REGISTER_HOP_LENGTH && last >= REGISTER_HOP_MODE){
+        hopRestart = true;
+      }
+      if(lastRegister <= REGISTER_HOP_ENTRY_KHZ+3 && last >= REGISTER_HOP_ENTRY_KHZ+3){
+        hopUpload = true;
+      }
       // Refresh EEPROM when we wrote things to settings registers
       if(lastRegister < REGISTER_END_SETTINGS || lastRegister + length < REGISTER_END_SETTINGS ){
         registerMapSettingsUpdate = true;
@@ -327,10 +582,125 @@ void i2cReadCallback(void){
   i2c.SlaveQueueNonBlocking(registerMap + lastRegister, size);
 }
 
+uint32_t readRegister32(uint8_t reg){
+  return (uint32_t)registerMap[reg] | (uint32_t)registerMap[reg+1]<<8 | (uint32_t)registerMap[reg+2]<<16 | (uint32_t)registerMap[reg+3]<<24;
+}
+
+void writeRegister32(uint8_t reg, uint32_t value){
+  for(uint8_t i = 0; i < 4; i++){
+    registerMap[reg+i] = value >> (8*i);
+  }
+}
+
+void writeRegister16(uint8_t reg, uint16_t value){
+  registerMap[reg] = value;
+  registerMap[reg+1] = value >> 8;
+}
+
+void updateFrequencyReadback(void){
+  // What the MAX2871 is set to, so hosts can check the LO they got
+  uint32_t actual = max2871.getRFOUTAkHz();
+  MAX2871_Dividers d = max2871.getDividers();
+
+  noInterrupts();
+  writeRegister32(REGISTER_PLL_ACTUAL_FREQUENCY_KHZ, actual);
+  writeRegister16(REGISTER_PLL_DIVIDER_N, d.n);
+  writeRegister16(REGISTER_PLL_DIVIDER_FRAC, d.frac);
+  writeRegister16(REGISTER_PLL_DIVIDER_M, d.m);
+  registerMap[REGISTER_PLL_DIVIDER_DIVA] = d.diva | d.fb<<7;
+  interrupts();
+}
+
+void updateTelemetry(void){
+  noInterrupts();
+  uint32_t time = (lockLatchCount == max2871.getLatchCount()) ? lockTime : LOCK_TIME_PENDING;
+  writeRegister32(REGISTER_TELEMETRY_LOCK_TIME, time);
+  writeRegister16(REGISTER_TELEMETRY_LOCK_LOSSES, lockLosses);
+  interrupts();
+
+  uint32_t age = (millis() - lastTelemetryTime) / 100;
+  registerMap[REGISTER_TELEMETRY_AGE] = (age > 255) ? 255 : age;
+
+  // Sample the MAX2871 ADC every interval, not while an R0 waits for the PPS interrupt (it uses the same SPI lines)
+  uint8_t interval = registerMap[REGISTER_SETTINGS_TELEMETRY_INTERVAL];
+  if(interval == 0 || millis() - lastTelemetryTime < interval*100UL || max2871.latchPending())
+    return;
+
+  // Both return -1 when the ADC conversion is not valid, which no reading scales to
+  uint8_t status = 0;
+  int16_t temperature = TEMPERATURE_INVALID;
+  uint16_t adc = ADC_INVALID;
+  double degrees = max2871.readTEMP();
+  if(degrees == -1)
+    status |= TELEMETRY_TEMPERATURE_INVALID;
+  else
+    temperature = degrees*10;
+  double volts = max2871.readADC();
+  if(volts < 0)
+    status |= TELEMETRY_ADC_INVALID;
+  else
+    adc = volts*1000;
+  uint8_t vco = max2871.readVCO();
+
+  noInterrupts();
+  writeRegister16(REGISTER_TELEMETRY_TEMPERATURE, temperature);
+  writeRegister16(REGISTER_TELEMETRY_ADC, adc);
+  registerMap[REGISTER_TELEMETRY_VCO] = vco;
+  registerMap[REGISTER_TELEMETRY_AGE] = 0;
+  registerMap[REGISTER_TELEMETRY_STATUS] = status;
+  interrupts();
+  lastTelemetryTime = millis();
+}
+
+ISR(PCINT0_vect){
+  uint32_t now = micros();
+  uint16_t latches = max2871.getLatchCount();
+  if(digitalRead(LD)){
+    // First lock after a retune: time it from the R0 write
+    if(latches != lockLatchCount){
+      lockTime = now - max2871.getLatchMicros();
+      lockLatchCount = latches;
+    }
+  }else if(latches == lockLatchCount){
+    // Dropped out of lock without a retune
+    lockLosses++;
+  }
+}
+
+uint8_t solveHopEntry(uint8_t entry){
+  // Same checks as a write to the kHz register
+  HopEntry &e = hopTable[entry];
+  uint16_t reference = (uint16_t) ( registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK] | (uint16_t)registerMap[REGISTER_SETTINGS_PLL_REFERENCE_CLOCK+1]<<8 );
+  uint8_t rdiv = registerMap[REGISTER_SETTINGS_PLL_REFERENCE_DIVIDER];
+  e.dividers.m = 0;
+  if(e.kHz < PLL_FREQUENCY_MIN_KHZ || e.kHz > PLL_FREQUENCY_MAX_KHZ)
+    return PLL_FREQUENCY_OUT_OF_RANGE;
+  if(reference == 0 || rdiv == 0 || !max2871SolveKHz(e.kHz, reference, rdiv, e.dividers))
+    return PLL_FREQUENCY_NO_SOLUTION;
+  return PLL_FREQUENCY_OK;
+}
+
+void latchStaged(void){
+  // Staged frequency change (commit on PPS, hop on an edge): latch R0 on this edge
+  max2871.latch();
+  if(hopStaged != HOP_NONE){
+    hopIndex = hopStaged;
+    hopStaged = HOP_NONE;
+    registerMap[REGISTER_HOP_INDEX] = hopIndex;
+  }
+}
+
 void ppsISR(void){
+  if(hopMode != HOP_ON_TRIGGER)
+    latchStaged();
   ppsHappened = true;
 }
 
+void triggerISR(void){
+  if(hopMode == HOP_ON_TRIGGER)
+    latchStaged();
+}
+
 int find(uint8_t a[], uint8_t size, uint8_t item){
     int i, pos = -1;
     for (i = 0; i < size; i++) {
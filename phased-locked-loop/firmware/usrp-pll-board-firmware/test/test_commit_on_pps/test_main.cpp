@@ -0,0 +1,178 @@
+/*
+ * Commit on PPS and hopping on the PPS edge, on the simulated board (see
+ * sim/ArduinoSim/sim.h), `pio test -e native -f test_commit_on_pps`.
+ *
+ * A staged change must not reach the MAX2871 before the edge, not even the
+ * registers R0 does not latch: with R4, R2 or R1 written early the PLL runs
+ * on a mix of the old and the new setting until the PPS.
+ *
+ * The tests run in order on one board.
+ */
+
+#include <unity.h>
+#include "sim.h"
+
+#define REG_TELEMETRY_INTERVAL  0x0A
+#define REG_POWER               0x10
+#define REG_ENABLE_OUTPUT       0x13
+#define REG_COMMIT_MODE         0x16
+#define REG_COMMIT_PENDING      0x17
+#define REG_FREQUENCY_KHZ       0x20
+#define REG_HOP_MODE            0x40
+#define REG_HOP_INDEX           0x42
+#define REG_HOP_ENTRY           0x44
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void writeByte(const uint8_t reg, const uint8_t value)
+{
+    sim::i2cWrite(reg, &value, 1);
+}
+
+static uint8_t readByte(const uint8_t reg)
+{
+    uint8_t value;
+    sim::i2cRead(reg, &value, 1);
+    return value;
+}
+
+static void writeKHz(const uint32_t khz)
+{
+    uint8_t data[4] = {(uint8_t)khz, (uint8_t)(khz >> 8), (uint8_t)(khz >> 16), (uint8_t)(khz >> 24)};
+    sim::i2cWrite(REG_FREQUENCY_KHZ, data, 4);
+}
+
+static void uploadHop(const uint8_t entry, const uint32_t khz)
+{
+    uint8_t data[8] = {entry, 0, 0, 0, (uint8_t)khz, (uint8_t)(khz >> 8), (uint8_t)(khz >> 16), (uint8_t)(khz >> 24)};
+    sim::i2cWrite(REG_HOP_ENTRY, data, sizeof(data));
+    sim::step();
+}
+
+static uint16_t dividerN(const uint32_t r0)
+{
+    return (r0 >> 15) & 0xFFFF;
+}
+
+// The words since from: written in the interrupt of the edge (the clock only
+// moves on by the SPI transfers there), R5 down to R1, R0 last
+static void assertLatched(const size_t from, const uint32_t edge)
+{
+    TEST_ASSERT_TRUE_MESSAGE(sim::spiWords.size() > from, "nothing written on the edge");
+    uint8_t previous = 6;
+    for(size_t i = from; i < sim::spiWords.size(); i++){
+        uint8_t addr = sim::spiWords[i].word & 0x7;
+        TEST_ASSERT_TRUE_MESSAGE(sim::spiWords[i].time >= edge && sim::spiWords[i].time <= sim::clock_us, "register written outside the edge");
+        TEST_ASSERT_TRUE_MESSAGE(addr < previous, "registers out of order");
+        previous = addr;
+    }
+    TEST_ASSERT_EQUAL_MESSAGE(0, previous, "R0 not written last");
+}
+
+static void test_retune_waits_for_the_edge(void)
+{
+    writeKHz(917250);
+    sim::run(10);
+    writeByte(REG_COMMIT_MODE, 1);
+    sim::run(10);
+
+    // 917.25 -> 2450 MHz changes DIVA, FB and the integer mode bits in R4, R2 and R1
+    size_t from = sim::spiWords.size();
+    writeKHz(2450000);
+    sim::run(2000);
+    TEST_ASSERT_EQUAL_MESSAGE(from, sim::spiWords.size(), "register written before the edge");
+    TEST_ASSERT_EQUAL(1, readByte(REG_COMMIT_PENDING));
+
+    uint32_t edge = sim::clock_us;
+    sim::pps();
+    assertLatched(from, edge);
+    const uint8_t order[] = {4, 2, 1, 0};
+    TEST_ASSERT_EQUAL(sizeof(order), sim::spiWords.size() - from);
+    for(size_t i = 0; i < sizeof(order); i++)
+        TEST_ASSERT_EQUAL(order[i], sim::spiWords[from + i].word & 0x7);
+    TEST_ASSERT_EQUAL(245, dividerN(sim::lastWord(0)));
+
+    sim::run(10);
+    TEST_ASSERT_EQUAL(0, readByte(REG_COMMIT_PENDING));
+}
+
+static void test_new_write_replaces_the_staged_change(void)
+{
+    // 917.25 MHz staged, then replaced by 2400 MHz, which only differs from
+    // the running 2450 MHz in R0
+    size_t from = sim::spiWords.size();
+    writeKHz(917250);
+    sim::run(10);
+    writeKHz(2400000);
+    sim::run(10);
+    TEST_ASSERT_EQUAL_MESSAGE(from, sim::spiWords.size(), "register written before the edge");
+
+    sim::pps();
+    TEST_ASSERT_EQUAL(1, sim::spiWords.size() - from);
+    TEST_ASSERT_EQUAL(0, sim::spiWords[from].word & 0x7);
+    TEST_ASSERT_EQUAL(240, dividerN(sim::spiWords[from].word));
+    sim::run(10);
+}
+
+static void test_output_switch_does_not_wait(void)
+{
+    // nothing staged: the output stage bits of R4 go out at once
+    size_t from = sim::spiWords.size();
+    writeByte(REG_ENABLE_OUTPUT, 0);
+    sim::run(10);
+    TEST_ASSERT_EQUAL(1, sim::spiWords.size() - from);
+    TEST_ASSERT_EQUAL(4, sim::spiWords[from].word & 0x7);
+    TEST_ASSERT_EQUAL(0, readByte(REG_COMMIT_PENDING));
+
+    writeByte(REG_ENABLE_OUTPUT, 1);
+    sim::run(10);
+}
+
+static void test_hops_wait_for_the_edge(void)
+{
+    // entry 3 is fractional, the others integer: 2 -> 3 and 3 -> 0 change R4, R2 and R1 as well
+    const uint32_t hops[] = {2400000, 2420000, 2440000, 2460500};
+    for(uint8_t i = 0; i < 4; i++)
+        uploadHop(i, hops[i]);
+    const uint8_t hopOnPPS[] = {2, 4};  // mode, length
+    sim::i2cWrite(REG_HOP_MODE, hopOnPPS, sizeof(hopOnPPS));
+    sim::run(10);
+
+    for(uint8_t n = 0; n < 6; n++){
+        size_t from = sim::spiWords.size();
+        sim::run(1000);
+        TEST_ASSERT_EQUAL_MESSAGE(from, sim::spiWords.size(), "register written before the edge");
+
+        uint32_t edge = sim::clock_us;
+        sim::pps();
+        TEST_ASSERT_EQUAL(n % 4, readByte(REG_HOP_INDEX));
+        if(n == 4)
+            TEST_ASSERT_EQUAL(4, sim::spiWords.size() - from);
+        if(sim::spiWords.size() > from)
+            assertLatched(from, edge);
+        sim::run(10);
+    }
+
+    writeByte(REG_HOP_MODE, 0);
+    sim::run(10);
+}
+
+int main(int argc, char **argv)
+{
+    sim::begin();
+    sim::run(10);
+    // no register 6 readback in between, every SPI word is a setting
+    writeByte(REG_TELEMETRY_INTERVAL, 0);
+    sim::run(10);
+    const uint8_t operation[] = {1, 900 & 0xFF, 900 >> 8, 1};    // power, 900 MHz, output on
+    sim::i2cWrite(REG_POWER, operation, sizeof(operation));
+    sim::run(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_retune_waits_for_the_edge);
+    RUN_TEST(test_new_write_replaces_the_staged_change);
+    RUN_TEST(test_output_switch_does_not_wait);
+    RUN_TEST(test_hops_wait_for_the_edge);
+    return UNITY_END();
+}
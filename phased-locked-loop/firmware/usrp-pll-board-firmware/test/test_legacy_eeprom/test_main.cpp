@@ -0,0 +1,87 @@
+/*
+ * Migration of the EEPROM left by firmware without the settings store, on the
+ * simulated board (see sim/ArduinoSim/sim.h),
+ * `pio test -e native -f test_legacy_eeprom`.
+ *
+ * That firmware kept a status byte at address 0 and its register map,
+ * 0x00 - 0x15, from address 1. Everything the map has grown since must come
+ * up as on a new board, not as erased EEPROM cells.
+ */
+
+#include <unity.h>
+#include <EEPROM.h>
+#include "sim.h"
+
+#define REG_REFERENCE_CLOCK     0x04
+#define REG_REFERENCE_DIVIDER   0x06
+#define REG_LED_MODE            0x07
+#define REG_TELEMETRY_INTERVAL  0x0A
+#define REG_POWER               0x10
+#define REG_FREQUENCY           0x11
+#define REG_ENABLE_OUTPUT       0x13
+#define REG_COMMIT_MODE         0x16
+#define REG_FREQUENCY_KHZ       0x20
+#define REG_ACTUAL_KHZ          0x24
+#define REG_FREQUENCY_STATUS    0x2F
+#define REG_HOP_MODE            0x40
+
+#define LEGACY_MAP_SIZE         0x16
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void test_whole_legacy_map_migrates(void)
+{
+    uint8_t map[0x48];
+    sim::i2cRead(0x00, map, 0x40);
+    sim::i2cRead(0x40, map + 0x40, 8);
+
+    // the legacy registers as stored
+    TEST_ASSERT_EQUAL(10, map[REG_REFERENCE_CLOCK]);
+    TEST_ASSERT_EQUAL(1, map[REG_REFERENCE_DIVIDER]);
+    TEST_ASSERT_EQUAL(4, map[REG_LED_MODE]);
+    TEST_ASSERT_EQUAL(1, map[REG_POWER]);
+    TEST_ASSERT_EQUAL(900, map[REG_FREQUENCY] | map[REG_FREQUENCY + 1] << 8);
+    TEST_ASSERT_EQUAL(1, map[REG_ENABLE_OUTPUT]);
+
+    // the newer ones at their defaults
+    TEST_ASSERT_EQUAL(10, map[REG_TELEMETRY_INTERVAL]);
+    TEST_ASSERT_EQUAL(0, map[REG_COMMIT_MODE]);
+    TEST_ASSERT_EQUAL_UINT32(0, get32(&map[REG_FREQUENCY_KHZ]));
+    TEST_ASSERT_EQUAL(0, map[REG_HOP_MODE]);
+
+    // so the board runs the stored MHz frequency
+    TEST_ASSERT_EQUAL(0, map[REG_FREQUENCY_STATUS]);
+    TEST_ASSERT_EQUAL_UINT32(900000, get32(&map[REG_ACTUAL_KHZ]));
+}
+
+int main(int argc, char **argv)
+{
+    // EEPROM of the old firmware with EEPROM_ALL: power on at 900 MHz
+    uint8_t legacy[LEGACY_MAP_SIZE] = {0};
+    legacy[0x03] = 2;                       // EEPROM_ALL
+    legacy[REG_REFERENCE_CLOCK] = 10;
+    legacy[REG_REFERENCE_DIVIDER] = 1;
+    legacy[REG_LED_MODE] = 4;
+    legacy[0x08] = 20;
+    legacy[0x09] = 80;
+    legacy[REG_POWER] = 1;
+    legacy[REG_FREQUENCY] = 900 & 0xFF;
+    legacy[REG_FREQUENCY + 1] = 900 >> 8;
+    legacy[REG_ENABLE_OUTPUT] = 1;
+    EEPROM.write(0, 1);
+    for(uint8_t i = 0; i < LEGACY_MAP_SIZE; i++)
+        EEPROM.write(1 + i, legacy[i]);
+
+    sim::begin();
+    sim::run(100);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_legacy_map_migrates);
+    return UNITY_END();
+}
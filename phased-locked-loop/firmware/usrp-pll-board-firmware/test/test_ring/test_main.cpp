@@ -0,0 +1,160 @@
+/*
+ * Host tests of CRing, the nI2C transfer queue, `pio test -e native -f test_ring`.
+ *
+ * The native build ignores lib/nI2C (sim/ArduinoSim stubs it), so the header
+ * is included by path. It has no AVR dependencies off the AVR.
+ */
+
+#include <unity.h>
+#include "../../lib/nI2C/queue.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+struct Transfer     // something wider than a byte, as the nI2C queue holds
+{
+    uint8_t address;
+    uint16_t length;
+    uint32_t tag;
+};
+
+static void test_empty(void)
+{
+    CRing<uint8_t, 4> ring;
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+    TEST_ASSERT_FALSE(ring.IsFull());
+    TEST_ASSERT_EQUAL(0, ring.Size());
+    TEST_ASSERT_EQUAL(4, ring.Vacancy());
+    TEST_ASSERT_NULL(ring.Front());
+
+    // popping an empty ring does nothing
+    ring.Pop();
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+    TEST_ASSERT_EQUAL(0, ring.Size());
+    TEST_ASSERT_TRUE(ring.Push(7));
+    TEST_ASSERT_EQUAL(1, ring.Size());
+    TEST_ASSERT_EQUAL(7, *ring.Front());
+}
+
+static void test_full(void)
+{
+    CRing<uint8_t, 4> ring;
+    for (uint8_t i = 0; i < 4; i++)
+        TEST_ASSERT_TRUE(ring.Push(i));
+    TEST_ASSERT_TRUE(ring.IsFull());
+    TEST_ASSERT_EQUAL(0, ring.Vacancy());
+    TEST_ASSERT_EQUAL(0, ring.Dropped());
+
+    // refused and counted, the queued elements stay as they are
+    TEST_ASSERT_FALSE(ring.Push(99));
+    TEST_ASSERT_EQUAL(1, ring.Dropped());
+    TEST_ASSERT_EQUAL(4, ring.Size());
+    for (uint8_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(i, *ring.Front());
+        ring.Pop();
+    }
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+
+    // room again after a pop
+    for (uint8_t i = 0; i < 4; i++)
+        ring.Push(i);
+    ring.Pop();
+    TEST_ASSERT_TRUE(ring.Push(4));
+    TEST_ASSERT_EQUAL(1, ring.Dropped());
+}
+
+static void test_dropped_saturates(void)
+{
+    CRing<uint8_t, 2> ring;
+    ring.Push(0);
+    ring.Push(1);
+    for (uint16_t i = 0; i < 300; i++)
+        TEST_ASSERT_FALSE(ring.Push(2));
+    TEST_ASSERT_EQUAL(255, ring.Dropped());
+}
+
+// FIFO order over many laps, so the free-running 8-bit head and tail wrap
+// around as well as the masked positions
+static void test_wrap_around(void)
+{
+    CRing<Transfer, 8> ring;
+    uint32_t pushed = 0, popped = 0;
+    for (uint16_t round = 0; round < 1000; round++) {
+        // fill up to a level that changes every round, drain part of it
+        uint8_t level = round % 9;
+        uint8_t expected = (ring.Size() > level) ? ring.Size() : level;
+        while (ring.Size() < level) {
+            Transfer t = {(uint8_t)pushed, (uint16_t)(pushed * 3), pushed};
+            TEST_ASSERT_TRUE(ring.Push(t));
+            pushed++;
+        }
+        TEST_ASSERT_EQUAL(expected, ring.Size());
+        TEST_ASSERT_EQUAL(8 - expected, ring.Vacancy());
+        TEST_ASSERT_EQUAL(expected == 8, ring.IsFull());
+
+        uint8_t drain = round % 5;
+        while (drain-- > 0 && !ring.IsEmpty()) {
+            Transfer *t = ring.Front();
+            TEST_ASSERT_NOT_NULL(t);
+            TEST_ASSERT_EQUAL_UINT32(popped, t->tag);
+            TEST_ASSERT_EQUAL((uint8_t)popped, t->address);
+            TEST_ASSERT_EQUAL((uint16_t)(popped * 3), t->length);
+            ring.Pop();
+            popped++;
+        }
+    }
+    TEST_ASSERT_TRUE(pushed > 1000);
+    TEST_ASSERT_EQUAL(pushed - popped, ring.Size());
+    TEST_ASSERT_EQUAL(0, ring.Dropped());
+}
+
+// At the largest capacity, full is 128 elements apart on 8-bit counters
+static void test_largest_capacity(void)
+{
+    CRing<uint8_t, 128> ring;
+    for (uint16_t lap = 0; lap < 3; lap++) {
+        for (uint16_t i = 0; i < 128; i++)
+            TEST_ASSERT_TRUE(ring.Push((uint8_t)(lap + i)));
+        TEST_ASSERT_TRUE(ring.IsFull());
+        TEST_ASSERT_FALSE(ring.IsEmpty());
+        TEST_ASSERT_EQUAL(128, ring.Size());
+        TEST_ASSERT_FALSE(ring.Push(0));
+        for (uint16_t i = 0; i < 128; i++) {
+            TEST_ASSERT_EQUAL((uint8_t)(lap + i), *ring.Front());
+            ring.Pop();
+        }
+        TEST_ASSERT_TRUE(ring.IsEmpty());
+        // 100 more in and out, so the next lap starts off the masked origin
+        for (uint8_t i = 0; i < 100; i++) {
+            ring.Push(i);
+            ring.Pop();
+        }
+    }
+    TEST_ASSERT_EQUAL(3, ring.Dropped());
+}
+
+static void test_clear(void)
+{
+    CRing<uint8_t, 4> ring;
+    ring.Push(1);
+    ring.Push(2);
+    ring.Pop();
+    ring.Clear();
+    TEST_ASSERT_TRUE(ring.IsEmpty());
+    TEST_ASSERT_NULL(ring.Front());
+    TEST_ASSERT_EQUAL(4, ring.Vacancy());
+    TEST_ASSERT_TRUE(ring.Push(3));
+    TEST_ASSERT_EQUAL(3, *ring.Front());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_full);
+    RUN_TEST(test_dropped_saturates);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_largest_capacity);
+    RUN_TEST(test_clear);
+    return UNITY_END();
+}
@@ -0,0 +1,82 @@
+/*
+ * Host tests of the MAX2871 divider solvers, `pio test -e native -f test_solver`.
+ *
+ * max2871Solve() replaced the floating point solver of setRFOUTA, so it has
+ * to give the same registers for every whole MHz input.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include "MAX2871_solver.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool sameDividers(const MAX2871_Dividers &a, const MAX2871_Dividers &b)
+{
+    return a.n == b.n && a.frac == b.frac && a.m == b.m && a.diva == b.diva && a.fb == b.fb;
+}
+
+// Every RFOUTA frequency from 24 MHz to 6 GHz, for the reference clocks and
+// dividers the register bank accepts in practice
+static void test_integer_solver_matches_reference(void)
+{
+    const uint16_t refs[] = {10, 19, 20, 25, 26, 30, 40, 50, 61, 100, 122, 200};
+    uint32_t checked = 0;
+    for (uint16_t ref : refs) {
+        for (uint16_t rdiv = 1; rdiv <= 8; rdiv++) {
+            for (uint16_t freq = 24; freq <= 6000; freq++) {
+                MAX2871_Dividers got = max2871Solve(freq, ref, rdiv);
+                MAX2871_Dividers want = max2871SolveReference<double>(freq, (double)ref / rdiv);
+                if (!sameDividers(got, want)) {
+                    char msg[160];
+                    snprintf(msg, sizeof(msg), "%u MHz, REF %u MHz, R %u: N %u F %u DIVA %u FB %u, reference N %u F %u DIVA %u FB %u",
+                             freq, ref, rdiv, got.n, got.frac, got.diva, got.fb, want.n, want.frac, want.diva, want.fb);
+                    TEST_FAIL_MESSAGE(msg);
+                }
+                checked++;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(12UL * 8 * 5977, checked);
+}
+
+// Whole MHz from 10 MHz are all exact. From 30 to 150 MHz N drops below 16
+// with the divided output fed back, so the VCO has to stay in the loop.
+static void test_khz_solver_whole_mhz(void)
+{
+    for (uint32_t freq = 24000; freq <= 6000000; freq += 1000) {
+        MAX2871_Dividers d;
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%lu kHz", (unsigned long)freq);
+        TEST_ASSERT_TRUE_MESSAGE(max2871SolveKHz(freq, 10, 1, d), msg);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(freq, max2871FrequencyKHz(d, 10, 1), msg);
+    }
+
+    const uint32_t low[] = {30000, 40000, 50000, 60000, 70000, 80000, 90000, 100000, 110000, 120000, 130000, 140000, 150000};
+    for (uint32_t freq : low) {
+        MAX2871_Dividers d;
+        TEST_ASSERT_TRUE(max2871SolveKHz(freq, 10, 1, d));
+        TEST_ASSERT_EQUAL(1, d.fb);
+        TEST_ASSERT_EQUAL_UINT32(freq, max2871FrequencyKHz(d, 10, 1));
+    }
+
+    // 100 MHz: VCO at 3.2 GHz, DIVA 32
+    MAX2871_Dividers d;
+    TEST_ASSERT_TRUE(max2871SolveKHz(100000, 10, 1, d));
+    TEST_ASSERT_EQUAL(320, d.n);
+    TEST_ASSERT_EQUAL(5, d.diva);
+
+    // 2.45 GHz keeps the divided output in the loop
+    TEST_ASSERT_TRUE(max2871SolveKHz(2450000, 10, 1, d));
+    TEST_ASSERT_EQUAL(245, d.n);
+    TEST_ASSERT_EQUAL(0, d.fb);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_integer_solver_matches_reference);
+    RUN_TEST(test_khz_solver_whole_mhz);
+    return UNITY_END();
+}
@@ -0,0 +1,170 @@
+/*
+ * MAX2871 register writes over the hardware SPI peripheral, on the simulated
+ * board (see sim/ArduinoSim/sim.h), `pio test -e native -f test_spi_order`.
+ *
+ * Checks the order of the register words, that the words of one update go
+ * out back to back (32 SPI clocks each, 4 us in the simulator), and the
+ * timing from the R0 latch: the lock time is counted from the R0 word, and
+ * with commit on PPS the whole set goes out on the edge.
+ *
+ * The tests run in order on one board.
+ */
+
+#include <unity.h>
+#include "sim.h"
+
+#define REG_TELEMETRY_INTERVAL  0x0A
+#define REG_POWER               0x10
+#define REG_ENABLE_OUTPUT       0x13
+#define REG_COMMIT_MODE         0x16
+#define REG_FREQUENCY_KHZ       0x20
+#define REG_LOCK_TIME           0x30
+
+#define WORD_US                 4   // one 32 bit word at 8 MHz, see SPIClass::transfer()
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void writeByte(const uint8_t reg, const uint8_t value)
+{
+    sim::i2cWrite(reg, &value, 1);
+}
+
+static void writeKHz(const uint32_t khz)
+{
+    uint8_t data[4] = {(uint8_t)khz, (uint8_t)(khz >> 8), (uint8_t)(khz >> 16), (uint8_t)(khz >> 24)};
+    sim::i2cWrite(REG_FREQUENCY_KHZ, data, 4);
+}
+
+static uint32_t lockTime(void)
+{
+    uint8_t data[4];
+    sim::i2cRead(REG_LOCK_TIME, data, 4);
+    return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// The words since from are exactly these registers, back to back
+static void assertWords(const size_t from, const uint8_t *addrs, const size_t count)
+{
+    TEST_ASSERT_EQUAL(count, sim::spiWords.size() - from);
+    for(size_t i = 0; i < count; i++){
+        TEST_ASSERT_EQUAL(addrs[i], sim::spiWords[from + i].word & 0x7);
+        if(i > 0)
+            TEST_ASSERT_EQUAL_UINT32(WORD_US, sim::spiWords[from + i].time - sim::spiWords[from + i - 1].time);
+    }
+}
+
+static void test_setup_writes_every_register_twice(void)
+{
+    // begin(): R5 down to R0, 20 ms, the same again
+    TEST_ASSERT_TRUE(sim::spiWords.size() >= 12);
+    for(size_t i = 0; i < 12; i++){
+        TEST_ASSERT_EQUAL(5 - i % 6, sim::spiWords[i].word & 0x7);
+        if(i > 0 && i != 6)
+            TEST_ASSERT_EQUAL_UINT32(WORD_US, sim::spiWords[i].time - sim::spiWords[i - 1].time);
+    }
+    TEST_ASSERT_EQUAL_UINT32(20000 + WORD_US, sim::spiWords[6].time - sim::spiWords[5].time);
+}
+
+static void test_fractional_retune_with_diva_change(void)
+{
+    // 900 MHz (integer) -> 917.25 MHz (fractional, VCO fed back): R4 (FB),
+    // R2 (LDF), R1 (CPL), then R0
+    sim::setLockDetect(false);
+    size_t from = sim::spiWords.size();
+    writeKHz(917250);
+    sim::step(0);
+    const uint8_t order[] = {4, 2, 1, 0};
+    assertWords(from, order, sizeof(order));
+
+    // lock time counts from the R0 word
+    uint32_t r0 = sim::spiWords.back().time;
+    sim::clock_us = r0 + 180;
+    sim::setLockDetect(true);
+    sim::run(10);
+    TEST_ASSERT_EQUAL_UINT32(180, lockTime());
+}
+
+static void test_fractional_step_writes_r0_only(void)
+{
+    size_t from = sim::spiWords.size();
+    writeKHz(917300);
+    sim::run(10);
+    const uint8_t order[] = {0};
+    assertWords(from, order, sizeof(order));
+}
+
+static void test_output_off_writes_r4_only(void)
+{
+    size_t from = sim::spiWords.size();
+    writeByte(REG_ENABLE_OUTPUT, 0);
+    sim::run(10);
+    const uint8_t order[] = {4};
+    assertWords(from, order, sizeof(order));
+
+    writeByte(REG_ENABLE_OUTPUT, 1);
+    sim::run(10);
+}
+
+static void test_latch_to_latch_on_pps(void)
+{
+    writeByte(REG_COMMIT_MODE, 1);
+    sim::run(10);
+
+    // 917.3 -> 2450 MHz on one edge, 2400 MHz on the next, 1 s later
+    const uint32_t khz[] = {2450000, 2400000};
+    const uint8_t first[] = {4, 2, 1, 0};
+    const uint8_t second[] = {0};
+    uint32_t latches[2];
+    for(uint8_t i = 0; i < 2; i++){
+        writeKHz(khz[i]);
+        sim::run(10);
+        sim::setLockDetect(false);
+
+        size_t from = sim::spiWords.size();
+        uint32_t edge = 1000000UL * (sim::clock_us / 1000000UL + 1);
+        sim::run((edge - sim::clock_us) / 1000);
+        sim::clock_us = edge;
+        sim::pps();
+        if(i == 0)
+            assertWords(from, first, sizeof(first));
+        else
+            assertWords(from, second, sizeof(second));
+
+        // the set goes out in the interrupt of the edge, R0 last
+        latches[i] = sim::spiWords.back().time;
+        TEST_ASSERT_EQUAL_UINT32((sim::spiWords.size() - from) * WORD_US, latches[i] - edge);
+
+        sim::clock_us = latches[i] + 250;
+        sim::setLockDetect(true);
+        sim::run(10);
+        TEST_ASSERT_EQUAL_UINT32(250, lockTime());
+    }
+    // one edge apart, less the R4 R2 R1 words the first edge wrote before R0
+    TEST_ASSERT_EQUAL_UINT32(1000000UL - 3 * WORD_US, latches[1] - latches[0]);
+
+    writeByte(REG_COMMIT_MODE, 0);
+    sim::run(10);
+}
+
+int main(int argc, char **argv)
+{
+    sim::begin();
+    sim::run(10);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_setup_writes_every_register_twice);
+
+    // no register 6 readback in between, every SPI word is a setting
+    writeByte(REG_TELEMETRY_INTERVAL, 0);
+    sim::run(10);
+    const uint8_t operation[] = {1, 900 & 0xFF, 900 >> 8, 1};    // power, 900 MHz, output on
+    sim::i2cWrite(REG_POWER, operation, sizeof(operation));
+    sim::run(10);
+
+    RUN_TEST(test_fractional_retune_with_diva_change);
+    RUN_TEST(test_fractional_step_writes_r0_only);
+    RUN_TEST(test_output_off_writes_r4_only);
+    RUN_TEST(test_latch_to_latch_on_pps);
+    return UNITY_END();
+}
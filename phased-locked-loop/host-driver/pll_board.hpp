@@ -0,0 +1,679 @@
+// Host driver for the Techtile PLL board (usrp-pll-board-firmware) over Linux i2c-dev.
+//
+// Where pll.py does one I2C transaction per register, a board here is
+// configured with one write transaction (0x03 - 0x23, the firmware keeps its
+// read-only bytes) and read back with one write/read transaction of 0x00 -
+// 0x3C. A hop table is uploaded with one transaction per entry. A rack runs the boards of every bus in parallel, one thread per
+// bus; the boards on one bus share it and go one after the other.
+//
+//      pll::i2c_dev_bus bus("/dev/i2c-1");
+//      pll::rack rack;
+//      rack.add(bus, 0x2F);
+//      pll::config config;
+//      config.frequency_khz = 917000;
+//      rack.configure(config);
+//      for (const pll::status &s : rack.read_status()) ...
+//
+// mock_bus emulates the register map of any number of boards without
+// hardware, with the firmware's read-only bytes, transfer size limit and
+// frequency handling (the divider solver of the firmware, MAX2871_solver.h),
+// the hop table, and counts transactions and bus time. pll_board_test.cpp
+// checks the transactions of board against it.
+
+#ifndef PLL_BOARD_HPP
+#define PLL_BOARD_HPP
+
+#include <boost/format.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "MAX2871_solver.h"
+
+namespace pll
+{
+
+// Register bank, as in usrp-pll-board-firmware/src/main.cpp
+namespace reg
+{
+constexpr uint8_t device_id = 0x00;
+constexpr uint8_t hardware_version = 0x01;
+constexpr uint8_t firmware_version = 0x02;
+constexpr uint8_t save_to_eeprom = 0x03;
+constexpr uint8_t reference_clock = 0x04; // uint16, MHz
+constexpr uint8_t reference_divider = 0x06;
+constexpr uint8_t led_mode = 0x07;
+constexpr uint8_t led_blink_on_time = 0x08;  // *10 ms
+constexpr uint8_t led_blink_off_time = 0x09; // *10 ms
+constexpr uint8_t telemetry_interval = 0x0A; // *100 ms
+
+constexpr uint8_t power = 0x10;
+constexpr uint8_t frequency = 0x11; // uint16, MHz
+constexpr uint8_t enable_output = 0x13;
+constexpr uint8_t lock_detected = 0x14; // read only
+constexpr uint8_t mode = 0x15;          // read only
+constexpr uint8_t commit_mode = 0x16;
+constexpr uint8_t commit_pending = 0x17; // read only
+constexpr uint8_t eeprom_commit = 0x18;  // 1: store now
+constexpr uint8_t eeprom_status = 0x19;  // read only, 0: stored, 1: pending, 2: writing
+
+constexpr uint8_t frequency_khz = 0x20;        // uint32, applied when 0x23 is written
+constexpr uint8_t actual_frequency_khz = 0x24; // uint32, read only
+constexpr uint8_t divider_n = 0x28;            // uint16, read only
+constexpr uint8_t divider_frac = 0x2A;         // uint16, read only
+constexpr uint8_t divider_m = 0x2C;            // uint16, read only
+constexpr uint8_t divider_diva = 0x2E;         // read only, bit 7: FB
+constexpr uint8_t frequency_status = 0x2F;     // read only
+
+constexpr uint8_t lock_time = 0x30;   // uint32, us, read only
+constexpr uint8_t lock_losses = 0x34; // uint16, read only
+constexpr uint8_t temperature = 0x36; // int16, 0.1 degC, read only
+constexpr uint8_t adc = 0x38;         // uint16, mV, read only
+constexpr uint8_t vco = 0x3A;         // read only
+constexpr uint8_t telemetry_age = 0x3B; // *100 ms, read only
+constexpr uint8_t telemetry_status = 0x3C; // telemetry_* flags, read only
+
+constexpr uint8_t hop_mode = 0x40;         // 0: off, 1: on strobe, 2: on PPS, 3: on trigger
+constexpr uint8_t hop_length = 0x41;
+constexpr uint8_t hop_index = 0x42;        // read only, 0xFF before the first hop
+constexpr uint8_t hop_step = 0x43;         // 1: next entry (on strobe)
+constexpr uint8_t hop_entry = 0x44;        // entry to upload, +1 after each upload
+constexpr uint8_t hop_entry_status = 0x45; // read only, frequency_status of the last upload
+constexpr uint8_t hop_entry_khz = 0x48;    // uint32, uploaded when 0x4B is written
+
+constexpr size_t status_size = telemetry_status + 1; // read by board::read_status()
+constexpr size_t map_size = hop_entry_khz + 4;
+
+// the configuration block written by board::configure()
+constexpr uint8_t config_first = save_to_eeprom;
+constexpr uint8_t config_last = frequency_khz + 3;
+
+inline bool read_only(uint8_t r)
+{
+        return r == lock_detected || r == mode || r == commit_pending || r == eeprom_status ||
+               (r >= actual_frequency_khz && r < status_size) || r == hop_index || r == hop_entry_status;
+}
+} // namespace reg
+
+constexpr uint32_t lock_time_pending = 0xFFFFFFFF;
+
+// reg::telemetry_status, the value is not valid (status::temperature / adc are NaN)
+constexpr uint8_t telemetry_temperature_invalid = 0x01;
+constexpr uint8_t telemetry_adc_invalid = 0x02;
+
+// range the firmware accepts (FREQUENCY_STATUS 1 outside)
+constexpr uint32_t frequency_min_khz = 23500;
+constexpr uint32_t frequency_max_khz = 6000000;
+
+enum class hop_on : uint8_t
+{
+        off = 0,
+        strobe = 1,
+        pps = 2,
+        trigger = 3
+};
+constexpr size_t hop_table_size = 32;
+constexpr uint8_t hop_none = 0xFF;
+// the board solves an uploaded entry in its next loop() pass
+constexpr std::chrono::milliseconds hop_upload_timeout(100);
+
+// SIZE_BUFFER in nTWI.h: register address plus data of one transaction
+constexpr size_t max_transfer = 64;
+
+typedef std::array<uint8_t, reg::map_size> register_map;
+
+inline uint16_t get16(const uint8_t *p) { return uint16_t(p[0] | p[1] << 8); }
+inline uint32_t get32(const uint8_t *p) { return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24; }
+inline void put16(uint8_t *p, uint16_t v)
+{
+        p[0] = v;
+        p[1] = v >> 8;
+}
+inline void put32(uint8_t *p, uint32_t v)
+{
+        for (size_t i = 0; i < 4; i++)
+                p[i] = v >> (8 * i);
+}
+
+class bus
+{
+public:
+        virtual ~bus() = default;
+
+        // one transaction: register address followed by the data
+        virtual void write(uint8_t address, uint8_t r, const uint8_t *data, size_t len) = 0;
+
+        // one transaction: register address, repeated start, len bytes read
+        virtual void read(uint8_t address, uint8_t r, uint8_t *data, size_t len) = 0;
+
+        virtual std::string name() const = 0;
+};
+
+class i2c_dev_bus : public bus
+{
+public:
+        explicit i2c_dev_bus(const std::string &device) : _device(device)
+        {
+                _fd = open(device.c_str(), O_RDWR);
+                if (_fd < 0)
+                        throw std::runtime_error("Could not open " + device + ": " + std::strerror(errno));
+        }
+
+        ~i2c_dev_bus() override { close(_fd); }
+
+        i2c_dev_bus(const i2c_dev_bus &) = delete;
+        i2c_dev_bus &operator=(const i2c_dev_bus &) = delete;
+
+        void write(uint8_t address, uint8_t r, const uint8_t *data, size_t len) override
+        {
+                uint8_t buf[max_transfer];
+                if (len + 1 > max_transfer)
+                        throw std::runtime_error("I2C write too long");
+                buf[0] = r;
+                std::memcpy(buf + 1, data, len);
+                i2c_msg msg{address, 0, uint16_t(len + 1), buf};
+                transfer(address, &msg, 1);
+        }
+
+        void read(uint8_t address, uint8_t r, uint8_t *data, size_t len) override
+        {
+                i2c_msg msgs[2] = {{address, 0, 1, &r}, {address, I2C_M_RD, uint16_t(len), data}};
+                transfer(address, msgs, 2);
+        }
+
+        std::string name() const override { return _device; }
+
+private:
+        void transfer(uint8_t address, i2c_msg *msgs, size_t n)
+        {
+                i2c_rdwr_ioctl_data xfer{msgs, uint32_t(n)};
+                if (ioctl(_fd, I2C_RDWR, &xfer) < 0)
+                        throw std::runtime_error(str(boost::format("I2C transfer to 0x%02X on %s failed: %s") % int(address) %
+                                                     _device % std::strerror(errno)));
+        }
+
+        std::string _device;
+        int _fd;
+};
+
+// Boards emulated in memory. bus_time() adds up the wire time of every
+// transaction at the given clock (9 clocks per byte plus start/stop).
+class mock_bus : public bus
+{
+public:
+        explicit mock_bus(const std::string &name = "mock", double clock = 100e3) : _name(name), _clock(clock) {}
+
+        void add_board(uint8_t address)
+        {
+                register_map &map = _boards[address];
+                map.fill(0);
+                put16(&map[reg::reference_clock], 10);
+                map[reg::reference_divider] = 1;
+                put32(&map[reg::lock_time], lock_time_pending);
+                map[reg::hop_index] = hop_none;
+                _hops[address] = hop_state();
+        }
+
+        // Edges on the PPS and trigger inputs of every board on the bus
+        void pps() { edge(hop_on::pps); }
+        void trigger() { edge(hop_on::trigger); }
+
+        register_map &board_map(uint8_t address) { return find(address); }
+
+        void write(uint8_t address, uint8_t r, const uint8_t *data, size_t len) override
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                count(len + 1);
+                register_map &map = find(address);
+                if (len + 1 > max_transfer || r + len > reg::map_size)
+                        throw std::runtime_error("Mock I2C write out of range");
+                for (size_t i = 0; i < len; i++)
+                        if (!reg::read_only(r + i))
+                                map[r + i] = data[i];
+                map[reg::eeprom_commit] = 0; // taken at once, nothing to store
+                size_t last = r + len - 1;
+                auto wrote = [&](uint8_t first, uint8_t end)
+                { return r <= end && last >= first; };
+                hop_state &hops = _hops[address];
+
+                // hop table handling of the firmware
+                if (wrote(reg::hop_entry_khz + 3, reg::hop_entry_khz + 3))
+                {
+                        uint8_t entry = map[reg::hop_entry];
+                        uint8_t status = 1;
+                        if (entry < hop_table_size)
+                        {
+                                hops.khz[entry] = get32(&map[reg::hop_entry_khz]);
+                                MAX2871_Dividers d;
+                                status = solve(map, hops.khz[entry], d);
+                        }
+                        map[reg::hop_entry_status] = status;
+                        map[reg::hop_entry] = entry + 1;
+                }
+                if (wrote(reg::hop_mode, reg::hop_length))
+                {
+                        hops.length = std::min<size_t>(map[reg::hop_length], hop_table_size);
+                        hops.mode = (map[reg::hop_mode] > uint8_t(hop_on::trigger) || hops.length == 0)
+                                            ? hop_on::off
+                                            : hop_on(map[reg::hop_mode]);
+                        hops.next = 0;
+                        map[reg::hop_index] = hop_none;
+                        if (hops.mode == hop_on::strobe)
+                                hop(map, hops);
+                }
+                if (map[reg::hop_step] > 0)
+                {
+                        map[reg::hop_step] = 0;
+                        if (hops.mode == hop_on::strobe)
+                                hop(map, hops);
+                }
+                if (hops.mode != hop_on::off)
+                {
+                        map[reg::frequency_status] = 0;
+                        return;
+                }
+
+                // frequency handling of the firmware: kHz once 0x23 is in, else MHz
+                uint32_t khz = 0;
+                if (wrote(reg::frequency_khz + 3, reg::frequency_khz + 3))
+                        khz = get32(&map[reg::frequency_khz]);
+                else if (wrote(reg::frequency, reg::frequency + 1))
+                {
+                        put32(&map[reg::frequency_khz], 0);
+                        khz = get16(&map[reg::frequency]) * 1000;
+                }
+                else
+                        return;
+                MAX2871_Dividers d;
+                map[reg::frequency_status] = solve(map, khz, d);
+                if (map[reg::frequency_status] == 0)
+                {
+                        tune(map, d);
+                        map[reg::commit_pending] = map[reg::commit_mode];
+                }
+        }
+
+        void read(uint8_t address, uint8_t r, uint8_t *data, size_t len) override
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                count(len + 2); // register address, repeated start and address
+                register_map &map = find(address);
+                if (len > max_transfer || r + len > reg::map_size)
+                        throw std::runtime_error("Mock I2C read out of range");
+                std::memcpy(data, &map[r], len);
+        }
+
+        std::string name() const override { return _name; }
+
+        size_t transactions() const { return _transactions; }
+        double bus_time() const { return _bits / _clock; }
+
+private:
+        struct hop_state
+        {
+                hop_on mode = hop_on::off;
+                size_t length = 0;
+                size_t next = 0;
+                std::array<uint32_t, hop_table_size> khz{};
+        };
+
+        // FREQUENCY_STATUS of khz: 0 ok, 1 out of range, 2 no divider setting
+        static uint8_t solve(const register_map &map, uint32_t khz, MAX2871_Dividers &d)
+        {
+                uint16_t ref = get16(&map[reg::reference_clock]);
+                uint8_t rdiv = map[reg::reference_divider];
+                if (khz < frequency_min_khz || khz > frequency_max_khz)
+                        return 1;
+                return (ref && rdiv && max2871SolveKHz(khz, ref, rdiv, d)) ? 0 : 2;
+        }
+
+        // the readback registers after a retune
+        static void tune(register_map &map, const MAX2871_Dividers &d)
+        {
+                uint16_t ref = get16(&map[reg::reference_clock]);
+                uint8_t rdiv = map[reg::reference_divider];
+                put32(&map[reg::actual_frequency_khz], max2871FrequencyKHz(d, ref, rdiv));
+                put16(&map[reg::divider_n], d.n);
+                put16(&map[reg::divider_frac], d.frac);
+                put16(&map[reg::divider_m], d.m);
+                map[reg::divider_diva] = d.diva | d.fb << 7;
+                map[reg::mode] = d.frac == 0;
+                map[reg::lock_detected] = map[reg::power];
+        }
+
+        // next entry of the table, one without a valid setting keeps the frequency
+        static void hop(register_map &map, hop_state &hops)
+        {
+                MAX2871_Dividers d;
+                if (solve(map, hops.khz[hops.next], d) == 0)
+                        tune(map, d);
+                map[reg::hop_index] = hops.next;
+                hops.next = (hops.next + 1 < hops.length) ? hops.next + 1 : 0;
+        }
+
+        void edge(hop_on source)
+        {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (auto &entry : _boards)
+                {
+                        hop_state &hops = _hops[entry.first];
+                        if (hops.mode == source)
+                                hop(entry.second, hops);
+                }
+        }
+
+        register_map &find(uint8_t address)
+        {
+                auto it = _boards.find(address);
+                if (it == _boards.end())
+                        throw std::runtime_error(str(boost::format("No board at 0x%02X on %s (NACK)") % int(address) % _name));
+                return it->second;
+        }
+
+        // bytes after the address byte
+        void count(size_t bytes)
+        {
+                _transactions++;
+                _bits += 9 * (bytes + 1) + 2;
+        }
+
+        std::string _name;
+        double _clock;
+        std::map<uint8_t, register_map> _boards;
+        std::map<uint8_t, hop_state> _hops;
+        std::mutex _mutex;
+        size_t _transactions = 0;
+        double _bits = 0;
+};
+
+struct config
+{
+        uint8_t save_to_eeprom = 1; // 0: off, 1: settings, 2: everything
+        uint16_t reference_mhz = 10;
+        uint8_t reference_divider = 1;
+        uint8_t led_mode = 2;
+        uint16_t led_on_ms = 200;
+        uint16_t led_off_ms = 800;
+        uint16_t telemetry_interval_ms = 1000;
+        bool power = true;
+        uint32_t frequency_khz = 0;
+        bool output = true;
+        bool commit_on_pps = false;
+};
+
+struct status
+{
+        uint8_t address = 0;
+        std::string bus;
+        uint8_t device_id = 0;
+        uint8_t hardware_version = 0;
+        uint8_t firmware_version = 0;
+
+        bool power = false;
+        bool output = false;
+        bool locked = false;
+        bool integer_mode = false;
+        bool commit_pending = false;
+        uint8_t eeprom_status = 0;
+        uint16_t frequency_mhz = 0;
+        uint32_t frequency_khz = 0;
+        uint32_t actual_khz = 0;
+        uint16_t n = 0, frac = 0, m = 0;
+        uint8_t diva = 0, fb = 0;
+        uint8_t frequency_status = 0;
+
+        uint32_t lock_time_us = lock_time_pending;
+        uint16_t lock_losses = 0;
+        double temperature = 0.0; // degC, NaN when not valid
+        double adc = 0.0;         // V, NaN when not valid
+        uint8_t vco = 0;
+        uint32_t telemetry_age_ms = 0;
+};
+
+class board
+{
+public:
+        board(bus &b, uint8_t address) : _bus(b), _address(address) {}
+
+        uint8_t address() const { return _address; }
+        bus &get_bus() const { return _bus; }
+
+        // The whole configuration in one write transaction
+        void configure(const config &c)
+        {
+                // the frequency is part of the block, so it has to be valid
+                check_frequency(c.frequency_khz);
+                uint8_t block[reg::config_last - reg::config_first + 1] = {0};
+                auto at = [&](uint8_t r)
+                { return &block[r - reg::config_first]; };
+
+                *at(reg::save_to_eeprom) = c.save_to_eeprom;
+                put16(at(reg::reference_clock), c.reference_mhz);
+                *at(reg::reference_divider) = c.reference_divider;
+                *at(reg::led_mode) = c.led_mode;
+                *at(reg::led_blink_on_time) = c.led_on_ms / 10;
+                *at(reg::led_blink_off_time) = c.led_off_ms / 10;
+                *at(reg::telemetry_interval) = c.telemetry_interval_ms / 100;
+                *at(reg::power) = c.power;
+                // the firmware takes the kHz register since its last byte is in the same write
+                put16(at(reg::frequency), c.frequency_khz / 1000);
+                *at(reg::enable_output) = c.output;
+                *at(reg::commit_mode) = c.commit_on_pps;
+                put32(at(reg::frequency_khz), c.frequency_khz);
+
+                _bus.write(_address, reg::config_first, block, sizeof(block));
+        }
+
+        void set_frequency_khz(uint32_t khz)
+        {
+                check_frequency(khz);
+                uint8_t data[4];
+                put32(data, khz);
+                _bus.write(_address, reg::frequency_khz, data, sizeof(data));
+        }
+
+        // Uploads the table one entry per transaction, each checked once the board took it
+        void upload_hops(const std::vector<uint32_t> &khz)
+        {
+                if (khz.size() > hop_table_size)
+                        throw std::runtime_error(str(boost::format("Hop table of %d entries, the board takes %d") % khz.size() %
+                                                     hop_table_size));
+                for (size_t i = 0; i < khz.size(); i++)
+                {
+                        check_frequency(khz[i]);
+                        uint8_t data[reg::hop_entry_khz + 4 - reg::hop_entry] = {uint8_t(i)};
+                        put32(&data[reg::hop_entry_khz - reg::hop_entry], khz[i]);
+                        _bus.write(_address, reg::hop_entry, data, sizeof(data));
+
+                        // entry and status, the entry moves on once loop() solved it
+                        uint8_t taken[2] = {0};
+                        auto deadline = std::chrono::steady_clock::now() + hop_upload_timeout;
+                        while (true)
+                        {
+                                _bus.read(_address, reg::hop_entry, taken, sizeof(taken));
+                                if (taken[0] == i + 1 || std::chrono::steady_clock::now() > deadline)
+                                        break;
+                                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                        if (taken[0] != i + 1)
+                                throw std::runtime_error(str(boost::format("Board 0x%02X did not take hop entry %d") % int(_address) % i));
+                        if (taken[1] != 0)
+                                throw std::runtime_error(str(boost::format("Hop entry %d (%d kHz) has no valid divider setting") % i %
+                                                             khz[i]));
+                }
+        }
+
+        // Starts at entry 0, hop_on::off goes back to the frequency registers
+        void start_hops(hop_on mode, size_t length)
+        {
+                uint8_t data[2] = {uint8_t(mode), uint8_t(length)};
+                _bus.write(_address, reg::hop_mode, data, sizeof(data));
+        }
+
+        void hop_step()
+        {
+                const uint8_t step = 1;
+                _bus.write(_address, reg::hop_step, &step, 1);
+        }
+
+        uint8_t hop_index()
+        {
+                uint8_t index;
+                _bus.read(_address, reg::hop_index, &index, 1);
+                return index;
+        }
+
+        // 0x00 - 0x3C, the hop table registers stay 0
+        register_map read_map()
+        {
+                register_map map{};
+                _bus.read(_address, 0, map.data(), reg::status_size);
+                return map;
+        }
+
+        // Settings, PLL and telemetry registers in one write/read transaction
+        status read_status()
+        {
+                register_map map = read_map();
+                status s;
+                s.address = _address;
+                s.bus = _bus.name();
+                s.device_id = map[reg::device_id];
+                s.hardware_version = map[reg::hardware_version];
+                s.firmware_version = map[reg::firmware_version];
+                s.power = map[reg::power];
+                s.output = map[reg::enable_output];
+                s.locked = map[reg::lock_detected];
+                s.integer_mode = map[reg::mode];
+                s.commit_pending = map[reg::commit_pending];
+                s.eeprom_status = map[reg::eeprom_status];
+                s.frequency_mhz = get16(&map[reg::frequency]);
+                s.frequency_khz = get32(&map[reg::frequency_khz]);
+                s.actual_khz = get32(&map[reg::actual_frequency_khz]);
+                s.n = get16(&map[reg::divider_n]);
+                s.frac = get16(&map[reg::divider_frac]);
+                s.m = get16(&map[reg::divider_m]);
+                s.diva = map[reg::divider_diva] & 0x7;
+                s.fb = map[reg::divider_diva] >> 7;
+                s.frequency_status = map[reg::frequency_status];
+                s.lock_time_us = get32(&map[reg::lock_time]);
+                s.lock_losses = get16(&map[reg::lock_losses]);
+                uint8_t flags = map[reg::telemetry_status];
+                s.temperature = (flags & telemetry_temperature_invalid) ? std::nan("") : int16_t(get16(&map[reg::temperature])) / 10.0;
+                s.adc = (flags & telemetry_adc_invalid) ? std::nan("") : get16(&map[reg::adc]) / 1000.0;
+                s.vco = map[reg::vco];
+                s.telemetry_age_ms = map[reg::telemetry_age] * 100;
+                return s;
+        }
+
+private:
+        static void check_frequency(uint32_t khz)
+        {
+                if (khz < frequency_min_khz || khz > frequency_max_khz)
+                        throw std::runtime_error(str(boost::format("Frequency %d kHz outside of %d - %d kHz") % khz %
+                                                     frequency_min_khz % frequency_max_khz));
+        }
+
+        bus &_bus;
+        uint8_t _address;
+};
+
+class rack
+{
+public:
+        void add(bus &b, uint8_t address) { _boards.emplace_back(b, address); }
+
+        size_t size() const { return _boards.size(); }
+        board &operator[](size_t i) { return _boards[i]; }
+
+        void configure(const config &c)
+        {
+                for_each_bus([&](board &b)
+                             { b.configure(c); });
+        }
+
+        void set_frequency_khz(uint32_t khz)
+        {
+                for_each_bus([&](board &b)
+                             { b.set_frequency_khz(khz); });
+        }
+
+        void upload_hops(const std::vector<uint32_t> &khz)
+        {
+                for_each_bus([&](board &b)
+                             { b.upload_hops(khz); });
+        }
+
+        void start_hops(hop_on mode, size_t length)
+        {
+                for_each_bus([&](board &b)
+                             { b.start_hops(mode, length); });
+        }
+
+        // in the order the boards were added
+        std::vector<status> read_status()
+        {
+                std::vector<status> result(_boards.size());
+                for_each_bus([&](board &b)
+                             { result[&b - _boards.data()] = b.read_status(); });
+                return result;
+        }
+
+private:
+        // fn for every board, one thread per bus, the first error is rethrown
+        template <typename F>
+        void for_each_bus(F &&fn)
+        {
+                std::map<bus *, std::vector<board *>> buses;
+                for (board &b : _boards)
+                        buses[&b.get_bus()].push_back(&b);
+
+                std::mutex error_mutex;
+                std::string error;
+                std::vector<std::thread> threads;
+                for (auto &entry : buses)
+                {
+                        threads.emplace_back([&, boards = entry.second]()
+                                             {
+                                for (board *b : boards)
+                                {
+                                        try
+                                        {
+                                                fn(*b);
+                                        }
+                                        catch (const std::exception &e)
+                                        {
+                                                std::lock_guard<std::mutex> lock(error_mutex);
+                                                if (error.empty())
+                                                        error = e.what();
+                                        }
+                                } });
+                }
+                for (std::thread &t : threads)
+                        t.join();
+                if (!error.empty())
+                        throw std::runtime_error(error);
+        }
+
+        std::vector<board> _boards;
+};
+
+} // namespace pll
+
+#endif /* PLL_BOARD_HPP */
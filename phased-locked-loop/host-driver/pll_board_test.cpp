@@ -0,0 +1,186 @@
+// Tests of pll::board against pll::mock_bus (see pll_board.hpp): the
+// transactions and register bytes of configure(), read_status() and the hop
+// table upload. No hardware needed, run by ctest.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "pll_board.hpp"
+
+#define CHECK(cond)                                                                              \
+        do                                                                                       \
+        {                                                                                        \
+                if (!(cond))                                                                     \
+                {                                                                                \
+                        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+                        std::exit(1);                                                            \
+                }                                                                                \
+        } while (0)
+
+static const uint8_t address = 0x2F;
+
+// Passes every transaction on to a mock_bus and keeps a log of them
+class recording_bus : public pll::bus
+{
+public:
+        struct transaction
+        {
+                bool read;
+                uint8_t address;
+                uint8_t r;
+                std::vector<uint8_t> data; // written bytes, or the length of a read
+        };
+
+        explicit recording_bus(pll::mock_bus &mock) : _mock(mock) {}
+
+        void write(uint8_t address, uint8_t r, const uint8_t *data, size_t len) override
+        {
+                log.push_back({false, address, r, std::vector<uint8_t>(data, data + len)});
+                _mock.write(address, r, data, len);
+        }
+
+        void read(uint8_t address, uint8_t r, uint8_t *data, size_t len) override
+        {
+                log.push_back({true, address, r, std::vector<uint8_t>(len)});
+                _mock.read(address, r, data, len);
+        }
+
+        std::string name() const override { return _mock.name(); }
+
+        std::vector<transaction> log;
+
+private:
+        pll::mock_bus &_mock;
+};
+
+static void test_configure()
+{
+        pll::mock_bus mock;
+        mock.add_board(address);
+        recording_bus bus(mock);
+        pll::board board(bus, address);
+
+        pll::config config;
+        config.save_to_eeprom = 2;
+        config.reference_mhz = 10;
+        config.reference_divider = 1;
+        config.led_mode = 2;
+        config.led_on_ms = 200;
+        config.led_off_ms = 800;
+        config.telemetry_interval_ms = 1000;
+        config.frequency_khz = 917000; // 0x000DFE08
+        config.commit_on_pps = true;
+        board.configure(config);
+
+        // 0x03 - 0x23 in one write
+        CHECK(bus.log.size() == 1);
+        const recording_bus::transaction &t = bus.log[0];
+        CHECK(!t.read && t.address == address && t.r == 0x03 && t.data.size() == 0x21);
+        auto at = [&](uint8_t r)
+        { return t.data[r - 0x03]; };
+        CHECK(at(0x03) == 2);
+        CHECK(at(0x04) == 10 && at(0x05) == 0);
+        CHECK(at(0x06) == 1 && at(0x07) == 2);
+        CHECK(at(0x08) == 20 && at(0x09) == 80 && at(0x0A) == 10);
+        CHECK(at(0x10) == 1);
+        CHECK(at(0x11) == (917 & 0xFF) && at(0x12) == (917 >> 8));
+        CHECK(at(0x13) == 1 && at(0x16) == 1);
+        CHECK(at(0x20) == 0x08 && at(0x21) == 0xFE && at(0x22) == 0x0D && at(0x23) == 0x00);
+
+        // outside the range of the board, nothing written
+        config.frequency_khz = 10000;
+        bool threw = false;
+        try
+        {
+                board.configure(config);
+        }
+        catch (const std::runtime_error &)
+        {
+                threw = true;
+        }
+        CHECK(threw && bus.log.size() == 1);
+}
+
+static void test_read_status()
+{
+        pll::mock_bus mock;
+        mock.add_board(address);
+        recording_bus bus(mock);
+        pll::board board(bus, address);
+
+        pll::config config;
+        config.frequency_khz = 917000;
+        board.configure(config);
+        bus.log.clear();
+
+        pll::register_map &map = mock.board_map(address);
+        pll::put16(&map[pll::reg::temperature], uint16_t(int16_t(-125)));
+        map[pll::reg::telemetry_status] = pll::telemetry_adc_invalid;
+
+        // 0x00 - 0x3C in one read
+        pll::status s = board.read_status();
+        CHECK(bus.log.size() == 1);
+        CHECK(bus.log[0].read && bus.log[0].r == 0x00 && bus.log[0].data.size() == 0x3D);
+
+        CHECK(s.address == address && s.bus == "mock");
+        CHECK(s.frequency_khz == 917000 && s.frequency_mhz == 917);
+        CHECK(s.frequency_status == 0 && s.locked && s.power && s.output);
+        CHECK(s.actual_khz == 917000);
+        CHECK(s.temperature == -12.5 && std::isnan(s.adc));
+}
+
+static void test_upload_hops()
+{
+        pll::mock_bus mock;
+        mock.add_board(address);
+        recording_bus bus(mock);
+        pll::board board(bus, address);
+
+        std::vector<uint32_t> table = {2400000, 2420000, 2440000};
+        board.upload_hops(table);
+
+        // per entry: 0x44 - 0x4B in one write, then entry and status read back
+        CHECK(bus.log.size() == 2 * table.size());
+        for (size_t i = 0; i < table.size(); i++)
+        {
+                const recording_bus::transaction &w = bus.log[2 * i];
+                CHECK(!w.read && w.r == 0x44 && w.data.size() == 8);
+                CHECK(w.data[0] == i);
+                CHECK(pll::get32(&w.data[4]) == table[i]);
+                const recording_bus::transaction &r = bus.log[2 * i + 1];
+                CHECK(r.read && r.r == 0x44 && r.data.size() == 2);
+        }
+        CHECK(mock.board_map(address)[pll::reg::hop_entry] == table.size());
+
+        // strobe: entry 0 on start, then one per step
+        bus.log.clear();
+        board.start_hops(pll::hop_on::strobe, table.size());
+        CHECK(bus.log.size() == 1 && bus.log[0].r == 0x40 && bus.log[0].data == std::vector<uint8_t>({1, 3}));
+        CHECK(board.hop_index() == 0);
+        board.hop_step();
+        CHECK(board.hop_index() == 1);
+        CHECK(board.read_status().actual_khz == table[1]);
+
+        // an entry outside the range of the board is refused before the upload
+        bus.log.clear();
+        bool threw = false;
+        try
+        {
+                board.upload_hops({10000});
+        }
+        catch (const std::runtime_error &)
+        {
+                threw = true;
+        }
+        CHECK(threw && bus.log.empty());
+}
+
+int main()
+{
+        test_configure();
+        test_read_status();
+        test_upload_hops();
+        std::printf("pll_board: all tests passed\n");
+        return 0;
+}
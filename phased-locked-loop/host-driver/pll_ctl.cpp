@@ -0,0 +1,153 @@
+// Configures and reads back PLL boards on one or more I2C buses, see pll_board.hpp.
+//
+// Every board gets its configuration in one write transaction and is read
+// back in one transaction; buses are handled in parallel.
+//
+//      ./pll_ctl --bus /dev/i2c-1,/dev/i2c-3 --address 0x2F,0x30 --freq-khz 917000 --status
+//      ./pll_ctl --mock 8 --bus a,b,c,d --freq-khz 917000 --status   (no hardware)
+//      ./pll_ctl --hop-khz 2400000,2420000,2440000 --hop-on pps      (step through on every PPS)
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "pll_board.hpp"
+
+namespace po = boost::program_options;
+
+std::vector<std::string> parse_list(const std::string &list)
+{
+        std::vector<std::string> values;
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ','))
+                values.push_back(item);
+        return values;
+}
+
+int main(int argc, char *argv[])
+{
+        std::string bus_list, address_list, hop_list, hop_on;
+        size_t mock_boards = 0;
+        pll::config config;
+        unsigned ref_mhz, rdiv, save;
+        bool no_output = false, power_off = false, commit_on_pps = false, status = false;
+
+        po::options_description desc("Allowed options");
+        // clang-format off
+        desc.add_options()
+                ("help", "help message")
+                ("bus", po::value<std::string>(&bus_list)->default_value("/dev/i2c-1"), "comma separated i2c-dev devices")
+                ("address", po::value<std::string>(&address_list)->default_value("0x2F"), "comma separated board addresses, on every bus")
+                ("mock", po::value<size_t>(&mock_boards), "emulate this many boards per bus (addresses from 0x2F) instead of i2c-dev")
+                ("freq-khz", po::value<uint32_t>(&config.frequency_khz), "RFOUTA frequency in kHz, configures the boards")
+                ("ref-mhz", po::value<unsigned>(&ref_mhz)->default_value(10), "reference clock in MHz")
+                ("rdiv", po::value<unsigned>(&rdiv)->default_value(1), "reference divider")
+                ("save", po::value<unsigned>(&save)->default_value(1), "save to EEPROM: 0 off, 1 settings, 2 everything")
+                ("no-output", po::bool_switch(&no_output), "leave RFOUTA disabled")
+                ("power-off", po::bool_switch(&power_off), "leave the PLL powered down")
+                ("commit-on-pps", po::bool_switch(&commit_on_pps), "apply the frequency on the next PPS edge")
+                ("status", po::bool_switch(&status), "read back and print the status of every board")
+                ("hop-khz", po::value<std::string>(&hop_list), "comma separated hop table in kHz, uploaded to every board")
+                ("hop-on", po::value<std::string>(&hop_on)->default_value("pps"), "step through the hop table on: strobe, pps, trigger or off")
+        ;
+        // clang-format on
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+
+        if (vm.count("help") || (!vm.count("freq-khz") && !vm.count("hop-khz") && !status))
+        {
+                std::cout << "PLL board control " << desc << std::endl;
+                return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        config.reference_mhz = ref_mhz;
+        config.reference_divider = rdiv;
+        config.save_to_eeprom = save;
+        config.output = !no_output;
+        config.power = !power_off;
+        config.commit_on_pps = commit_on_pps;
+
+        const std::map<std::string, pll::hop_on> hop_modes = {
+                {"off", pll::hop_on::off}, {"strobe", pll::hop_on::strobe}, {"pps", pll::hop_on::pps}, {"trigger", pll::hop_on::trigger}};
+        if (!hop_modes.count(hop_on))
+                throw std::runtime_error("Unknown --hop-on " + hop_on);
+        std::vector<uint32_t> hops;
+        for (const std::string &khz : parse_list(hop_list))
+                hops.push_back(std::stoul(khz));
+
+        std::vector<std::unique_ptr<pll::bus>> buses;
+        std::vector<pll::mock_bus *> mocks;
+        pll::rack rack;
+        for (const std::string &device : parse_list(bus_list))
+        {
+                if (vm.count("mock"))
+                {
+                        auto mock = std::make_unique<pll::mock_bus>(device);
+                        for (size_t i = 0; i < mock_boards; i++)
+                        {
+                                mock->add_board(0x2F + i);
+                                rack.add(*mock, 0x2F + i);
+                        }
+                        mocks.push_back(mock.get());
+                        buses.push_back(std::move(mock));
+                        continue;
+                }
+                buses.push_back(std::make_unique<pll::i2c_dev_bus>(device));
+                for (const std::string &address : parse_list(address_list))
+                        rack.add(*buses.back(), std::stoul(address, nullptr, 0));
+        }
+
+        auto timed = [](const char *what, auto fn)
+        {
+                auto start = std::chrono::steady_clock::now();
+                fn();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << boost::format("%s: %.3f ms") % what % (elapsed.count() * 1e3) << std::endl;
+        };
+
+        if (vm.count("freq-khz"))
+                timed("Configure", [&]()
+                      { rack.configure(config); });
+
+        if (!hops.empty())
+                timed("Upload hop table", [&]()
+                      {
+                        rack.upload_hops(hops);
+                        rack.start_hops(hop_modes.at(hop_on), hops.size()); });
+
+        if (status)
+        {
+                std::vector<pll::status> result;
+                timed("Read status", [&]()
+                      { result = rack.read_status(); });
+
+                std::cout << boost::format("%-12s %4s %5s %5s %4s %10s %10s %5s %4s %4s %4s %10s %6s %7s %6s %3s") % "bus" %
+                                 "addr" % "power" % "out" % "lock" % "freq_khz" % "actual" % "n" % "frac" % "diva" % "stat" %
+                                 "lock_us" % "losses" % "temp" % "adc" % "vco"
+                          << std::endl;
+                for (const pll::status &s : result)
+                {
+                        std::string lock_us = s.lock_time_us == pll::lock_time_pending ? "pending" : std::to_string(s.lock_time_us);
+                        std::cout << boost::format("%-12s 0x%02X %5d %5d %4d %10d %10d %5d %4d %4d %4d %10s %6d %7.1f %6.3f %3d") %
+                                         s.bus % int(s.address) % s.power % s.output % s.locked % s.frequency_khz %
+                                         s.actual_khz % s.n % s.frac % int(s.diva) % int(s.frequency_status) % lock_us %
+                                         s.lock_losses % s.temperature % s.adc % int(s.vco)
+                                  << std::endl;
+                }
+        }
+
+        for (pll::mock_bus *mock : mocks)
+                std::cout << boost::format("%s: %d transactions, %.3f ms on the wire at 100 kHz") % mock->name() %
+                                 mock->transactions() % (mock->bus_time() * 1e3)
+                          << std::endl;
+        return EXIT_SUCCESS;
+}
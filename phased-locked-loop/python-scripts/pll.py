@@ -14,6 +14,7 @@ REGISTER_SETTINGS_PLL_REFERENCE_DIVIDER = 0x06
 REGISTER_SETTINGS_LED_MODE              = 0x07
 REGISTER_SETTINGS_LED_BLINK_ON_TIME     = 0x08
 REGISTER_SETTINGS_LED_BLINK_OFF_TIME    = 0x09
+REGISTER_SETTINGS_TELEMETRY_INTERVAL    = 0x0A # *100 ms, 0: off
 
 REGISTER_START_SETTINGS                 = 0x00
 REGISTER_END_SETTINGS                   = 0x10
@@ -24,9 +25,40 @@ REGISTER_PLL_FREQUENCY                  = 0x11 # 4 byte (double)
 REGISTER_PLL_ENABLE_OUTPUT              = 0x13
 REGISTER_PLL_LOCK_DETECTED              = 0x14 # Read only
 REGISTER_PLL_MODE                       = 0x15 # Read only
-
-REGISTER_MAP_SIZE                       = REGISTER_PLL_MODE+1
-REGISTER_MAP_NR_READ_ONLY               = 2
+REGISTER_PLL_COMMIT_MODE                = 0x16
+REGISTER_PLL_COMMIT_PENDING             = 0x17 # Read only
+REGISTER_EEPROM_COMMIT                  = 0x18 # 1: store now
+REGISTER_EEPROM_STATUS                  = 0x19 # Read only
+
+# 0x2?: PLL FREQUENCY (kHz resolution)
+REGISTER_PLL_FREQUENCY_KHZ              = 0x20 # 4 byte (uint32), applied when byte 0x23 is written
+REGISTER_PLL_ACTUAL_FREQUENCY_KHZ       = 0x24 # 4 byte (uint32), read only
+REGISTER_PLL_DIVIDER_N                  = 0x28 # 2 byte (uint16), read only
+REGISTER_PLL_DIVIDER_FRAC               = 0x2A # 2 byte (uint16), read only
+REGISTER_PLL_DIVIDER_M                  = 0x2C # 2 byte (uint16), read only
+REGISTER_PLL_DIVIDER_DIVA               = 0x2E # Read only, bit 7: FB
+REGISTER_PLL_FREQUENCY_STATUS           = 0x2F # Read only
+
+# 0x3?: TELEMETRY (read only)
+REGISTER_TELEMETRY_LOCK_TIME            = 0x30 # 4 byte (uint32), us from the last R0 write to LD high
+REGISTER_TELEMETRY_LOCK_LOSSES          = 0x34 # 2 byte (uint16)
+REGISTER_TELEMETRY_TEMPERATURE          = 0x36 # 2 byte (int16), 0.1 degC
+REGISTER_TELEMETRY_ADC                  = 0x38 # 2 byte (uint16), mV
+REGISTER_TELEMETRY_VCO                  = 0x3A
+REGISTER_TELEMETRY_AGE                  = 0x3B # *100 ms
+REGISTER_TELEMETRY_STATUS               = 0x3C # TELEMETRY_* flags
+
+# 0x4?: HOP TABLE (not stored in EEPROM)
+REGISTER_HOP_MODE                       = 0x40
+REGISTER_HOP_LENGTH                     = 0x41
+REGISTER_HOP_INDEX                      = 0x42 # Read only, 0xFF before the first hop
+REGISTER_HOP_STEP                       = 0x43 # 1: next entry (on strobe)
+REGISTER_HOP_ENTRY                      = 0x44 # entry to upload, +1 after each upload
+REGISTER_HOP_ENTRY_STATUS               = 0x45 # Read only
+REGISTER_HOP_ENTRY_KHZ                  = 0x48 # 4 byte (uint32), uploaded when byte 0x4B is written
+
+REGISTER_MAP_SIZE                       = REGISTER_HOP_ENTRY_KHZ+4
+REGISTER_MAP_NR_READ_ONLY               = 30
 
 # Register bank settings
 EEPROM_STATUS_ADDRESS                   = 0
@@ -38,6 +70,10 @@ EEPROM_DISABLE                          = 0
 EEPROM_SETTINGS                         = 1
 EEPROM_ALL                              = 2
 
+EEPROM_STORED                           = 0
+EEPROM_PENDING                          = 1 # waiting for the quiet time
+EEPROM_WRITING                          = 2
+
 LED_MODE_OFF                            = 0
 LED_MODE_ON                             = 1
 LED_MODE_BLINK                          = 2
@@ -45,6 +81,25 @@ LED_MODE_PPS_BLINK                      = 3
 LED_MODE_LOCK_DETECT                    = 4
 LED_MODE_PPS_BLINK_AND_LOCK_DETECT      = 5
 
+PLL_COMMIT_IMMEDIATE                    = 0
+PLL_COMMIT_ON_PPS                       = 1
+
+PLL_FREQUENCY_OK                        = 0
+PLL_FREQUENCY_OUT_OF_RANGE              = 1
+PLL_FREQUENCY_NO_SOLUTION               = 2
+
+LOCK_TIME_PENDING                       = 0xFFFFFFFF
+
+TELEMETRY_TEMPERATURE_INVALID           = 0x01
+TELEMETRY_ADC_INVALID                   = 0x02
+
+HOP_OFF                                 = 0
+HOP_ON_STROBE                           = 1
+HOP_ON_PPS                              = 2
+HOP_ON_TRIGGER                          = 3
+HOP_TABLE_SIZE                          = 32
+HOP_NONE                                = 0xFF
+
 DELAY                                   = 0.1
 class PLL(object):
     def __init__(self, address=PLL_ADDRESS, i2c=None, **kwargs):
@@ -78,6 +133,9 @@ class PLL(object):
     def get_LED_blink_off_time(self):
         return self._device.readU8(REGISTER_SETTINGS_LED_BLINK_OFF_TIME)*10
 
+    def get_telemetry_interval(self):
+        return self._device.readU8(REGISTER_SETTINGS_TELEMETRY_INTERVAL)*100
+
     # - Setters
     def set_PLL_reference_clock(self, v):
         self._device.write16(REGISTER_SETTINGS_PLL_REFERENCE_CLOCK, v)
@@ -98,6 +156,9 @@ class PLL(object):
     def set_LED_blink_off_time(self, v):
         self._device.write8(REGISTER_SETTINGS_LED_BLINK_OFF_TIME, v//10)
 
+    def set_telemetry_interval(self, v):
+        self._device.write8(REGISTER_SETTINGS_TELEMETRY_INTERVAL, v//100)
+
     # ---- Operating instructions ----
     # - Getters
     def get_PLL_power(self):
@@ -115,6 +176,43 @@ class PLL(object):
     def get_PLL_mode(self):
         return self._device.readU8(REGISTER_PLL_MODE)
 
+    def get_PLL_commit_mode(self):
+        return self._device.readU8(REGISTER_PLL_COMMIT_MODE)
+
+    def get_PLL_commit_pending(self):
+        return self._device.readU8(REGISTER_PLL_COMMIT_PENDING)
+
+    def get_EEPROM_status(self):
+        return self._device.readU8(REGISTER_EEPROM_STATUS)
+
+    def get_PLL_frequency_kHz(self):
+        result = self._device.readList(REGISTER_PLL_FREQUENCY_KHZ, 4)
+        return struct.unpack('<I', result)[0]
+
+    def get_PLL_actual_frequency_kHz(self):
+        result = self._device.readList(REGISTER_PLL_ACTUAL_FREQUENCY_KHZ, 4)
+        return struct.unpack('<I', result)[0]
+
+    def get_PLL_dividers(self):
+        result = self._device.readList(REGISTER_PLL_DIVIDER_N, 7)
+        n, frac, m, diva = struct.unpack('<HHHB', result)
+        return {'n': n, 'frac': frac, 'm': m, 'diva': diva & 0x7, 'fb': diva >> 7}
+
+    def get_PLL_frequency_status(self):
+        return self._device.readU8(REGISTER_PLL_FREQUENCY_STATUS)
+
+    def get_telemetry(self):
+        # one burst read of the telemetry bank, 0x30 - 0x3C
+        layout = '<IHhHBBB'
+        result = self._device.readList(REGISTER_TELEMETRY_LOCK_TIME, struct.calcsize(layout))
+        lock_time, losses, temperature, adc, vco, age, status = struct.unpack(layout, result)
+        return {'lock_time_us': None if lock_time == LOCK_TIME_PENDING else lock_time,
+                'lock_losses': losses,
+                'temperature': None if status & TELEMETRY_TEMPERATURE_INVALID else temperature / 10.0,
+                'adc': None if status & TELEMETRY_ADC_INVALID else adc / 1000.0,
+                'vco': vco,
+                'age_ms': age * 100}
+
     # - Setters
     def set_PLL_power(self, v):
         self._device.write8(REGISTER_PLL_POWER, v)
@@ -131,6 +229,20 @@ class PLL(object):
         self._output = v
         time.sleep(DELAY)
 
+    def set_PLL_frequency_kHz(self, v):
+        # all 4 bytes in one write, the board applies the value on the last one
+        self._device.writeList(REGISTER_PLL_FREQUENCY_KHZ, list(struct.pack('<I', v)))
+        self._frequency = v / 1000.0
+        time.sleep(DELAY)
+
+    def set_PLL_commit_mode(self, v):
+        self._device.write8(REGISTER_PLL_COMMIT_MODE, v)
+        time.sleep(DELAY)
+
+    def set_EEPROM_commit(self):
+        self._device.write8(REGISTER_EEPROM_COMMIT, 1)
+        time.sleep(DELAY)
+
     # - Simpler naming functions
 
     def power_on(self):
@@ -148,5 +260,58 @@ class PLL(object):
     def frequency(self, v):
         self.set_PLL_frequency(v)
 
+    def frequency_kHz(self, v):
+        self.set_PLL_frequency_kHz(v)
+        if self.get_PLL_frequency_status() != PLL_FREQUENCY_OK:
+            raise ValueError("PLL frequency %d kHz rejected" % v)
+        return self.get_PLL_actual_frequency_kHz()
+
+    def commit_on_pps(self, enable=True):
+        self.set_PLL_commit_mode(PLL_COMMIT_ON_PPS if enable else PLL_COMMIT_IMMEDIATE)
+
+    def wait_for_commit(self, timeout=2.0):
+        # A staged frequency is applied on the next PPS edge
+        start = time.time()
+        while self.get_PLL_commit_pending() > 0:
+            if time.time() - start > timeout:
+                return False
+            time.sleep(DELAY)
+        return True
+
+    def store_settings(self, timeout=2.0):
+        # Store now instead of after the quiet time, and wait until it is written
+        self.set_EEPROM_commit()
+        start = time.time()
+        while self.get_EEPROM_status() != EEPROM_STORED:
+            if time.time() - start > timeout:
+                return False
+            time.sleep(DELAY)
+        return True
+
+    def upload_hops(self, frequencies_kHz):
+        # One entry per write: index, 3 bytes up to the kHz register, kHz
+        if len(frequencies_kHz) > HOP_TABLE_SIZE:
+            raise ValueError("Hop table of %d entries, the board takes %d" % (len(frequencies_kHz), HOP_TABLE_SIZE))
+        for i, v in enumerate(frequencies_kHz):
+            self._device.writeList(REGISTER_HOP_ENTRY, [i, 0, 0, 0] + list(struct.pack('<I', v)))
+            time.sleep(DELAY)
+            entry, status = self._device.readList(REGISTER_HOP_ENTRY, 2)
+            if entry != i + 1 or status != PLL_FREQUENCY_OK:
+                raise ValueError("Hop entry %d (%d kHz) rejected" % (i, v))
+
+    def start_hops(self, mode, length):
+        # Starts at entry 0: right away on strobe, on the next edge on PPS / trigger
+        self._device.writeList(REGISTER_HOP_MODE, [mode, length])
+        time.sleep(DELAY)
+
+    def stop_hops(self):
+        self.start_hops(HOP_OFF, 0)
+
+    def hop(self):
+        self._device.write8(REGISTER_HOP_STEP, 1)
+
+    def get_hop_index(self):
+        return self._device.readU8(REGISTER_HOP_INDEX)
+
     def locked(self):
         return self.get_PLL_lock_detected() > 0
\ No newline at end of file
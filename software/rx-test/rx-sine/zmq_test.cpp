@@ -10,6 +10,10 @@
 #include <chrono>
 #include <thread>
 
+#include "gpio_sequencer.hpp"
+#include "stream_core.hpp"
+#include "sweep_engine.hpp"
+
 namespace po = boost::program_options;
 
 zmq::context_t context(1);
@@ -58,12 +62,22 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         std::string str_args;
         std::string port;
         bool ignore_sync = false;
+        std::vector<std::string> gpio_pulses;
+        std::string gpio_edges_file;
+        size_t gpio_queue_depth;
+        std::string sweep_file;
+        double sweep_settle;
 
         po::options_description desc("Allowed options");
         desc.add_options()("help", "produce help message")
         ("args", po::value<std::string>(&str_args)->default_value("type=b200,mode_n=integer"), "give device arguments here")
         ("iq_port", po::value<std::string>(&port)->default_value("8888"), "Port to stream IQ samples to")
-        ("ignore-server", po::bool_switch(&ignore_sync), "Discard waiting till SYNC server");
+        ("ignore-server", po::bool_switch(&ignore_sync), "Discard waiting till SYNC server")
+        ("gpio-pulse", po::value<std::vector<std::string>>(&gpio_pulses), "FP0 pulse train \"start,period,width,count[,mask]\", start in seconds relative to the RX start (repeatable)")
+        ("gpio-edges", po::value<std::string>(&gpio_edges_file), "file with FP0 edges \"time mask value\" per line, time relative to the RX start")
+        ("gpio-queue-depth", po::value<size_t>(&gpio_queue_depth)->default_value(16), "max timed GPIO commands queued on the device")
+        ("sweep-file", po::value<std::string>(&sweep_file), "sweep the steps in this file (\"freq gain dwell\" per line) instead of a single capture")
+        ("sweep-settle", po::value<double>(&sweep_settle)->default_value(0.1), "seconds dropped after every retune of a sweep, the retune included");
 
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -80,16 +94,11 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         // std::cout << "Hello World"
         //           << std::endl;
 
-        // // set up some catch-all masks
         uint32_t gpio_line = 0xF; // only the bottom 4 lines: 0xF = 00001111 = Pin 0, 1, 2, 3
-        uint32_t all_one = 0xFF;
-        uint32_t all_zero = 0x00;
 
-        // // set gpio pins up for output
+        // set gpio pins up for output, reset LOW (async)
         std::cout << "Setting up GPIO" << std::endl;
-        usrp->set_gpio_attr("FP0", "DDR", all_one, gpio_line, 0);
-        usrp->set_gpio_attr("FP0", "CTRL", all_zero, gpio_line, 0);
-        usrp->set_gpio_attr("FP0", "OUT", all_zero, gpio_line, 0); // reset LOW (async)
+        gpio::sequencer gpio_seq(usrp, gpio_line, gpio_queue_depth);
 
         // initialise
         std::cout << "Setting up PPS + 10MHz" << std::endl;
@@ -194,52 +203,14 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
                   << std::endl;
 
 
-        /********************************************/
-        /*********** begin gpio operations **********/
-        /********************************************/
-
-        // usrp->clear_command_time();
-        // time_t GPIO_time = 10.0;
-        // usrp->set_command_time(uhd::time_spec_t(GPIO_time));
-        // usrp->set_gpio_attr("FP0", "OUT", all_one, gpio_line, 0);
-        // usrp->clear_command_time();
-
-        // while(usrp->get_time_now() < uhd::time_spec_t(GPIO_time + 10.0)){}
-
-
-        // // set all gpio lines to output 0
-        // usrp->clear_command_time();
-        // usrp->set_command_time(uhd::time_spec_t(6.0));
-        // usrp->set_gpio_attr("FP0", "OUT", all_zero, gpio_line, 0); // set LOW @ t=2
-
-        // // set all gpio lines to output 1
-        // usrp->clear_command_time();
-        // usrp->set_command_time(uhd::time_spec_t(8.0));
-        // usrp->set_gpio_attr("FP0", "OUT", all_one, gpio_line, 0); // set HIGH @ t=4
-
-        // // set all gpio lines to output 0
-        // usrp->clear_command_time();
-        // usrp->set_command_time(uhd::time_spec_t(10.0));
-        // usrp->set_gpio_attr("FP0", "OUT", all_zero, gpio_line, 0); // set LOW @ t=6
-
         usrp->clear_command_time();
 
-        // std::this_thread::sleep_for(std::chrono::seconds(20));
-
-        // /********************************************/
-        // /*********** quit gpio operations ***********/
-        // /********************************************/
-
         size_t num_requested_samples = rate * 10;
         size_t nsamps_per_buff = 1024; //rx_stream->get_max_num_samps();
-        std::vector<std::vector<std::complex<float>>> buff(usrp->get_rx_num_channels(), std::vector<std::complex<float>>(nsamps_per_buff));        
+        std::vector<std::vector<std::complex<float>>> buff(usrp->get_rx_num_channels(), std::vector<std::complex<float>>(nsamps_per_buff));
         std::vector<std::complex<float> *> buff_ptrs;
 	for (size_t i = 0; i < buff.size(); i++)
 		buff_ptrs.push_back(&buff[i].front());
-        uhd::rx_metadata_t md;
-        // setup streaming
-        //uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-        uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
 
         // process IQ samples
         // zmq::socket_t zmq_send_socket = zmq::socket_t(context, ZMQ_PUSH);
@@ -247,73 +218,54 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         //           << std::endl;
         // zmq_send_socket.bind("tcp://*:" + port);
 
-
-        stream_cmd.stream_now = false;
-        stream_cmd.num_samps = num_requested_samples;
         std::cout << num_requested_samples << std::endl;
         cmd_time += 10.0;
-        // std::cout << usrp->get_time_now().get_real_secs() << std::endl;
-        stream_cmd.time_spec = uhd::time_spec_t(uhd::time_spec_t(cmd_time));
-        rx_stream->issue_stream_cmd(stream_cmd);
-
-        // uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-        // stream_cmd.stream_now = false;
-        // stream_cmd.time_spec = uhd::time_spec_t(usrp->get_time_now() + uhd::time_spec_t(1.0));
-        // rx_stream->issue_stream_cmd(stream_cmd);
 
         usrp->clear_command_time();
 
-        // std::cout << rx_stream->get_max_num_samps() << std::endl;
-
-        size_t num_total_samps = 0;
-
-        double timeout = cmd_time + 0.5f;
-
         std::cout << "Locked: " << usrp->get_rx_sensor("lo_locked").to_bool() << std::endl;
         std::cout << "RX channels: " << rx_stream->get_num_channels() << std::endl;
 
-        // Run this loop until either time expired (if a duration was given), until
-        // the requested number of samples were collected (if such a number was
-        // given), or until Ctrl-C was pressed.
-        while (num_requested_samples > num_total_samps)
+        // scope triggers / markers on FP0, on the same clock as the RX start.
+        // The edges are queued only once the RX stream command is out: timed
+        // commands run in order, so an edge queued first would hold it back.
+        for (const std::string &pulse : gpio_pulses)
+                gpio_seq.add_pulse_train(gpio::parse_pulse_train(pulse, cmd_time));
+        if (!gpio_edges_file.empty())
+                gpio_seq.add(gpio::load_edges(gpio_edges_file, cmd_time));
+        std::thread gpio_thread;
+        auto start_gpio = [&]()
+        {
+                gpio_thread = std::thread([&]()
+                                          { gpio_seq.run(); });
+        };
+
+        if (sweep_file.empty())
+        {
+                // Stream until the requested number of samples were collected, both
+                // channels written to their own file as plain fc32.
+                stream::raw_file_sink<std::complex<float>, 2> sink(stream::to_array<std::complex<float>, 2>(buff_ptrs), {&outfile_0, &outfile_1});
+                stream::receive<std::complex<float>, 2>(rx_stream, sink, nsamps_per_buff, num_requested_samples, cmd_time, rate, nullptr, nullptr, start_gpio);
+        }
+        else
         {
-                size_t num_rx_samps =
-                    rx_stream->recv(buff_ptrs, nsamps_per_buff, md, timeout); // wait long enough bcs we initiated a timed cmd
-                timeout = 0.1f;                                               // small timeout for subsequent recv
-
-
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
-                {
-                        std::cout << boost::format("Timeout while streaming") << std::endl;
-                        break;
-                }
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
-                {
-                        std::cout << "O";
-                }
-                if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
-                {
-                        std::string error = str(boost::format("Receiver error: %s") % md.strerror());
-                }
-                num_total_samps += num_rx_samps;
-                //std::cout << num_total_samps;
-
-                //zmq::message_t send_message(buff[0]);
-
-                //zmq_send_socket.send(send_message, zmq::send_flags::dontwait);
-
-                if (outfile_0.is_open())
-                {
-                        outfile_0.write((const char *)buff_ptrs[0], num_rx_samps * sizeof(std::complex<float>));
-                }
-                if (outfile_1.is_open())
-                {
-                        outfile_1.write((const char *)buff_ptrs[1], num_rx_samps * sizeof(std::complex<float>));
-                }
+                // One continuous stream over all steps, retuned in between; only
+                // the dwell windows end up in the files.
+                sweep::engine sweep_engine(usrp, sweep::load_steps(sweep_file), stream_args.channels, cmd_time, sweep_settle);
+                std::cout << boost::format("Sweeping %d steps from t=%f to t=%f s") % sweep_engine.size() % sweep_engine.rx_start() % sweep_engine.end_time()
+                          << std::endl;
+                std::thread sweep_thread([&]()
+                                         { sweep_engine.run(); });
+
+                sweep::step_sink<std::complex<float>, 2> sink(stream::to_array<std::complex<float>, 2>(buff_ptrs), sweep_engine, rate,
+                                                              {&outfile_0, &outfile_1}, "usrp_samples_" + serial + "_sweep.csv");
+                stream::receive<std::complex<float>, 2>(rx_stream, sink, nsamps_per_buff, sweep_engine.num_samples(rate), sweep_engine.rx_start(), rate, nullptr, nullptr, start_gpio);
+
+                sweep_thread.join();
         }
 
-        stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
-        rx_stream->issue_stream_cmd(stream_cmd);
+        if (gpio_thread.joinable())
+                gpio_thread.join();
 
         if (outfile_0.is_open())
         {
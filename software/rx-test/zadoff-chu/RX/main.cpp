@@ -10,6 +10,8 @@
 #include <chrono>
 #include <thread>
 
+#include "stream_core.hpp"
+
 namespace po = boost::program_options;
 
 #define RATE 1e6
@@ -245,10 +247,6 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         std::vector<std::complex<float> *> buff_ptrs;
 	for (size_t i = 0; i < buff.size(); i++)
 		buff_ptrs.push_back(&buff[i].front());
-        uhd::rx_metadata_t md;
-        // setup streaming
-        //uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-        uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
 
         // process IQ samples
         // zmq::socket_t zmq_send_socket = zmq::socket_t(context, ZMQ_PUSH);
@@ -256,28 +254,11 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         //           << std::endl;
         // zmq_send_socket.bind("tcp://*:" + port);
 
-
-        stream_cmd.stream_now = false;
-        stream_cmd.num_samps = num_requested_samples;
         std::cout << num_requested_samples << std::endl;
         cmd_time += 4.0; //15
-        // std::cout << usrp->get_time_now().get_real_secs() << std::endl;
-        stream_cmd.time_spec = uhd::time_spec_t(cmd_time);
-        rx_stream->issue_stream_cmd(stream_cmd);
-
-        // uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
-        // stream_cmd.stream_now = false;
-        // stream_cmd.time_spec = uhd::time_spec_t(usrp->get_time_now() + uhd::time_spec_t(1.0));
-        // rx_stream->issue_stream_cmd(stream_cmd);
 
         usrp->clear_command_time();
 
-        // std::cout << rx_stream->get_max_num_samps() << std::endl;
-
-        size_t num_total_samps = 0;
-
-        double timeout = cmd_time + 4.0f;
-
         std::cout << "Locked: " << usrp->get_rx_sensor("lo_locked").to_bool() << std::endl;
         std::cout << "RX channels: " << rx_stream->get_num_channels() << std::endl;
         
@@ -285,46 +266,9 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         
        	std::cout << "Rx starting in " << rx_starts_in.get_full_secs() << " seconds" << std::endl;
 
-        // Run this loop until either time expired (if a duration was given), until
-        // the requested number of samples were collected (if such a number was
-        // given), or until Ctrl-C was pressed.
-        while (num_requested_samples > num_total_samps)
-        {
-                size_t num_rx_samps =
-                    rx_stream->recv(buff_ptrs, nsamps_per_buff, md, timeout); // wait long enough bcs we initiated a timed cmd
-                timeout = 0.5f;                                               // small timeout for subsequent recv
-
-
-                // increase the pointers by the number of samples received
-                buff_ptrs[0]+=num_rx_samps;
-                buff_ptrs[1]+=num_rx_samps;
-
-
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
-                {
-                        std::cout << boost::format("Timeout while streaming after %d rx samples") %num_total_samps << std::endl;
-                        break;
-                }
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
-                {
-                        std::cout << "O";
-                }
-                if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
-                {
-                        std::string error = str(boost::format("Receiver error: %s") % md.strerror());
-                }
-                num_total_samps += num_rx_samps;
-                //std::cout << num_total_samps;
-
-                //zmq::message_t send_message(buff[0]);
-
-                //zmq_send_socket.send(send_message, zmq::send_flags::dontwait);
-
-                
-        }
-
-        stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
-        rx_stream->issue_stream_cmd(stream_cmd);
+        // Capture both channels straight into the large buffers, written out after streaming.
+        stream::memory_sink<std::complex<float>, 2> sink(stream::to_array<std::complex<float>, 2>(buff_ptrs), num_requested_samples);
+        stream::receive<std::complex<float>, 2>(rx_stream, sink, nsamps_per_buff, num_requested_samples, cmd_time, rate);
 
 
         if (outfile_0.is_open())
@@ -11,6 +11,10 @@
 #include <thread>
 #include <cmath>
 #include <filesystem>
+#include <memory>
+
+#include "stream_core.hpp"
+#include "file_source.hpp"
 
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
@@ -130,12 +134,16 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         std::string str_args;
         std::string port;
         bool ignore_sync = false;
+        std::string stream_file;
+        bool stream_loop = false;
 
         po::options_description desc("Allowed options");
         desc.add_options()("help", "produce help message")
         ("args", po::value<std::string>(&str_args)->default_value("type=b200,mode_n=integer"), "give device arguments here")
         ("iq_port", po::value<std::string>(&port)->default_value("8888"), "Port to stream IQ samples to")
-        ("ignore-server", po::bool_switch(&ignore_sync), "Discard waiting till SYNC server");
+        ("ignore-server", po::bool_switch(&ignore_sync), "Discard waiting till SYNC server")
+        ("stream-file", po::value<std::string>(&stream_file)->default_value(""), "stream this fc32 file from disk through a prefetching reader instead of the preloaded ZC sequence; played once, the burst is rounded up to whole send buffers, zero-padded after the end of the file")
+        ("stream-loop", po::bool_switch(&stream_loop), "repeat --stream-file for the whole burst instead of playing it once");
 
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -179,7 +187,14 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         uhd::tx_streamer::sptr tx_stream = usrp->get_tx_stream(stream_args);
 
         size_t nsamps_per_buff = tx_stream->get_max_num_samps();
-        std::vector<sample_t> seq = read_ZC_seq(nsamps_per_buff);
+        // --stream-file is read from disk while sending, the ring is prefetched
+        // here, well before the timed start
+        std::vector<sample_t> seq;
+        std::unique_ptr<playback::file_source<sample_t, 1>> file;
+        if (!stream_file.empty())
+                file.reset(new playback::file_source<sample_t, 1>(stream_file, nsamps_per_buff, stream_loop));
+        else
+                seq = read_ZC_seq(nsamps_per_buff);
 
         if (!ignore_sync)
         {
@@ -264,9 +279,6 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
 
         size_t num_requested_samples = rate*15;
 
-        size_t num_total_samps = 0;
-        
-
         double timeout = cmd_time + 4.0f;
 
         std::cout << "Locked: " << usrp->get_tx_sensor("lo_locked").to_bool() << std::endl;
@@ -280,83 +292,21 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         // the requested number of samples were collected (if such a number was
         // given), or until Ctrl-C was pressed.
 
-        std::vector<sample_t> buff(nsamps_per_buff);
-        std::string filename = "../zc-sequence.dat";
-        // check whether file exists
-        if (!std::filesystem::exists(filename.data()))
+        if (file)
         {
-                fmt::print(stderr, "file '{:s}' not found\n", filename);
+                // played once unless --stream-loop
+                if (!stream_loop)
+                        num_requested_samples = std::filesystem::file_size(stream_file) / sizeof(sample_t);
+                stream::transmit_from<sample_t, 1>(tx_stream, *file, nsamps_per_buff, num_requested_samples, md, timeout);
         }
-
-        // calculate how many samples to read
-        auto file_size = std::filesystem::file_size(std::filesystem::path(filename));
-        auto samples_in_file = file_size / sizeof(sample_t);
-
-        std::ifstream infile(filename.data(), std::ios_base::binary);
-        if (!infile)
-        {
-                fmt::print(stderr, "error opening '{:s}'\n", filename);
-        }
-
-
-        // while (num_requested_samples > num_total_samps)
-        // {
-
-        //         infile.read((char *)&buff.front(), buff.size() * sizeof(sample_t));
-        //         size_t num_tx_samps = infile.gcount() / sizeof(sample_t);
-
-        //         sample_t *start_pos = &buff.front();
-        //          for (int i = 0; i < num_tx_samps; i++)
-        //         {
-        //                 std::cout << std::arg(*start_pos) << " ";
-        //                 start_pos++;
-        //         }
-        //         std::cout << std::endl;
-
-        //         if(infile.eof()){
-        //                 // reset to beginning
-        //                 infile.clear();
-        //                 infile.seekg(0, std::ios::beg);
-        //         }
-
-        //         tx_stream->send(&buff.front(), num_tx_samps, md, timeout);
-        //         md.has_time_spec = false;
-
-        //         if (num_tx_samps < nsamps_per_buff)
-        //                 std::cerr << "Send timeout..." << std::endl;
-        //         num_total_samps += num_tx_samps;
-        // }
-
-        while (num_requested_samples > num_total_samps)
+        else
         {
-        
-                //send a single packet
-                size_t num_tx_samps = tx_stream->send(&seq.front(), nsamps_per_buff, md, timeout);
-
-                //do not use time spec for subsequent packets
-                md.has_time_spec = false;
-
-                if (num_tx_samps < nsamps_per_buff)
-                        std::cerr << "Send timeout..." << std::endl;
-
-                num_total_samps += num_tx_samps;
+                // the same sequence every packet, then a mini EOB packet
+                stream::transmit<sample_t, 1>(tx_stream, {&seq.front()}, nsamps_per_buff, num_requested_samples, md, timeout);
         }
 
-
-
-        // send a mini EOB packet
-        md.end_of_burst = true;
-        tx_stream->send("", 0, md);
-
         std::cout << std::endl << "Waiting for async burst ACK... " << std::flush;
-        uhd::async_metadata_t async_md;
-        bool got_async_burst_ack = false;
-        // loop through all messages for the ACK packet (may have underflow messages in queue)
-        while (not got_async_burst_ack and tx_stream->recv_async_msg(async_md, timeout)) {
-                got_async_burst_ack =
-                (async_md.event_code == uhd::async_metadata_t::EVENT_CODE_BURST_ACK);
-        }
-        std::cout << (got_async_burst_ack ? "success" : "fail") << std::endl;
+        std::cout << (stream::wait_burst_ack(tx_stream, timeout) ? "success" : "fail") << std::endl;
 
         // finished
         std::cout << std::endl << "Done!" << std::endl << std::endl;
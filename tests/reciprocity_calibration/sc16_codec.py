@@ -0,0 +1,111 @@
+"""Reader for the sc16 frames written by common/sc16_codec.hpp.
+
+Buffers without a frame header are plain interleaved int16 I/Q, so the
+reader also accepts sc16 captures made with --codec raw. Frames carry the
+sample type (--type char/short/float), which is scaled to [-1, 1) on reading.
+The zstd codec needs the `zstandard` package.
+"""
+
+import struct
+
+import numpy as np
+
+FRAME_MAGIC = 0x32314353  # "SC12"
+FRAME_VERSION = 1
+HEADER = struct.Struct("<IBBBBII")
+
+CODEC_RAW = 0
+CODEC_PACK12 = 1
+CODEC_ZSTD = 2
+
+# sample::format -> (numpy dtype of one I or Q value, full scale)
+FORMATS = {
+    0: (np.int16, 2**15),  # sc16
+    1: (np.int8, 2**7),  # sc8
+    2: (np.float32, 1.0),  # fc32
+}
+
+
+def unpack12(payload, nsamps):
+    b = np.frombuffer(payload, dtype=np.uint8, count=3 * nsamps).reshape(-1, 3).astype(np.uint16)
+    out = np.empty((nsamps, 2), dtype=np.uint16)
+    out[:, 0] = (b[:, 0] | ((b[:, 1] & 0xF) << 8)) << 4
+    out[:, 1] = ((b[:, 1] >> 4) | (b[:, 2] << 4)) << 4
+    return out.view(np.int16).reshape(-1)
+
+
+def undelta_planes(planes, nsamps):
+    p = np.frombuffer(planes, dtype=np.uint8)
+    d = p[: 2 * nsamps].astype(np.uint16) | (p[2 * nsamps :].astype(np.uint16) << 8)
+    d = d.reshape(-1, 2)
+    return np.cumsum(d, axis=0, dtype=np.uint16).view(np.int16).reshape(-1)
+
+
+def is_frame(data, offset=0):
+    """True when a frame header starts at offset: the full magic, version and reserved byte."""
+    if len(data) - offset < HEADER.size:
+        return False
+    magic, version, _, _, reserved, _, _ = HEADER.unpack_from(data, offset)
+    return magic == FRAME_MAGIC and version == FRAME_VERSION and reserved == 0
+
+
+def decode_frame(data, offset=0):
+    """Decodes one frame at offset, returns (interleaved I/Q, format, next offset)."""
+    if not is_frame(data, offset):
+        return np.frombuffer(data, dtype=np.int16, offset=offset), 0, len(data)
+
+    _, _, codec, fmt, _, nsamps, payload_bytes = HEADER.unpack_from(data, offset)
+    start = offset + HEADER.size
+    payload = data[start : start + payload_bytes]
+    if len(payload) != payload_bytes:
+        raise ValueError("truncated sc16 frame")
+    if fmt not in FORMATS:
+        raise ValueError(f"unknown sample format {fmt}")
+
+    # one channel per frame, the samples have to fit the payload
+    if codec == CODEC_RAW:
+        needed = 2 * nsamps * np.dtype(FORMATS[fmt][0]).itemsize
+    elif codec == CODEC_PACK12:
+        needed = 3 * nsamps
+    else:
+        needed = 0
+    if needed > payload_bytes:
+        raise ValueError("corrupt sc16 frame, the samples do not fit its payload")
+
+    if codec == CODEC_RAW:
+        iq = np.frombuffer(payload, dtype=FORMATS[fmt][0], count=2 * nsamps)
+    elif codec == CODEC_PACK12:
+        iq = unpack12(payload, nsamps)
+    elif codec == CODEC_ZSTD:
+        import zstandard
+
+        planes = zstandard.ZstdDecompressor().decompress(payload, max_output_size=4 * nsamps)
+        if len(planes) != 4 * nsamps:
+            raise ValueError("corrupt zstd sc16 frame")
+        iq = undelta_planes(planes, nsamps)
+    else:
+        raise ValueError(f"unknown sc16 codec {codec}")
+    return iq, fmt, start + payload_bytes
+
+
+def to_complex(iq, fmt):
+    return (iq[0::2] + 1j * iq[1::2]).astype(np.complex64) / FORMATS[fmt][1]
+
+
+def decode(message):
+    """Decodes one ZMQ message into complex64 samples in [-1, 1)."""
+    iq, fmt, _ = decode_frame(message)
+    return to_complex(iq, fmt)
+
+
+def read_file(path):
+    """Reads a whole capture file (frames back to back) as complex64 in [-1, 1)."""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    parts = []
+    offset = 0
+    while offset < len(data):
+        iq, fmt, offset = decode_frame(data, offset)
+        parts.append(to_complex(iq, fmt))
+    return np.concatenate(parts) if parts else np.zeros(0, dtype=np.complex64)
@@ -21,6 +21,11 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 
+#include "latency_stats.hpp"
+#include "sc16_codec.hpp"
+#include "sample_format.hpp"
+#include "stream_core.hpp"
+
 namespace po = boost::program_options;
 
 zmq::context_t context(1);
@@ -43,141 +48,54 @@ void transmit_worker(size_t nsamps_per_buff, uhd::tx_streamer::sptr tx_stream,
 {
 
     std::vector<sample_t> seq(nsamps_per_buff, SHRT_MAX - 1);
-    std::vector<sample_t *> buffs(num_channels, &seq.front());
-
-    size_t num_total_samps = 0;
-
-    while (num_requested_samples > num_total_samps && !stop_signal_called)
-    {
-        // send a single packet
-        size_t num_tx_samps = tx_stream->send(buffs, nsamps_per_buff, md, timeout);
-
-        // do not use time spec for subsequent packets
-        md.has_time_spec = false;
 
-        if (num_tx_samps < nsamps_per_buff)
-            std::cerr << "Send timeout..." << std::endl;
-
-        num_total_samps += num_tx_samps;
-    }
-
-    // send a mini EOB packet
-    md.end_of_burst = true;
-    tx_stream->send("", 0, md);
+    stream::dispatch_channels(num_channels, [&](auto nc) {
+        constexpr size_t N = decltype(nc)::value;
+        std::array<const sample_t *, N> buffs;
+        buffs.fill(&seq.front());
+        stream::transmit<sample_t, N>(tx_stream, buffs, nsamps_per_buff, num_requested_samples, md, timeout, &stop_signal_called);
+    });
 
     std::cout << std::endl
               << "Waiting for async burst ACK... " << std::flush;
-    uhd::async_metadata_t async_md;
-    bool got_async_burst_ack = false;
-    // loop through all messages for the ACK packet (may have underflow messages in queue)
-    while (not got_async_burst_ack and tx_stream->recv_async_msg(async_md, timeout))
-    {
-        got_async_burst_ack =
-            (async_md.event_code == uhd::async_metadata_t::EVENT_CODE_BURST_ACK);
-    }
+    bool got_async_burst_ack = stream::wait_burst_ack(tx_stream, timeout);
     std::cout << (got_async_burst_ack ? "success" : "fail") << std::endl;
 }
 
+template <typename samp_type>
 void recv_to_file(uhd::usrp::multi_usrp::sptr usrp,
                   const std::string &cpu_format,
                   const std::string &wire_format,
                   size_t samps_per_buff,
                   int num_requested_samples,
                   double start_time,
-                  std::vector<size_t> rx_channel_nums)
+                  std::vector<size_t> rx_channel_nums,
+                  codec::codec_id sample_codec)
 {
-    int num_total_samps = 0;
     // create a receive streamer
     uhd::stream_args_t stream_args(cpu_format, wire_format);
     stream_args.channels = rx_channel_nums;
     uhd::rx_streamer::sptr rx_stream = usrp->get_rx_stream(stream_args);
 
-    // Prepare buffers for received samples and metadata
-    uhd::rx_metadata_t md;
-    std::vector<std::vector<sample_t>> buffs(
-        rx_channel_nums.size(), std::vector<sample_t>(samps_per_buff));
+    // Prepare buffers for received samples
+    std::vector<std::vector<samp_type>> buffs(
+        rx_channel_nums.size(), std::vector<samp_type>(samps_per_buff));
     // create a vector of pointers to point to each of the channel buffers
-    std::vector<sample_t *> buff_ptrs;
+    std::vector<samp_type *> buff_ptrs;
     for (size_t i = 0; i < buffs.size(); i++)
     {
         buff_ptrs.push_back(&buffs[i].front());
     }
 
-    // Create one ofstream object per channel
-    // (use shared_ptr because ofstream is non-copyable)
-    std::vector<std::shared_ptr<std::ofstream>> outfiles;
-    for (size_t i = 0; i < buffs.size(); i++)
-    {
-        const std::string this_filename = str(boost::format("out-%02d.dat") % i);
-        outfiles.push_back(std::shared_ptr<std::ofstream>(
-            new std::ofstream(this_filename.c_str(), std::ofstream::binary)));
-    }
-    UHD_ASSERT_THROW(outfiles.size() == buffs.size());
-    UHD_ASSERT_THROW(buffs.size() == rx_channel_nums.size());
-    bool overflow_message = true;
-    // We increase the first timeout to cover for the delay between now + the
-    // command time, plus 500ms of buffer. In the loop, we will then reduce the
-    // timeout for subsequent receives.
-    double timeout = start_time + 0.5f;
-
-    // setup streaming
-    uhd::stream_cmd_t stream_cmd((num_requested_samples == 0)
-                                     ? uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS
-                                     : uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
-    stream_cmd.num_samps = num_requested_samples;
-    stream_cmd.stream_now = false;
-    stream_cmd.time_spec = uhd::time_spec_t(start_time);
-    rx_stream->issue_stream_cmd(stream_cmd);
-
-    while (not stop_signal_called and (num_requested_samples > num_total_samps or num_requested_samples == 0))
-    {
-        size_t num_rx_samps = rx_stream->recv(buff_ptrs, samps_per_buff, md, timeout);
-        timeout = 0.1f; // small timeout for subsequent recv
-
-        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
-        {
-            std::cout << "Timeout while streaming" << std::endl;
-            break;
-        }
-        if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
-        {
-            if (overflow_message)
-            {
-                overflow_message = false;
-                std::cerr
-                    << boost::format(
-                           "Got an overflow indication. Please consider the following:\n"
-                           "  Your write medium must sustain a rate of %fMB/s.\n"
-                           "  Dropped samples will not be written to the file.\n"
-                           "  Please modify this example for your purposes.\n"
-                           "  This message will not appear again.\n") %
-                           (usrp->get_rx_rate() * sizeof(sample_t) / 1e6);
-            }
-            continue;
-        }
-        if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
-        {
-            throw std::runtime_error("Receiver error " + md.strerror());
-        }
-
-        num_total_samps += num_rx_samps;
-
-        for (size_t i = 0; i < outfiles.size(); i++)
-        {
-            outfiles[i]->write(
-                (const char *)buff_ptrs[i], num_rx_samps * sizeof(sample_t));
-        }
-    }
-
-    // Shut down receiver
-    stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
-    rx_stream->issue_stream_cmd(stream_cmd);
-
-    // Close files
-    for (size_t i = 0; i < outfiles.size(); i++)
-    {
-        outfiles[i]->close();
-    }
+    stream::dispatch_channels(buff_ptrs.size(), [&](auto nc) {
+        constexpr size_t N = decltype(nc)::value;
+        // one file per channel, closed when the sink goes out of scope
+        std::array<std::string, N> filenames;
+        for (size_t i = 0; i < N; i++)
+            filenames[i] = str(boost::format("out-%02d.dat") % i);
+        stream::file_sink<samp_type, N> sink(stream::to_array<samp_type, N>(buff_ptrs), filenames, sample_codec);
+        stream::receive<samp_type, N>(rx_stream, sink, samps_per_buff, num_requested_samples, start_time, usrp->get_rx_rate(), &stop_signal_called);
+    });
 }
 
 int UHD_SAFE_MAIN(int argc, char *argv[])
@@ -194,6 +112,11 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
     double rx_rate, rx_freq, rx_gain, rx_bw;
     double settling;
 
+    std::string stats_file;
+    double stats_period;
+
+    std::string codec_name;
+
     // setup the program options
     po::options_description desc("Allowed options");
     // clang-format off
@@ -202,7 +125,7 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         ("tx-args", po::value<std::string>(&tx_args)->default_value(""), "uhd transmit device address args")
         ("rx-args", po::value<std::string>(&rx_args)->default_value(""), "uhd receive device address args")
         ("file", po::value<std::string>(&file)->default_value("usrp_samples.dat"), "name of the file to write binary samples to")
-        ("type", po::value<std::string>(&type)->default_value("short"), "sample type in file: double, float, or short")
+        ("type", po::value<std::string>(&type)->default_value("short"), "sample type in file: char (sc8), short (sc16) or float (fc32)")
         ("nsamps", po::value<size_t>(&total_num_samps)->default_value(0), "total number of samples to receive")
         ("settling", po::value<double>(&settling)->default_value(double(0.2)), "settling time (seconds) before receiving")
         ("spb", po::value<size_t>(&spb)->default_value(0), "samples per buffer, 0 for default")
@@ -225,6 +148,9 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         ("rx-channels", po::value<std::string>(&rx_channels)->default_value("0"), "which RX channel(s) to use (specify \"0\", \"1\", \"0,1\", etc)")
         ("tx-int-n", "tune USRP TX with integer-N tuning")
         ("rx-int-n", "tune USRP RX with integer-N tuning")
+        ("stats-file", po::value<std::string>(&stats_file)->default_value(""), "append the TX event counts and, with ENABLE_LATENCY_STATS, the latency histograms as JSON lines to this file (\"-\" for stderr)")
+        ("stats-period", po::value<double>(&stats_period)->default_value(1.0), "seconds between two latency stats lines")
+        ("codec", po::value<std::string>(&codec_name)->default_value("raw"), "codec of the stored samples: raw, pack12 (12-bit, lossless with --otw sc12) or zstd (delta + zstd, lossless)")
     ;
     // clang-format on
     po::variables_map vm;
@@ -241,6 +167,8 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
     rx_freq = tx_freq;
     rx_rate = tx_rate;
 
+    stats::reporter stats_reporter(stats_file, stats_period);
+
     // create a usrp device
     std::cout << std::endl;
     std::cout << boost::format("Creating the transmit usrp device with: %s...") % tx_args
@@ -529,7 +457,12 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
     // clean up transmit worker
     // stop_signal_called = true;
 
-    recv_to_file(rx_usrp, "sc16", otw, spb, num_requested_samples, cmd_time + 0.1, tx_channel_nums);
+    codec::codec_id sample_codec = codec::parse_codec(codec_name);
+    sample::format rx_format = sample::parse_type(type);
+    if (sample_codec != codec::codec_id::raw && rx_format != sample::format::sc16)
+        throw std::runtime_error("--codec pack12 and zstd need --type short");
+    sample::dispatch(rx_format, [&](auto tag)
+                     { recv_to_file<decltype(tag)>(rx_usrp, sample::traits<decltype(tag)>::cpu_format, otw, spb, num_requested_samples, cmd_time + 0.1, tx_channel_nums, sample_codec); });
 
     transmit_thread.join();
 
@@ -1,7 +1,8 @@
 import zmq
 import numpy as np
 import sys
-from io import BytesIO
+
+import sc16_codec
 
 
 
@@ -25,7 +26,7 @@ i = 0
 while True:
     try:
         i+=1
-        buff = BytesIO()
+        chunks = []
         print(f"[{i}] ----------------------------------")
         print("Listening for IQ samples")
         socket.RCVTIMEO = rct_default
@@ -34,21 +35,14 @@ while True:
                 message = socket.recv()
             except zmq.error.Again as _e:
                     break
-            buff.write(message)
+            chunks.append(sc16_codec.decode(message))  # any --type / --codec, scaled to [-1, 1)
             print(".", end=" ")
             sys.stdout.flush()
             socket.RCVTIMEO = 1000
 
         print("Done RX'en")
 
-        dt = np.dtype([('re', np.int16), ('im', np.int16)])
-
-        buff.seek(0)
-        a = np.frombuffer(buff.read(), dtype=dt)
-
-        b = np.zeros(len(a), dtype=np.complex64)
-        b[:].real = a['re']/(2**15)
-        b[:].imag = a['im']/(2**15)
+        b = np.concatenate(chunks) if chunks else np.zeros(0, dtype=np.complex64)
 
         sample_rate = int(250e3)
         dt = 1/sample_rate
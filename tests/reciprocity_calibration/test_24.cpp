@@ -15,6 +15,8 @@
 #include <string>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <cmath>
 #include <csignal>
 #include <filesystem>
@@ -24,11 +26,17 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 
-namespace po = boost::program_options;
-
-using sample_dt = short;
+#include "latency_stats.hpp"
+#include "trace_events.hpp"
+#include "thread_placement.hpp"
+#include "sample_arena.hpp"
+#include "sc16_codec.hpp"
+#include "sample_format.hpp"
+#include "stream_core.hpp"
+#include "tx_weights.hpp"
+#include "tx_monitor.hpp"
 
-using sample_t = std::complex<sample_dt>;
+namespace po = boost::program_options;
 
 using sample_fc32 = std::complex<float>;
 
@@ -39,6 +47,28 @@ zmq::socket_t publisher(context, zmq::socket_type::push);
 
 zmq::socket_t socket(context, zmq::socket_type::req);
 
+placement::config thread_placement;
+
+// allocated once in main from the sample arena, reused by every recv_to_file call
+// and viewed as the --type sample type there
+arena::channel_buffers<uint8_t> rx_buffs;
+
+// host sample type of the receive path, set from --type
+sample::format rx_format = sample::format::sc16;
+
+// codec stage in front of publisher, set from --codec
+codec::encoder zmq_encoder(codec::codec_id::raw);
+
+// per-channel beamforming weights on top of the calibration correction, kept
+// across bursts and updated by weights_listener while transmitting
+weights::bank tx_weights;
+
+// beam sweep of the bursts after calibration, set from --codebook (no entries: no sweep)
+weights::codebook beam_codebook;
+
+// owns the async messages of the transmit streamer, set in main
+txmon::monitor *tx_monitor = nullptr;
+
 /***********************************************************************
  * Signal handlers
  **********************************************************************/
@@ -88,159 +118,131 @@ void wait_till_go_from_server(std::string server_ip)
 
 void sync(std::string serial, std::string server_ip, uhd::usrp::multi_usrp::sptr usrp)
 {
+        TRACE_SCOPE("sync");
         // ready_to_go(serial, server_ip);      // non-blocking
         // wait_till_go_from_server(server_ip); // blocking till SYNC message received
         //  This command will be processed fairly soon after the last PPS edge:
         usrp->set_time_next_pps(uhd::time_spec_t(0.0));
         // std::cout << "[SYNC] Resetting time." << std::endl;
+        TRACE_SCOPE("pps_wait");
         std::this_thread::sleep_for(std::chrono::milliseconds(2000));
 }
 
-void transmit_worker(size_t nsamps_per_buff, uhd::tx_streamer::sptr tx_stream,
-                     size_t timeout, size_t num_channels, uhd::tx_metadata_t md, size_t num_requested_samples, sample_fc32 a)
+// Posts the weight updates published on endpoint to tx_weights until it is
+// destroyed, see tx_weights.hpp for the message format
+class weights_listener
 {
-        std::vector<sample_fc32 *> buffs;
-
-        std::vector<sample_fc32> seq_ch1(nsamps_per_buff, a);
-        buffs.push_back(&seq_ch1.front());
-
-        std::vector<sample_fc32> seq_ch2(nsamps_per_buff, a);
-        buffs.push_back(&seq_ch2.front());
-        size_t num_total_samps = 0;
-
-        while (num_requested_samples > num_total_samps && !stop_signal_called)
+public:
+        weights_listener(const std::string &endpoint, size_t num_channels)
+            : _thread([this, endpoint, num_channels]() { run(endpoint, num_channels); })
         {
-                // send a single packet
-                size_t num_tx_samps = tx_stream->send(buffs, nsamps_per_buff, md, timeout);
-
-                // do not use time spec for subsequent packets
-                md.has_time_spec = false;
-
-                if (num_tx_samps < nsamps_per_buff)
-                        std::cerr << "Send timeout..." << std::endl;
-
-                num_total_samps += num_tx_samps;
         }
 
-        // send a mini EOB packet
-        md.end_of_burst = true;
-        tx_stream->send("", 0, md);
-
-        // std::cout << std::endl
-        //           << "Waiting for async burst ACK... " << std::flush;
-        uhd::async_metadata_t async_md;
-        bool got_async_burst_ack = false;
-        // loop through all messages for the ACK packet (may have underflow messages in queue)
-        while (not got_async_burst_ack and tx_stream->recv_async_msg(async_md, timeout))
+        ~weights_listener()
         {
-                got_async_burst_ack =
-                    (async_md.event_code == uhd::async_metadata_t::EVENT_CODE_BURST_ACK);
+                _stop = true;
+                _thread.join();
         }
-        // std::cout << (got_async_burst_ack ? "success" : "fail") << std::endl;
-}
 
-void recv_to_file(std::string id, uhd::rx_streamer::sptr rx_stream,
-                  size_t samps_per_buff,
-                  int num_requested_samples,
-                  double start_time,
-                  std::vector<size_t> rx_channel_nums)
-{
-        int num_total_samps = 0;
-
-        // Prepare buffers for received samples and metadata
-        uhd::rx_metadata_t md;
-        std::vector<std::vector<sample_t>> buffs(
-            rx_channel_nums.size(), std::vector<sample_t>(samps_per_buff));
-        // create a vector of pointers to point to each of the channel buffers
-        std::vector<sample_t *> buff_ptrs;
-        for (size_t i = 0; i < buffs.size(); i++)
+private:
+        void run(const std::string &endpoint, size_t num_channels)
         {
-                buff_ptrs.push_back(&buffs[i].front());
+                trace::set_thread_name("weights_listener");
+                zmq::socket_t subscriber(context, zmq::socket_type::sub);
+                int timeout_ms = 100;
+                zmq_setsockopt(subscriber, ZMQ_RCVTIMEO, &timeout_ms, sizeof(timeout_ms));
+                zmq_setsockopt(subscriber, ZMQ_SUBSCRIBE, "", 0);
+                subscriber.connect(endpoint);
+
+                while (!_stop && !stop_signal_called)
+                {
+                        zmq::message_t msg;
+                        if (!subscriber.recv(msg, zmq::recv_flags::none))
+                                continue;
+                        std::string text(static_cast<char *>(msg.data()), msg.size());
+                        try
+                        {
+                                tx_weights.post(weights::parse(text, num_channels));
+                        }
+                        catch (const std::runtime_error &e)
+                        {
+                                std::cerr << "Ignoring weight update: " << e.what() << std::endl;
+                        }
+                }
         }
 
-        // Create one ofstream object per channel
-        // (use shared_ptr because ofstream is non-copyable)
-        // std::vector<std::shared_ptr<std::ofstream>> outfiles;
-        // for (size_t i = 0; i < buffs.size(); i++)
-        // {
-        //         const std::string this_filename = str(boost::format("out-%02d-%s.dat") % i % id);
-        //         outfiles.push_back(std::shared_ptr<std::ofstream>(
-        //             new std::ofstream(this_filename.c_str(), std::ofstream::binary)));
-        // }
-        // UHD_ASSERT_THROW(outfiles.size() == buffs.size());
-        UHD_ASSERT_THROW(buffs.size() == rx_channel_nums.size());
-        bool overflow_message = true;
-        // We increase the first timeout to cover for the delay between now + the
-        // command time, plus 500ms of buffer. In the loop, we will then reduce the
-        // timeout for subsequent receives.
-        double timeout = start_time + 0.5f;
-
-        // setup streaming
-        uhd::stream_cmd_t stream_cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
-        stream_cmd.num_samps = num_requested_samples;
-        stream_cmd.stream_now = false;
-        stream_cmd.time_spec = uhd::time_spec_t(start_time);
-        rx_stream->issue_stream_cmd(stream_cmd);
-
-        while (not stop_signal_called and (num_requested_samples > num_total_samps or num_requested_samples == 0))
-        {
-                size_t num_rx_samps = rx_stream->recv(buff_ptrs, samps_per_buff, md, timeout);
-                timeout = 0.1f; // small timeout for subsequent recv
+        std::atomic<bool> _stop{false};
+        std::thread _thread;
+};
+
+void transmit_worker(size_t nsamps_per_buff, uhd::tx_streamer::sptr tx_stream,
+                     size_t timeout, size_t num_channels, uhd::tx_metadata_t md, size_t num_requested_samples, sample_fc32 a, double rate, bool calibration, bool sweep)
+{
+        trace::set_thread_name("transmit_worker");
+        placement::apply("tx", thread_placement.tx);
+
+        // every channel sends the same constant baseband value times its weight
+        std::vector<sample_fc32> seq(nsamps_per_buff, a);
 
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+        placement::jitter_meter send_jitter;
+        stream::dispatch_channels(num_channels, [&](auto nc) {
+                constexpr size_t N = decltype(nc)::value;
+                if (calibration)
                 {
-                        std::cout << "Timeout while streaming" << std::endl;
-                        break;
+                        // unit weights: the posted weights are for the data bursts
+                        std::array<const sample_fc32 *, N> buffs;
+                        buffs.fill(seq.data());
+                        stream::transmit<sample_fc32, N>(tx_stream, buffs, nsamps_per_buff, num_requested_samples, md, timeout, &stop_signal_called, &send_jitter);
                 }
-                if (md.error_code == uhd::rx_metadata_t::ERROR_CODE_OVERFLOW)
+                else if (sweep)
                 {
-                        if (overflow_message)
-                        {
-                                overflow_message = false;
-                                std::cerr
-                                    << boost::format(
-                                           "Got an overflow indication. Please consider the following:\n"
-                                           "  Your write medium must sustain a rate of %fMB/s.\n"
-                                           "  Dropped samples will not be written to the file.\n"
-                                           "  Please modify this example for your purposes.\n"
-                                           "  This message will not appear again.\n") %
-                                           (250e3 * sizeof(sample_t) / 1e6);
-                        }
-                        continue;
+                        weights::codebook_source<N> source(beam_codebook, seq, rate);
+                        stream::transmit_from<sample_fc32, N>(tx_stream, source, nsamps_per_buff, num_requested_samples, md, timeout, &stop_signal_called, &send_jitter);
                 }
-                if (md.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE)
+                else
                 {
-                        throw std::runtime_error("Receiver error " + md.strerror());
+                        weights::source<N> source(tx_weights, seq, md.time_spec.get_real_secs(), rate);
+                        stream::transmit_from<sample_fc32, N>(tx_stream, source, nsamps_per_buff, num_requested_samples, md, timeout, &stop_signal_called, &send_jitter);
                 }
+        });
+        send_jitter.report("tx", thread_placement.tx);
 
-                num_total_samps += num_rx_samps;
-
-                unsigned int num_bytes = num_rx_samps * sizeof(sample_t);
-                zmq::message_t message(num_bytes);
-                std::memcpy(message.data(), (const char *)buff_ptrs[0], num_bytes);
-
-                publisher.send(message);
-
-                // for (size_t i = 0; i < outfiles.size(); i++)
-                // {
-                //     outfiles[i]->write(
-                //         (const char *)buff_ptrs[i], num_rx_samps * sizeof(sample_t));
-                // }
-        }
-
-        // Shut down receiver
-        stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
-        rx_stream->issue_stream_cmd(stream_cmd);
+        tx_monitor->wait_burst_ack(timeout);
+        tx_monitor->report_burst();
+}
 
-        // Close files
-        // for (size_t i = 0; i < outfiles.size(); i++)
-        // {
-        //         outfiles[i]->close();
-        // }
+template <typename sample_type>
+void recv_to_file(std::string id, uhd::rx_streamer::sptr rx_stream,
+                  size_t samps_per_buff,
+                  int num_requested_samples,
+                  double start_time,
+                  double rate,
+                  std::vector<size_t> rx_channel_nums)
+{
+        TRACE_SCOPE("rx");
+
+        // the per-channel sample buffers are reused from the session arena
+        arena::channel_buffers<sample_type> buffs = arena::view_as<sample_type>(rx_buffs);
+        UHD_ASSERT_THROW(buffs.ptrs.size() == rx_channel_nums.size());
+        UHD_ASSERT_THROW(samps_per_buff <= buffs.nsamps);
+
+        placement::jitter_meter recv_jitter;
+        stream::dispatch_channels(rx_channel_nums.size(), [&](auto nc) {
+                constexpr size_t N = decltype(nc)::value;
+                auto sink = stream::make_publish_sink(stream::to_array<sample_type, N>(buffs.ptrs), zmq_encoder,
+                                                      [](const uint8_t *data, size_t size) {
+                                                              zmq::message_t message(data, size);
+                                                              publisher.send(message);
+                                                      });
+                stream::receive<sample_type, N>(rx_stream, sink, samps_per_buff, num_requested_samples, start_time, rate, &stop_signal_called, &recv_jitter);
+        });
+        recv_jitter.report("recv", thread_placement.recv);
+        zmq_encoder.report();
 }
 
 sample_fc32 start_cal(std::string id_cal, std::string serial, std::string server_ip, uhd::usrp::multi_usrp::sptr usrp, size_t num_channels, uhd::tx_streamer::sptr tx_stream, uhd::rx_streamer::sptr rx_stream, std::string otw, std::vector<size_t> rx_channel_nums, double rate, sample_fc32 bb_correction = sample_fc32(0.8))
 {
+        TRACE_SCOPE("start_cal");
         sync(serial, server_ip, usrp); // first sync to get absolute time=0
         uhd::tx_metadata_t md;
         md.start_of_burst = false;
@@ -261,15 +263,25 @@ sample_fc32 start_cal(std::string id_cal, std::string serial, std::string server
         size_t spb = tx_stream->get_max_num_samps();
         // std::cout << "nsamps_per_buff: " << spb << std::endl;
 
+        // the calibration bursts (id_cal "0") send the plain baseband on every channel
+        bool calibration = id_cal == "0";
+        bool sweep = !calibration && !beam_codebook.entries.empty();
+
         // start transmit worker thread
         std::thread transmit_thread([&]()
-                                    { transmit_worker(spb, tx_stream, timeout, num_channels, md, num_requested_samples, bb_correction); });
+                                    { transmit_worker(spb, tx_stream, timeout, num_channels, md, num_requested_samples, bb_correction, rate, calibration, sweep); });
 
-        recv_to_file(id_cal, rx_stream, spb, num_requested_samples, cmd_time, rx_channel_nums);
+        sample::dispatch(rx_format, [&](auto tag)
+                         { recv_to_file<decltype(tag)>(id_cal, rx_stream, spb, num_requested_samples, cmd_time, rate, rx_channel_nums); });
 
-        transmit_thread.join();
+        {
+                TRACE_SCOPE("tx_join");
+                transmit_thread.join();
+        }
 
         // get calbration phase
+        // the reply only arrives after the server drained the ZMQ stream and estimated the phase
+        std::unique_ptr<trace::scope> query_scope(new trace::scope("phase_query"));
         // std::cout << "Connecting to receiver ..." << std::endl;
         socket.connect("tcp://localhost:5000");
 
@@ -286,7 +298,11 @@ sample_fc32 start_cal(std::string id_cal, std::string serial, std::string server
         std::string rpl = std::string(static_cast<char *>(reply.data()), reply.size());
         std::cout << "Current phase: " << rpl << "rad" << std::endl;
 
+        query_scope.reset();
+
+        TRACE_SCOPE("correction");
         float phase_diff = std::stof(rpl);
+        trace::counter("phase_rad", phase_diff);
 
         return std::polar<float>(0.8, -phase_diff);
 }
@@ -307,6 +323,21 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         bool ignore_sync;
         std::string server_ip;
 
+        std::string stats_file;
+        double stats_period;
+
+        std::string trace_file;
+
+        int numa_node;
+
+        std::string codec_name;
+
+        std::string weights_endpoint;
+
+        std::string codebook_file;
+        double codebook_dwell;
+        size_t codebook_column;
+
         // setup the program options
         po::options_description desc("Allowed options");
         // clang-format off
@@ -315,7 +346,7 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         ("tx-args", po::value<std::string>(&tx_args)->default_value(""), "uhd transmit device address args")
         ("rx-args", po::value<std::string>(&rx_args)->default_value(""), "uhd receive device address args")
         ("file", po::value<std::string>(&file)->default_value("usrp_samples.dat"), "name of the file to write binary samples to")
-        ("type", po::value<std::string>(&type)->default_value("short"), "sample type in file: double, float, or short")
+        ("type", po::value<std::string>(&type)->default_value("short"), "sample type of the received samples and ZMQ frames: char (sc8), short (sc16) or float (fc32)")
         ("nsamps", po::value<size_t>(&total_num_samps)->default_value(0), "total number of samples to receive")
         ("settling", po::value<double>(&settling)->default_value(double(0.2)), "settling time (seconds) before receiving")
         ("spb", po::value<size_t>(&spb)->default_value(0), "samples per buffer, 0 for default")
@@ -340,11 +371,24 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         ("rx-int-n", "tune USRP RX with integer-N tuning")
         ("ignore-server", po::bool_switch(&ignore_sync), "Discard waiting till SYNC server")
         ("server-ip", po::value<std::string>(&server_ip), "Server local IP address")
+        ("stats-file", po::value<std::string>(&stats_file)->default_value(""), "append the TX event counts and, with ENABLE_LATENCY_STATS, the latency histograms as JSON lines to this file (\"-\" for stderr)")
+        ("stats-period", po::value<double>(&stats_period)->default_value(1.0), "seconds between two latency stats lines")
+        ("trace-file", po::value<std::string>(&trace_file)->default_value(""), "write a Chrome trace / Perfetto JSON timeline of the calibration cycles to this file")
+        ("codec", po::value<std::string>(&codec_name)->default_value("raw"), "codec of the ZMQ sample frames: raw, pack12 (12-bit, lossless with --otw sc12) or zstd (delta + zstd, lossless)")
+        ("weights-endpoint", po::value<std::string>(&weights_endpoint)->default_value(""), "subscribe to beamforming weight updates (\"[@time] re im [re im]\", one pair per TX channel) on this ZMQ endpoint, e.g. tcp://192.168.1.10:5558")
+        ("codebook", po::value<std::string>(&codebook_file)->default_value(""), "sweep the beams of this codebook file after calibration, one entry per line (see common/tx_weights.hpp)")
+        ("codebook-dwell", po::value<double>(&codebook_dwell)->default_value(0.01), "seconds every codebook entry is on air")
+        ("codebook-column", po::value<size_t>(&codebook_column)->default_value(0), "codebook column of TX channel 0 of this tile, e.g. tile index times the number of TX channels")
+        ("numa-node", po::value<int>(&numa_node)->default_value(-1), "bind the sample buffers to this NUMA node, e.g. the node of the USB controller (-1: node of the receive thread)")
+        ("placement-file", po::value<std::string>(&thread_placement.file)->default_value(""), "read the thread placement options below from this config file (command line wins)")
     ;
         // clang-format on
+        desc.add(placement::options(thread_placement));
         po::variables_map vm;
         po::store(po::parse_command_line(argc, argv, desc), vm);
         po::notify(vm);
+        placement::load_file(thread_placement.file, desc, vm);
+        po::notify(vm);
 
         // print the help message
         if (vm.count("help"))
@@ -356,8 +400,18 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         rx_freq = tx_freq;
         rx_rate = tx_rate;
 
+        rx_format = sample::parse_type(type);
+        zmq_encoder = codec::encoder(codec::parse_codec(codec_name));
+        if (zmq_encoder.id() != codec::codec_id::raw && rx_format != sample::format::sc16)
+                throw std::runtime_error("--codec pack12 and zstd need --type short");
+
         publisher.bind("tcp://*:5555");
 
+        stats::reporter stats_reporter(stats_file, stats_period);
+
+        trace::session trace_session(trace_file);
+        trace::set_thread_name("main");
+
         // create a usrp device
         std::cout << std::endl;
         std::cout << "Creating the usrp device in integer mode args..." << std::endl;
@@ -519,10 +573,14 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         stream_args.channels = tx_channel_nums;
         uhd::tx_streamer::sptr tx_stream = usrp->get_tx_stream(stream_args);
 
+        // drains the underflow, sequence and time errors while bursts are running
+        txmon::monitor monitor(tx_stream);
+        tx_monitor = &monitor;
+
         int num_channels = tx_channel_nums.size();
 
         // create a receive streamer
-        uhd::stream_args_t rx_stream_args("sc16", otw);
+        uhd::stream_args_t rx_stream_args(sample::cpu_format(rx_format), otw);
         rx_stream_args.channels = rx_channel_nums;
         uhd::rx_streamer::sptr rx_stream = usrp->get_rx_stream(rx_stream_args);
 
@@ -587,6 +645,29 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
         /**************** start tuning **************/
         /********************************************/
 
+        if (!codebook_file.empty())
+        {
+                beam_codebook = weights::load_codebook(codebook_file, num_channels, codebook_column, codebook_dwell);
+                std::cout << boost::format("Sweeping %d codebook entries, %f s each") % beam_codebook.entries.size() % codebook_dwell << std::endl;
+        }
+
+        // started before the receive placement below, like the UHD and ZMQ threads
+        std::unique_ptr<weights_listener> listener;
+        if (!weights_endpoint.empty())
+                listener.reset(new weights_listener(weights_endpoint, num_channels));
+
+        // the receive loop runs on the main thread, placed only now so the UHD
+        // and ZMQ threads created above do not inherit its affinity and priority
+        placement::apply("recv", thread_placement.recv);
+        placement::lock_memory(thread_placement.lock_memory);
+
+        // one huge-page arena for the whole session, pre-faulted by the receive thread
+        // and sized for the largest sample type
+        size_t rx_spb = std::max(tx_stream->get_max_num_samps(), rx_stream->get_max_num_samps());
+        size_t rx_bytes = rx_spb * sizeof(std::complex<float>);
+        arena::sample_arena rx_arena(arena::sample_arena::channel_bytes<uint8_t>(rx_channel_nums.size(), rx_bytes), numa_node);
+        rx_buffs = rx_arena.allocate_channels<uint8_t>(rx_channel_nums.size(), rx_bytes);
+
         bool calibrated = false;
         sample_fc32 a = start_cal("0", serial, server_ip, usrp, num_channels, tx_stream, rx_stream, otw, rx_channel_nums, tx_rate);
 
@@ -639,7 +720,8 @@ int UHD_SAFE_MAIN(int argc, char *argv[])
 
                 std::cout << "Using USRP Device: " << usrp->get_pp_string() << std::endl;
 
-                recv_to_file("1", rx_stream, spb, num_requested_samples, cmd_time, rx_channel_nums);
+                sample::dispatch(rx_format, [&](auto tag)
+                                 { recv_to_file<decltype(tag)>("1", rx_stream, spb, num_requested_samples, cmd_time, tx_rate, rx_channel_nums); });
 
                 
         }